@@ -0,0 +1,42 @@
+/**
+ * Claim the tokens the UG_Rewards group of the manager owes to the user
+ */
+import { Keypair, PublicKey } from '@solana/web3.js';
+import {
+  claim,
+  getMember,
+  createGroupPoolAddress,
+  establishConnection,
+  loadManager,
+  loadProgramId,
+  loadTokenId,
+  TOKEN_ID,
+  UPALA_PROGRAM_ID,
+  USER_1_KEYPAIR_PATH
+} from './lib';
+import { readAccountFromFile } from './utils';
+
+async function main() {
+  console.log("#CLAIM_REWARDS");
+  await establishConnection();
+  await loadProgramId();
+  await loadTokenId();
+  const user:Keypair = await readAccountFromFile(USER_1_KEYPAIR_PATH);
+  console.log(user.publicKey.toBase58());
+
+  const manager:Keypair = await loadManager();
+  const group_id:PublicKey = await createGroupPoolAddress([manager.publicKey, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Associated token account:', group_id.toBase58());
+
+  const member = await getMember(group_id, user.publicKey);
+  console.log('Pending tokens:', member ? member.pending.toString() : 'not a member');
+  await claim(group_id, user.publicKey, user);
+}
+
+main().then(
+  () => process.exit(),
+  err => {
+    console.error(err);
+    process.exit(-1);
+  },
+);
@@ -8,6 +8,7 @@ import {
   loadProgramId,
   loadTokenId,
   mintToPool,
+  UpalaGroupFlags,
 } from './lib';
 
 async function main() {
@@ -15,7 +16,13 @@ async function main() {
   await establishConnection();
   await loadProgramId();
   await loadTokenId();
-  const ata:PublicKey = await create();
+  // `npm run create-group -- --score-index` keeps the members ranked by score,
+  // `-- --merkle` keeps the Merkle root of the members instead of the members,
+  // `-- --rewards` pays the deposits out to the members by score
+  const flags = (process.argv.includes('--score-index') ? UpalaGroupFlags.UG_ScoreIndex : 0) |
+                (process.argv.includes('--merkle') ? UpalaGroupFlags.UG_Merkle : 0) |
+                (process.argv.includes('--rewards') ? UpalaGroupFlags.UG_Rewards : 0);
+  const ata:PublicKey = await create(flags);
   // await mintToPool(ata);
 }
 
@@ -0,0 +1,32 @@
+/**
+ * Pay the pool of the upala group out to its users in one instruction
+ */
+import { Keypair } from '@solana/web3.js';
+import {
+  distribute,
+  establishConnection,
+  loadProgramId,
+  loadTokenId,
+  UpalaDistribution,
+  USER_1_KEYPAIR_PATH
+} from './lib';
+import { readAccountFromFile } from './utils';
+
+async function main() {
+  console.log("#DISTRIBUTE_POOL");
+  await establishConnection();
+  await loadProgramId();
+  await loadTokenId();
+  const user:Keypair = await readAccountFromFile(USER_1_KEYPAIR_PATH);
+  console.log(user.publicKey.toBase58());
+
+  await distribute([user.publicKey], [1], UpalaDistribution.UD_Weights);
+}
+
+main().then(
+  () => process.exit(),
+  err => {
+    console.error(err);
+    process.exit(-1);
+  },
+);
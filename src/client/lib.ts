@@ -13,6 +13,7 @@ import {
   sendAndConfirmTransaction,
 } from '@solana/web3.js';
 import fs from 'mz/fs';
+import { createHash } from 'crypto';
 import path from 'path';
 
 import { 
@@ -33,9 +34,72 @@ enum UpalaInstution
   UI_AddUser,      // 3
   UI_RemoveUser,   // 4
   UI_SetScore,     // 5
-  UI_CleanStorage  // 6
+  UI_CleanStorage, // 6
+  UI_Migrate,      // 7
+  UI_Batch,        // 8
+  UI_Distribute,   // 9
+  UI_CreateShard,  // 10
+  UI_GetGroup,     // 11
+  UI_GetMember,    // 12
+  UI_ListMembers,  // 13
+  UI_SetRoot,      // 14
+  UI_VerifyMember, // 15
+  UI_Deposit,      // 16
+  UI_Claim         // 17
 };
 
+/**
+ * How UI_Distribute reads the values of the recipients
+ */
+export enum UpalaDistribution
+{
+  UD_Amounts,      // Token amounts
+  UD_Weights,      // Shares of the pool balance
+};
+
+/**
+ * Options of a group, passed to UI_CreatePool
+ */
+export enum UpalaGroupFlags
+{
+  UG_ScoreIndex = 1, // Keeps the ranks of the members by score
+  UG_Merkle = 2,     // Keeps the Merkle root of the members instead of the members
+  UG_Rewards = 4,    // Pays the pool deposits out to the members by score, claimed by UI_Claim
+};
+
+/**
+ * Operation of the UI_Batch instruction, the accounts are indexes of the instruction keys
+ */
+interface UpalaOperation
+{
+  instruction: UpalaInstution;
+  pool?: number;
+  group?: number;
+  user?: number;
+  user_at?: number;
+  payload?: Buffer;
+};
+
+const UPALA_NO_ACCOUNT = 0xff;
+
+function encodeBatch(operations: Array<UpalaOperation>): Buffer
+{
+  const buffers = [Buffer.from([operations.length])];
+  for (const op of operations)
+  {
+    const payload = op.payload ?? Buffer.alloc(0);
+    const header = Buffer.alloc(7);
+    header.writeUInt8(op.instruction, 0);
+    header.writeUInt8(op.pool ?? UPALA_NO_ACCOUNT, 1);
+    header.writeUInt8(op.group ?? UPALA_NO_ACCOUNT, 2);
+    header.writeUInt8(op.user ?? UPALA_NO_ACCOUNT, 3);
+    header.writeUInt8(op.user_at ?? UPALA_NO_ACCOUNT, 4);
+    header.writeUInt16LE(payload.length, 5);
+    buffers.push(header, payload);
+  }
+  return Buffer.concat(buffers);
+}
+
 /**
  * Connection to the network
  */
@@ -97,13 +161,99 @@ async function findAssociatedTokenAddress(
   ))[0];
 }
 
+export async function findGroupAddress(group_id: PublicKey): Promise<PublicKey>
+{
+  return (await PublicKey.findProgramAddress(
+      [Buffer.from('group'), group_id.toBuffer(), TOKEN_ID.toBuffer(), UPALA_PROGRAM_ID.toBuffer()],
+      UPALA_PROGRAM_ID
+  ))[0];
+}
+
+/**
+ * Registry of the user keys, the groups hold the indexes of their members in it
+ */
+export async function findRegistryAddress(): Promise<PublicKey>
+{
+  return (await PublicKey.findProgramAddress(
+      [Buffer.from('users'), TOKEN_ID.toBuffer(), UPALA_PROGRAM_ID.toBuffer()],
+      UPALA_PROGRAM_ID
+  ))[0];
+}
+
+function shardSeed(shard: number): Buffer
+{
+  const seed = Buffer.alloc(2);
+  seed.writeUInt16LE(shard, 0);
+  return seed;
+}
+
+/**
+ * Shard account holding the groups of the shard `shard` of a sharded storage
+ */
+export async function findShardAddress(shard: number): Promise<PublicKey>
+{
+  return (await PublicKey.findProgramAddress(
+      [Buffer.from('shard'), TOKEN_ID.toBuffer(), UPALA_PROGRAM_ID.toBuffer(), shardSeed(shard)],
+      UPALA_PROGRAM_ID
+  ))[0];
+}
+
+/**
+ * Registry of the user keys of the shard `shard` of a sharded storage
+ */
+export async function findShardRegistryAddress(shard: number): Promise<PublicKey>
+{
+  return (await PublicKey.findProgramAddress(
+      [Buffer.from('users'), TOKEN_ID.toBuffer(), UPALA_PROGRAM_ID.toBuffer(), shardSeed(shard)],
+      UPALA_PROGRAM_ID
+  ))[0];
+}
+
+/**
+ * Create the shard `shard` of a storage spread over `count` shards, and its registry.
+ * The first shard fixes the count, the storage must hold no group yet
+ */
+export async function createShard(count: number, shard: number): Promise<PublicKey>
+{
+  const manager:Keypair = await loadManager();
+  const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  const shard_account:PublicKey = await findShardAddress(shard);
+  console.log('Shard account:', shard_account.toBase58());
+
+  const data = Buffer.alloc(5);
+  data.writeUInt8(UpalaInstution.UI_CreateShard, 0);
+  data.writeUInt16LE(count, 1);
+  data.writeUInt16LE(shard, 3);
+
+  const instruction = new TransactionInstruction(
+    {
+    keys: [
+        {pubkey: manager.publicKey,         isSigner: true, isWritable: true},   // 0
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: true},  // 1
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 2
+        {pubkey: SystemProgram.programId,   isSigner: false, isWritable: false}, // 3
+        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 4
+        {pubkey: await findShardRegistryAddress(shard), isSigner: false, isWritable: true}, // 5
+        {pubkey: shard_account,             isSigner: false, isWritable: true},  // 6
+      ],
+    programId: UPALA_PROGRAM_ID,
+    data: data,
+  });
+
+  const signers = [manager];
+  console.log('Transaction Signature (create shard)',
+    await sendAndConfirmTransaction(connection, new Transaction().add(instruction), signers));
+
+  return shard_account;
+}
+
 export async function printPubkey(key:string): Promise<Uint8Array> 
 {
   let pk:PublicKey = new PublicKey(key);
   return Uint8Array.from(pk.toBuffer());
 }
 
-export async function create(): Promise<PublicKey>
+export async function create(flags: number = 0): Promise<PublicKey>
 {
   const manager:Keypair = await loadManager();
   const pool_at_account:PublicKey = await createGroupPoolAddress([manager.publicKey, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
@@ -112,8 +262,12 @@ export async function create(): Promise<PublicKey>
   const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
   console.log('Upala manager account:', pools_manager_account.toBase58());
 
-  const data_instruction = Buffer.alloc(1);
+  const group_account:PublicKey = await findGroupAddress(pool_at_account);
+  console.log('Group account:', group_account.toBase58());
+
+  const data_instruction = Buffer.alloc(2);
   data_instruction.writeUInt8(UpalaInstution.UI_CreatePool, 0);
+  data_instruction.writeUInt8(flags, 1);
   console.log("Data instruction of UpalaInstution.UI_CreatePool (hex):", data_instruction.toString('hex'));
   
   const instruction = new TransactionInstruction(
@@ -123,10 +277,10 @@ export async function create(): Promise<PublicKey>
         {pubkey: pool_at_account,           isSigner: false, isWritable: true},  // 1
         {pubkey: pools_manager_account,     isSigner: false, isWritable: true},  // 2
         {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 3
-        {pubkey: UPALA_PROGRAM_ID,          isSigner: false, isWritable: false}, // 4 
-        {pubkey: SystemProgram.programId,   isSigner: false, isWritable: false}, // 5
-        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 6
-        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 7
+        {pubkey: SystemProgram.programId,   isSigner: false, isWritable: false}, // 4
+        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 5
+        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 6
+        {pubkey: group_account,             isSigner: false, isWritable: true},  // 7
       ],
     programId: UPALA_PROGRAM_ID,
     data: data_instruction,
@@ -175,13 +329,9 @@ export async function cleanStorage(): Promise<PublicKey>
     {
     keys: [
         {pubkey: manager.publicKey,         isSigner: true, isWritable: true},   // 0
-        {pubkey: associated_account_address,isSigner: false, isWritable: true},  // 1
-        {pubkey: upala_manager_address,     isSigner: false, isWritable: true},  // 2
-        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 3
-        {pubkey: UPALA_PROGRAM_ID,          isSigner: false, isWritable: false}, // 4 
-        {pubkey: SystemProgram.programId,   isSigner: false, isWritable: false}, // 5
-        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 6
-        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 7
+        {pubkey: upala_manager_address,     isSigner: false, isWritable: true},  // 1
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 2
+        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 3
       ],
     programId: UPALA_PROGRAM_ID,
     data: data_instruction,
@@ -211,6 +361,203 @@ export async function cleanStorage(): Promise<PublicKey>
   return associated_account_address;
 }
 
+export async function removePool(): Promise<PublicKey>
+{
+  const manager:Keypair = await loadManager();
+  console.log('Group manager account:', manager.publicKey.toBase58());
+
+  const pool_at_account:PublicKey = await createGroupPoolAddress([manager.publicKey, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Associated token account:', pool_at_account.toBase58());
+
+  const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Upala manager account:', pools_manager_account.toBase58());
+
+  const group_account:PublicKey = await findGroupAddress(pool_at_account);
+  console.log('Group account:', group_account.toBase58());
+
+  const data_instruction = Buffer.alloc(1);
+  data_instruction.writeUInt8(UpalaInstution.UI_RemovePool, 0);
+  console.log("Data instruction of UpalaInstution.UI_RemovePool (hex):", data_instruction.toString('hex'));
+  
+  const instruction = new TransactionInstruction(
+    {
+    keys: [
+        {pubkey: manager.publicKey,         isSigner: true, isWritable: true},   // 0
+        {pubkey: pool_at_account,           isSigner: false, isWritable: false}, // 1
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: true},  // 2
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 3
+        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 4
+        {pubkey: group_account,             isSigner: false, isWritable: true},  // 5
+      ],
+    programId: UPALA_PROGRAM_ID,
+    data: data_instruction,
+  });
+  
+  let tx = new Transaction().add(instruction);
+	tx.recentBlockhash	= (await connection.getRecentBlockhash()).blockhash;
+	tx.feePayer			    = manager.publicKey;
+	tx.sign(manager);
+
+	const signers = [manager];
+	const resultTxSimul = await connection.simulateTransaction(tx, signers);
+	const txResponse = resultTxSimul.value;
+	
+  console.error("Transaction error:", txResponse.err);
+  if (txResponse.err == null)
+	{
+		console.log('Transaction Signature (remove group)', 
+      await sendAndConfirmTransaction(
+        connection,
+        tx,
+        signers
+      ));
+	}
+	console.log(txResponse.logs);
+
+  return pool_at_account;
+}
+
+/**
+ * Upgrade the storage and the group account of the manager to the current layout
+ */
+export async function migrate(): Promise<PublicKey>
+{
+  const manager:Keypair = await loadManager();
+  console.log('Group manager account:', manager.publicKey.toBase58());
+
+  const pool_at_account:PublicKey = await createGroupPoolAddress([manager.publicKey, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Associated token account:', pool_at_account.toBase58());
+
+  const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Upala manager account:', pools_manager_account.toBase58());
+
+  const group_account:PublicKey = await findGroupAddress(pool_at_account);
+  console.log('Group account:', group_account.toBase58());
+
+  const data_instruction = Buffer.alloc(1);
+  data_instruction.writeUInt8(UpalaInstution.UI_Migrate, 0);
+  console.log("Data instruction of UpalaInstution.UI_Migrate (hex):", data_instruction.toString('hex'));
+  
+  const instruction = new TransactionInstruction(
+    {
+    keys: [
+        {pubkey: manager.publicKey,         isSigner: true, isWritable: true},   // 0
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: true},  // 1
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 2
+        {pubkey: SystemProgram.programId,   isSigner: false, isWritable: false}, // 3
+        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 4
+        {pubkey: group_account,             isSigner: false, isWritable: true},  // 5
+        {pubkey: await findRegistryAddress(), isSigner: false, isWritable: true}, // 6
+      ],
+    programId: UPALA_PROGRAM_ID,
+    data: data_instruction,
+  });
+  
+  let tx = new Transaction().add(instruction);
+	tx.recentBlockhash	= (await connection.getRecentBlockhash()).blockhash;
+	tx.feePayer			    = manager.publicKey;
+	tx.sign(manager);
+
+	const signers = [manager];
+	const resultTxSimul = await connection.simulateTransaction(tx, signers);
+	const txResponse = resultTxSimul.value;
+	
+  console.error("Transaction error:", txResponse.err);
+  if (txResponse.err == null)
+	{
+		console.log('Transaction Signature (migrate layout)', 
+      await sendAndConfirmTransaction(
+        connection,
+        tx,
+        signers
+      ));
+	}
+	console.log(txResponse.logs);
+
+  return pool_at_account;
+}
+
+/**
+ * Create the group of the manager and add the users in one UI_Batch instruction
+ */
+export async function provision(users: Array<PublicKey>, scores: Array<number>): Promise<PublicKey>
+{
+  const manager:Keypair = await loadManager();
+  const pool_at_account:PublicKey = await createGroupPoolAddress([manager.publicKey, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Associated token account:', pool_at_account.toBase58());
+
+  const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Upala manager account:', pools_manager_account.toBase58());
+
+  const group_account:PublicKey = await findGroupAddress(pool_at_account);
+  console.log('Group account:', group_account.toBase58());
+
+  // The shared accounts of UI_Batch, then the accounts the operations address
+  const keys = [
+    {pubkey: manager.publicKey,         isSigner: true, isWritable: true},   // 0
+    {pubkey: pools_manager_account,     isSigner: false, isWritable: true},  // 1
+    {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 2
+    {pubkey: SystemProgram.programId,   isSigner: false, isWritable: false}, // 3
+    {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 4
+    {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 5
+    {pubkey: await findRegistryAddress(), isSigner: false, isWritable: true}, // 6
+    {pubkey: pools_manager_account,     isSigner: false, isWritable: true},  // 7, the shard slot of an unsharded storage
+    {pubkey: pool_at_account,           isSigner: false, isWritable: true},  // 8
+    {pubkey: group_account,             isSigner: false, isWritable: true},  // 9
+  ];
+  const operations: Array<UpalaOperation> = [{instruction: UpalaInstution.UI_CreatePool, pool: 8, group: 9}];
+
+  for (let i = 0; i < users.length; i++)
+  {
+    const user_at_account:PublicKey = await createGroupPoolAddress([users[i], TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+    keys.push({pubkey: users[i],        isSigner: false, isWritable: false});
+    keys.push({pubkey: user_at_account, isSigner: false, isWritable: true});
+
+    const buffer_count = Buffer.alloc(1);
+    buffer_count.writeUInt8(1, 0);
+    const buffer_score = Buffer.alloc(8);
+    buffer_score.writeBigUInt64LE(BigInt(scores[i]), 0);
+    operations.push({
+      instruction: UpalaInstution.UI_AddUser,
+      group: 9, user: keys.length - 2, user_at: keys.length - 1,
+      payload: Buffer.concat([pool_at_account.toBuffer(), buffer_count, users[i].toBuffer(), buffer_score]),
+    });
+  }
+
+  const data = Buffer.concat([Buffer.from([UpalaInstution.UI_Batch]), encodeBatch(operations)]);
+  console.log("Data instruction of UpalaInstution.UI_Batch (hex):", data.toString('hex'));
+
+  const instruction = new TransactionInstruction(
+    {
+    keys: keys,
+    programId: UPALA_PROGRAM_ID,
+    data: data,
+  });
+
+  let tx = new Transaction().add(instruction);
+	tx.recentBlockhash	= (await connection.getRecentBlockhash()).blockhash;
+	tx.feePayer			    = manager.publicKey;
+	tx.sign(manager);
+
+	const signers = [manager];
+	const resultTxSimul = await connection.simulateTransaction(tx, signers);
+	const txResponse = resultTxSimul.value;
+
+  console.error("Transaction error:", txResponse.err);
+  if (txResponse.err == null)
+	{
+		console.log('Transaction Signature (provision group)',
+      await sendAndConfirmTransaction(
+        connection,
+        tx,
+        signers
+      ));
+	}
+	console.log(txResponse.logs);
+
+  return pool_at_account;
+}
+
 export async function addUser(group_id: PublicKey, user_account: PublicKey, score: Number): Promise<PublicKey>
 {
   console.log('User account:', user_account.toBase58(), 'Score:', score);
@@ -227,7 +574,9 @@ export async function addUser(group_id: PublicKey, user_account: PublicKey, scor
   const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
   console.log('Upala manager account:', pools_manager_account.toBase58());
 
-  const data_instruction = Buffer.alloc(1);
+  const group_account:PublicKey = await findGroupAddress(group_id);
+  console.log('Group account:', group_account.toBase58());
+
   const buffer_cmd = Buffer.alloc(1);
   buffer_cmd.writeUInt8(UpalaInstution.UI_AddUser, 0);
   const buffer_count = Buffer.alloc(1);
@@ -250,15 +599,15 @@ export async function addUser(group_id: PublicKey, user_account: PublicKey, scor
     {
     keys: [
         {pubkey: manager.publicKey,         isSigner: true, isWritable: true},   // 0
-        {pubkey: pool_at_account,           isSigner: false, isWritable: true},  // 1
-        {pubkey: pools_manager_account,     isSigner: false, isWritable: true},  // 2
-        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 3
-        {pubkey: UPALA_PROGRAM_ID,          isSigner: false, isWritable: false}, // 4 
-        {pubkey: SystemProgram.programId,   isSigner: false, isWritable: false}, // 5
-        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 6
-        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 7
-        {pubkey: user_account,              isSigner: false, isWritable: false}, // 8
-        {pubkey: user_at_account,           isSigner: false, isWritable: true}, // 8
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: false}, // 1
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 2
+        {pubkey: SystemProgram.programId,   isSigner: false, isWritable: false}, // 3
+        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 4
+        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 5
+        {pubkey: group_account,             isSigner: false, isWritable: true},  // 6
+        {pubkey: user_account,              isSigner: false, isWritable: false}, // 7
+        {pubkey: user_at_account,           isSigner: false, isWritable: true},  // 8
+        {pubkey: await findRegistryAddress(), isSigner: false, isWritable: true}, // 9
       ],
     programId: UPALA_PROGRAM_ID,
     data: data,
@@ -288,6 +637,160 @@ export async function addUser(group_id: PublicKey, user_account: PublicKey, scor
   return pool_at_account;
 }
 
+/**
+ * Send an instruction changing the members of the group: gid | count, then the entries
+ */
+async function changeMembers(instruction: UpalaInstution, group_id: PublicKey, entries: Array<Buffer>): Promise<PublicKey>
+{
+  const manager:Keypair = await loadManager();
+  console.log('Group manager account:', manager.publicKey.toBase58());
+
+  const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Upala manager account:', pools_manager_account.toBase58());
+
+  const group_account:PublicKey = await findGroupAddress(group_id);
+  console.log('Group account:', group_account.toBase58());
+
+  const data = Buffer.concat([Buffer.from([instruction]), group_id.toBuffer(), Buffer.from([entries.length]), ...entries]);
+  console.log("Data instruction of", UpalaInstution[instruction], "(hex):", data.toString('hex'));
+
+  const instruction_tx = new TransactionInstruction(
+    {
+    keys: [
+        {pubkey: manager.publicKey,         isSigner: true, isWritable: false},  // 0
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: false}, // 1
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 2
+        {pubkey: group_account,             isSigner: false, isWritable: true},  // 3
+        {pubkey: await findRegistryAddress(), isSigner: false, isWritable: false}, // 4
+      ],
+    programId: UPALA_PROGRAM_ID,
+    data: data,
+  });
+
+  let tx = new Transaction().add(instruction_tx);
+	tx.recentBlockhash	= (await connection.getRecentBlockhash()).blockhash;
+	tx.feePayer			    = manager.publicKey;
+	tx.sign(manager);
+
+	const signers = [manager];
+	const resultTxSimul = await connection.simulateTransaction(tx, signers);
+	const txResponse = resultTxSimul.value;
+
+  console.error("Transaction error:", txResponse.err);
+  if (txResponse.err == null)
+	{
+		console.log('Transaction Signature (change members)',
+      await sendAndConfirmTransaction(
+        connection,
+        tx,
+        signers
+      ));
+	}
+	console.log(txResponse.logs);
+
+  return group_id;
+}
+
+export async function setScore(group_id: PublicKey, users: Array<PublicKey>, scores: Array<number>): Promise<PublicKey>
+{
+  const entries = users.map((user:PublicKey, i:number) => {
+    const buffer_score = Buffer.alloc(8);
+    buffer_score.writeBigUInt64LE(BigInt(scores[i]), 0);
+    return Buffer.concat([user.toBuffer(), buffer_score]);
+  });
+  return await changeMembers(UpalaInstution.UI_SetScore, group_id, entries);
+}
+
+function sha256(parts: Array<Buffer>): Buffer
+{
+  const hash = createHash('sha256');
+  parts.forEach((part:Buffer) => hash.update(part));
+  return hash.digest();
+}
+
+/**
+ * Leaf of a member of a UG_Merkle group, as upala_merkle_leaf() hashes it
+ */
+export function merkleLeaf(user: PublicKey, score: number): Buffer
+{
+  const buffer_score = Buffer.alloc(8);
+  buffer_score.writeBigUInt64LE(BigInt(score), 0);
+  return sha256([Buffer.from([0]), user.toBuffer(), buffer_score]);
+}
+
+function merkleNode(one: Buffer, two: Buffer): Buffer
+{
+  return Buffer.compare(one, two) <= 0
+    ? sha256([Buffer.from([1]), one, two])
+    : sha256([Buffer.from([1]), two, one]);
+}
+
+/**
+ * Root of the members of a UG_Merkle group and the proof of every member.
+ * The leaves are paired in the order given, a node without sibling goes up unchanged
+ */
+export function merkleTree(users: Array<PublicKey>, scores: Array<number>): {root: Buffer, proofs: Array<Array<Buffer>>}
+{
+  let level = users.map((user:PublicKey, i:number) => merkleLeaf(user, scores[i]));
+  const positions = users.map((_, i:number) => i);
+  const proofs: Array<Array<Buffer>> = users.map(() => []);
+  while (level.length > 1)
+  {
+    positions.forEach((position:number, i:number) => {
+      if ((position ^ 1) < level.length)
+      {
+        proofs[i].push(level[position ^ 1]);
+      }
+      positions[i] = position >> 1;
+    });
+    const next: Array<Buffer> = [];
+    for (let j = 0; j < level.length; j += 2)
+    {
+      next.push(j + 1 < level.length ? merkleNode(level[j], level[j + 1]) : level[j]);
+    }
+    level = next;
+  }
+  return {root: level.length > 0 ? level[0] : Buffer.alloc(32), proofs: proofs};
+}
+
+/**
+ * Replace the members of the UG_Merkle group of the manager, returns the proofs of the members
+ */
+export async function setRoot(group_id: PublicKey, users: Array<PublicKey>, scores: Array<number>): Promise<Array<Array<Buffer>>>
+{
+  const manager:Keypair = await loadManager();
+  const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  const tree = merkleTree(users, scores);
+
+  const buffer_members = Buffer.alloc(4);
+  buffer_members.writeUInt32LE(users.length, 0);
+  const data = Buffer.concat([Buffer.from([UpalaInstution.UI_SetRoot]), group_id.toBuffer(), tree.root, buffer_members]);
+  console.log("Data instruction of UpalaInstution.UI_SetRoot (hex):", data.toString('hex'));
+
+  const instruction = new TransactionInstruction(
+    {
+    keys: [
+        {pubkey: manager.publicKey,         isSigner: true, isWritable: false},  // 0
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: false}, // 1
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 2
+        {pubkey: await findGroupAddress(group_id), isSigner: false, isWritable: true}, // 3
+      ],
+    programId: UPALA_PROGRAM_ID,
+    data: data,
+  });
+
+  const signers = [manager];
+  console.log('Transaction Signature (set root)',
+    await sendAndConfirmTransaction(connection, new Transaction().add(instruction), signers));
+
+  return tree.proofs;
+}
+
+export async function removeUser(group_id: PublicKey, users: Array<PublicKey>): Promise<PublicKey>
+{
+  return await changeMembers(UpalaInstution.UI_RemoveUser, group_id, users.map((user:PublicKey) => user.toBuffer()));
+}
+
 export async function empty(user_account: Keypair): Promise<PublicKey>
 {
   const manager:Keypair = await loadManager();
@@ -302,6 +805,9 @@ export async function empty(user_account: Keypair): Promise<PublicKey>
   const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
   console.log('Upala manager account:', pools_manager_account.toBase58());
 
+  const group_account:PublicKey = await findGroupAddress(pool_at_account);
+  console.log('Group account:', group_account.toBase58());
+
   const buffer_cmd = Buffer.alloc(1);
   buffer_cmd.writeUInt8(UpalaInstution.UI_EmptyPool, 0);
 
@@ -310,16 +816,13 @@ export async function empty(user_account: Keypair): Promise<PublicKey>
   const instruction = new TransactionInstruction(
     {
     keys: [
-        {pubkey: manager.publicKey,         isSigner: false, isWritable: false}, // 0
+        {pubkey: manager.publicKey,         isSigner: true,  isWritable: false}, // 0
         {pubkey: pool_at_account,           isSigner: false, isWritable: true},  // 1
-        {pubkey: pools_manager_account,     isSigner: false, isWritable: true},  // 2
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: false}, // 2
         {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 3
-        {pubkey: UPALA_PROGRAM_ID,          isSigner: false, isWritable: false}, // 4 
-        {pubkey: SystemProgram.programId,   isSigner: false, isWritable: false}, // 5
-        {pubkey: SYSVAR_RENT_PUBKEY,        isSigner: false, isWritable: false}, // 6
-        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 7
-        {pubkey: user_account.publicKey,    isSigner: true,  isWritable: false}, // 9
-        {pubkey: user_at_account,           isSigner: false, isWritable: true}, // 8
+        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 4
+        {pubkey: group_account,             isSigner: false, isWritable: false}, // 5
+        {pubkey: user_at_account,           isSigner: false, isWritable: true},  // 6
       ],
     programId: UPALA_PROGRAM_ID,
     data: buffer_cmd,
@@ -327,10 +830,10 @@ export async function empty(user_account: Keypair): Promise<PublicKey>
   
   let tx = new Transaction().add(instruction);
 	tx.recentBlockhash	= (await connection.getRecentBlockhash()).blockhash;
-	tx.feePayer			    = user_account.publicKey;
-	tx.sign(user_account);
+	tx.feePayer			    = manager.publicKey;
+	tx.sign(manager);
 
-	const signers = [user_account];
+	const signers = [manager];
 	const resultTxSimul = await connection.simulateTransaction(tx, signers);
 	const txResponse = resultTxSimul.value;
 	
@@ -350,6 +853,274 @@ export async function empty(user_account: Keypair): Promise<PublicKey>
 }
 
 
+/**
+ * Pay the pool of the manager out to the token accounts of the users in one instruction
+ */
+export async function distribute(users: Array<PublicKey>, values: Array<number>, mode: UpalaDistribution): Promise<PublicKey>
+{
+  const manager:Keypair = await loadManager();
+  console.log('Group manager account:', manager.publicKey.toBase58());
+
+  const pool_at_account:PublicKey = await createGroupPoolAddress([manager.publicKey, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Associated token account:', pool_at_account.toBase58());
+
+  const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Upala manager account:', pools_manager_account.toBase58());
+
+  const group_account:PublicKey = await findGroupAddress(pool_at_account);
+  console.log('Group account:', group_account.toBase58());
+
+  // The recipients follow the accounts of the instruction, from the index 6:
+  // the storage is not sharded and the shard account is left out
+  const recipients:Array<PublicKey> = await Promise.all(users.map((user:PublicKey) =>
+    createGroupPoolAddress([user, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID)));
+  const entries = values.map((value:number, i:number) => {
+    const entry = Buffer.alloc(9);
+    entry.writeUInt8(6 + i, 0);
+    entry.writeBigUInt64LE(BigInt(value), 1);
+    return entry;
+  });
+
+  const data = Buffer.concat([Buffer.from([UpalaInstution.UI_Distribute, mode, entries.length]), ...entries]);
+  console.log("Data instruction of UpalaInstution.UI_Distribute (hex):", data.toString('hex'));
+
+  const instruction = new TransactionInstruction(
+    {
+    keys: [
+        {pubkey: manager.publicKey,         isSigner: true, isWritable: false},  // 0
+        {pubkey: pool_at_account,           isSigner: false, isWritable: true},  // 1
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: false}, // 2
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 3
+        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 4
+        {pubkey: group_account,             isSigner: false, isWritable: false}, // 5
+        ...recipients.map((recipient:PublicKey) => ({pubkey: recipient, isSigner: false, isWritable: true})),
+      ],
+    programId: UPALA_PROGRAM_ID,
+    data: data,
+  });
+
+  let tx = new Transaction().add(instruction);
+	tx.recentBlockhash	= (await connection.getRecentBlockhash()).blockhash;
+	tx.feePayer			    = manager.publicKey;
+	tx.sign(manager);
+
+	const signers = [manager];
+	const resultTxSimul = await connection.simulateTransaction(tx, signers);
+	const txResponse = resultTxSimul.value;
+
+  console.error("Transaction error:", txResponse.err);
+  if (txResponse.err == null)
+	{
+		console.log('Transaction Signature (distribute pool)',
+      await sendAndConfirmTransaction(
+        connection,
+        tx,
+        signers
+      ));
+	}
+	console.log(txResponse.logs);
+
+  return pool_at_account;
+}
+
+/**
+ * Simulate the instruction and send it when the simulation succeeds
+ */
+async function simulateAndSend(instruction: TransactionInstruction, payer: Keypair, name: string): Promise<void>
+{
+  let tx = new Transaction().add(instruction);
+	tx.recentBlockhash	= (await connection.getRecentBlockhash()).blockhash;
+	tx.feePayer			    = payer.publicKey;
+	tx.sign(payer);
+
+	const signers = [payer];
+	const resultTxSimul = await connection.simulateTransaction(tx, signers);
+	const txResponse = resultTxSimul.value;
+
+  console.error("Transaction error:", txResponse.err);
+  if (txResponse.err == null)
+	{
+		console.log('Transaction Signature (' + name + ')',
+      await sendAndConfirmTransaction(
+        connection,
+        tx,
+        signers
+      ));
+	}
+	console.log(txResponse.logs);
+}
+
+/**
+ * Deposit tokens of the depositor into the pool of a UG_Rewards group, spread
+ * over the members by score. The tokens come from the token account of the
+ * depositor for the minter
+ */
+export async function deposit(group_id: PublicKey, depositor: Keypair, source: PublicKey, amount: number): Promise<PublicKey>
+{
+  const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Upala manager account:', pools_manager_account.toBase58());
+
+  const buffer_amount = Buffer.alloc(8);
+  buffer_amount.writeBigUInt64LE(BigInt(amount), 0);
+  const data = Buffer.concat([Buffer.from([UpalaInstution.UI_Deposit]), group_id.toBuffer(), buffer_amount]);
+  console.log("Data instruction of UpalaInstution.UI_Deposit (hex):", data.toString('hex'));
+
+  const instruction = new TransactionInstruction(
+    {
+    keys: [
+        {pubkey: depositor.publicKey,       isSigner: true, isWritable: false},  // 0
+        {pubkey: group_id,                  isSigner: false, isWritable: true},  // 1
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: false}, // 2
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 3
+        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 4
+        {pubkey: await findGroupAddress(group_id), isSigner: false, isWritable: true}, // 5
+        {pubkey: source,                    isSigner: false, isWritable: true},  // 6
+      ],
+    programId: UPALA_PROGRAM_ID,
+    data: data,
+  });
+  await simulateAndSend(instruction, depositor, 'deposit');
+  return group_id;
+}
+
+/**
+ * Pay the user the tokens a UG_Rewards group owes it, into its token account.
+ * The payer sends the claim, it may be anybody
+ */
+export async function claim(group_id: PublicKey, user: PublicKey, payer: Keypair): Promise<PublicKey>
+{
+  const pools_manager_account:PublicKey = await createGroupPoolAddress([TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Upala manager account:', pools_manager_account.toBase58());
+
+  const user_at_account:PublicKey = await createGroupPoolAddress([user, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Dst token account:', user_at_account.toBase58());
+
+  const data = Buffer.concat([Buffer.from([UpalaInstution.UI_Claim]), group_id.toBuffer()]);
+  console.log("Data instruction of UpalaInstution.UI_Claim (hex):", data.toString('hex'));
+
+  const instruction = new TransactionInstruction(
+    {
+    keys: [
+        {pubkey: payer.publicKey,           isSigner: true, isWritable: false},  // 0
+        {pubkey: group_id,                  isSigner: false, isWritable: true},  // 1
+        {pubkey: pools_manager_account,     isSigner: false, isWritable: false}, // 2
+        {pubkey: TOKEN_ID,                  isSigner: false, isWritable: false}, // 3
+        {pubkey: TOKEN_PROGRAM_ID,          isSigner: false, isWritable: false}, // 4
+        {pubkey: await findGroupAddress(group_id), isSigner: false, isWritable: true}, // 5
+        {pubkey: user,                      isSigner: false, isWritable: false}, // 6
+        {pubkey: user_at_account,           isSigner: false, isWritable: true},  // 7
+        {pubkey: await findRegistryAddress(), isSigner: false, isWritable: false}, // 8
+      ],
+    programId: UPALA_PROGRAM_ID,
+    data: data,
+  });
+  await simulateAndSend(instruction, payer, 'claim');
+  return user_at_account;
+}
+
+/**
+ * Runs a query instruction in a simulated transaction, nothing is sent,
+ * and returns the record the program returned
+ */
+async function query(data: Buffer, group_id: PublicKey, with_registry: boolean): Promise<Buffer>
+{
+  const manager:Keypair = await loadManager();
+  const keys = [
+    {pubkey: TOKEN_ID,                       isSigner: false, isWritable: false}, // 0
+    {pubkey: await findGroupAddress(group_id), isSigner: false, isWritable: false}, // 1
+  ];
+  if (with_registry)
+  {
+    keys.push({pubkey: await findRegistryAddress(), isSigner: false, isWritable: false}); // 2
+  }
+
+  const tx = new Transaction().add(new TransactionInstruction({keys: keys, programId: UPALA_PROGRAM_ID, data: data}));
+  tx.recentBlockhash = (await connection.getRecentBlockhash()).blockhash;
+  tx.feePayer = manager.publicKey;
+  const response = (await connection.simulateTransaction(tx, [manager])).value;
+  if (response.err != null || !response.returnData)
+  {
+    console.log(response.logs);
+    throw new Error('Query failed: ' + JSON.stringify(response.err));
+  }
+  return Buffer.from(response.returnData.data[0], 'base64');
+}
+
+/**
+ * UQ_Group record of the group: its manager, members and score aggregates
+ */
+export async function getGroup(group_id: PublicKey)
+{
+  const r = await query(Buffer.from([UpalaInstution.UI_GetGroup]), group_id, false);
+  return {
+    key: new PublicKey(r.subarray(1, 33)),
+    manager: new PublicKey(r.subarray(33, 65)),
+    members: r.readUInt32LE(65),
+    flags: r.readUInt8(69),
+    sum: r.readBigUInt64LE(70),
+    min: r.readBigUInt64LE(78),
+    max: r.readBigUInt64LE(86),
+    min_count: r.readUInt32LE(94),
+    max_count: r.readUInt32LE(98),
+  };
+}
+
+/**
+ * UQ_Member record of the user, null when the user is not a member.
+ * The rank is 0xffffffff for a group without UG_ScoreIndex, the pending
+ * tokens of a claim 0 without UG_Rewards
+ */
+export async function getMember(group_id: PublicKey, user: PublicKey)
+{
+  const data = Buffer.concat([Buffer.from([UpalaInstution.UI_GetMember]), user.toBuffer()]);
+  const r = await query(data, group_id, true);
+  if (r.readUInt8(33) == 0)
+  {
+    return null;
+  }
+  return {position: r.readUInt32LE(34), score: r.readBigUInt64LE(38), rank: r.readUInt32LE(46),
+          pending: r.readBigUInt64LE(50)};
+}
+
+/**
+ * UQ_Members record: up to `limit` members from `offset`, a record holds 25 members at most
+ */
+export async function listMembers(group_id: PublicKey, offset: number, limit: number)
+{
+  const data = Buffer.alloc(6);
+  data.writeUInt8(UpalaInstution.UI_ListMembers, 0);
+  data.writeUInt32LE(offset, 1);
+  data.writeUInt8(limit, 5);
+  const r = await query(data, group_id, true);
+  const members = [];
+  for (let i = 0, at = 10; i < r.readUInt8(9); i++, at += 40)
+  {
+    members.push({key: new PublicKey(r.subarray(at, at + 32)), score: r.readBigUInt64LE(at + 32)});
+  }
+  return {total: r.readUInt32LE(1), offset: r.readUInt32LE(5), members: members};
+}
+
+/**
+ * Whether the proof shows the user a member of the UG_Merkle group with the score
+ */
+export async function verifyMember(group_id: PublicKey, user: PublicKey, score: number, proof: Array<Buffer>): Promise<boolean>
+{
+  const header = Buffer.alloc(9);
+  header.writeBigUInt64LE(BigInt(score), 0);
+  header.writeUInt8(proof.length, 8);
+  const data = Buffer.concat([Buffer.from([UpalaInstution.UI_VerifyMember]), user.toBuffer(), header, ...proof]);
+  // A proof that does not lead to the root fails the instruction
+  try
+  {
+    await query(data, group_id, false);
+    return true;
+  }
+  catch (err)
+  {
+    return false;
+  }
+}
+
 export async function mintToPool(key:PublicKey): Promise<void>
 {
   const minter:Keypair = await readAccountFromFile(TOKEN_KEYPAIR_PATH);
@@ -0,0 +1,25 @@
+/**
+ * Upgrade the program accounts of the manager to the current layout
+ */
+import {
+  establishConnection,
+  loadProgramId,
+  loadTokenId,
+  migrate,
+} from './lib';
+
+async function main() {
+  console.log("#MIGRATE");
+  await establishConnection();
+  await loadProgramId();
+  await loadTokenId();
+  await migrate();
+}
+
+main().then(
+  () => process.exit(),
+  err => {
+    console.error(err);
+    process.exit(-1);
+  },
+);
@@ -0,0 +1,31 @@
+/**
+ * Create the upala group and add the users in a single transaction
+ */
+import { Keypair } from '@solana/web3.js';
+import {
+  establishConnection,
+  loadProgramId,
+  loadTokenId,
+  provision,
+  USER_1_KEYPAIR_PATH
+} from './lib';
+import { readAccountFromFile } from './utils';
+
+async function main() {
+  console.log("#PROVISION_GROUP");
+  await establishConnection();
+  await loadProgramId();
+  await loadTokenId();
+  const user:Keypair = await readAccountFromFile(USER_1_KEYPAIR_PATH);
+  console.log(user.publicKey.toBase58());
+
+  await provision([user.publicKey], [10]);
+}
+
+main().then(
+  () => process.exit(),
+  err => {
+    console.error(err);
+    process.exit(-1);
+  },
+);
@@ -0,0 +1,43 @@
+/**
+ * Read the group of the manager and its members with simulated query instructions
+ */
+import { Keypair, PublicKey } from '@solana/web3.js';
+import {
+  getGroup,
+  listMembers,
+  createGroupPoolAddress,
+  establishConnection,
+  loadManager,
+  loadProgramId,
+  loadTokenId,
+  TOKEN_ID,
+  UPALA_PROGRAM_ID,
+} from './lib';
+
+async function main() {
+  console.log("#QUERY_GROUP");
+  await establishConnection();
+  await loadProgramId();
+  await loadTokenId();
+
+  const manager:Keypair = await loadManager();
+  const group_id:PublicKey = await createGroupPoolAddress([manager.publicKey, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Associated token account:', group_id.toBase58());
+
+  const group = await getGroup(group_id);
+  console.log('Group:', group);
+  for (let offset = 0; offset < group.members; )
+  {
+    const page = await listMembers(group_id, offset, 25);
+    page.members.forEach(member => console.log(member.key.toBase58(), member.score.toString()));
+    offset += page.members.length;
+  }
+}
+
+main().then(
+  () => process.exit(),
+  err => {
+    console.error(err);
+    process.exit(-1);
+  },
+);
@@ -0,0 +1,25 @@
+/**
+ * Remove the upala group of the manager
+ */
+import {
+  establishConnection,
+  loadProgramId,
+  loadTokenId,
+  removePool,
+} from './lib';
+
+async function main() {
+  console.log("#REMOVE_GROUP");
+  await establishConnection();
+  await loadProgramId();
+  await loadTokenId();
+  await removePool();
+}
+
+main().then(
+  () => process.exit(),
+  err => {
+    console.error(err);
+    process.exit(-1);
+  },
+);
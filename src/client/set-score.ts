@@ -0,0 +1,40 @@
+/**
+ * Set the score of the user in the upala group
+ */
+import { Keypair, PublicKey } from '@solana/web3.js';
+import {
+  setScore,
+  createGroupPoolAddress,
+  establishConnection,
+  loadManager,
+  loadProgramId,
+  loadTokenId,
+  TOKEN_ID,
+  UPALA_PROGRAM_ID,
+  USER_1_KEYPAIR_PATH
+} from './lib';
+import { readAccountFromFile } from './utils';
+
+async function main() {
+  console.log("#SET_SCORE");
+  await establishConnection();
+  await loadProgramId();
+  await loadTokenId();
+  const user:Keypair = await readAccountFromFile(USER_1_KEYPAIR_PATH);
+  console.log(user.publicKey.toBase58());
+
+  // const group_id = new PublicKey('9ZyEEr7YcDA6voLgD2a5kXEZbhF5yG7L5Qw4ZEhKatjB');
+  const manager:Keypair = await loadManager();
+  const group_id:PublicKey = await createGroupPoolAddress([manager.publicKey, TOKEN_ID, UPALA_PROGRAM_ID], UPALA_PROGRAM_ID);
+  console.log('Associated token account:', group_id.toBase58());
+
+  await setScore(group_id, [user.publicKey], [20]);
+}
+
+main().then(
+  () => process.exit(),
+  err => {
+    console.error(err);
+    process.exit(-1);
+  },
+);
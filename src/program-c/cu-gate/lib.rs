@@ -0,0 +1,544 @@
+//! Instruction corpus of the Upala C program, replayed by tests/ on its
+//! BPF builds in the local runtime of `solana-program-test`.
+//!
+//! `compute_units` compares the costs of the profiled build with
+//! `compute_units.baseline` and fails on a regression; `UPALA_CU_BLESS=1`
+//! writes the current costs to the baseline instead. Run it with
+//! `make -C src/program-c cu-gate`, which builds `helloworld_profile.so`
+//! and points `SBF_OUT_DIR` to it.
+//!
+//! `compare` replays the corpus on the C program and on the Rust one and
+//! reports, per case and program, the compute units, the heap bytes, the
+//! cross-program invocations and the binary size. Run it with
+//! `make -C src/program-c compare`.
+
+use solana_program_test::*;
+use solana_sdk::{
+    account::Account,
+    hash::hashv,
+    instruction::{AccountMeta, Instruction},
+    pubkey::Pubkey,
+    rent::Rent,
+    signature::{Keypair, Signer},
+    system_instruction, system_program, sysvar,
+    transaction::Transaction,
+};
+use std::{str::FromStr, sync::Mutex};
+
+pub const SPL_TOKEN_ID: &str = "TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA";
+const MINT_LEN: usize = 82;
+const TOKEN_ACCOUNT_LEN: usize = 165;
+const GROUP_SEED: &[u8] = b"group";
+const REGISTRY_SEED: &[u8] = b"users";
+const SHARD_SEED: &[u8] = b"shard";
+
+/// `UpalaGroupFlags` of helloworld.c the corpus creates groups with
+const UG_MERKLE: u8 = 2;
+const UG_REWARDS: u8 = 4;
+
+/// Seed of the token account the manager deposits from
+const DEPOSIT_SEED: &str = "deposit";
+
+/// `UpalaInstruction` of helloworld.c
+#[derive(Clone, Copy)]
+pub enum UpalaInstruction {
+    CreatePool = 0,
+    EmptyPool,
+    RemovePool,
+    AddUser,
+    RemoveUser,
+    SetScore,
+    CleanStorage,
+    Migrate,
+    Batch,
+    Distribute,
+    CreateShard,
+    GetGroup,
+    GetMember,
+    ListMembers,
+    SetRoot,
+    VerifyMember,
+    Deposit,
+    Claim,
+}
+
+/// `UpalaAccountRole` of helloworld.c, in the order of the instruction accounts
+#[derive(Clone, Copy, PartialEq)]
+pub enum Role {
+    Manager,
+    Pool,
+    PoolsManager,
+    Minter,
+    SystemProgram,
+    SysvarRent,
+    SplToken,
+    Group,
+    User,
+    UserAt,
+    Registry,
+    Shard,
+}
+
+pub const SHARED: &[Role] = &[Role::Manager, Role::PoolsManager, Role::Minter];
+pub const PROVISION: &[Role] = &[Role::SystemProgram, Role::SysvarRent, Role::SplToken];
+
+/// Roles and writable roles of the instruction, as `UPALA_SCHEMAS` declares them
+///
+/// The corpus runs on an unsharded storage until UI_CreateShard: the
+/// pools_manager holds the groups and is writable where the shard would
+/// be, and the shard slot of UI_Batch repeats the pools_manager. UI_Distribute
+/// leaves its optional shard out, its recipients follow the group
+pub fn schema(instruction: UpalaInstruction) -> (Vec<Role>, Vec<Role>) {
+    use Role::*;
+    let (roles, writable): (Vec<Role>, Vec<Role>) = match instruction {
+        UpalaInstruction::CreatePool => ([SHARED, PROVISION, &[Pool, Group]].concat(), vec![Manager, PoolsManager, Pool, Group]),
+        UpalaInstruction::EmptyPool => ([SHARED, &[SplToken, Pool, Group, UserAt]].concat(), vec![Pool, UserAt]),
+        UpalaInstruction::RemovePool => ([SHARED, &[SysvarRent, Pool, Group]].concat(), vec![Manager, PoolsManager, Group]),
+        UpalaInstruction::AddUser => {
+            ([SHARED, PROVISION, &[Group, User, UserAt, Registry]].concat(), vec![Manager, Group, UserAt, Registry])
+        }
+        UpalaInstruction::RemoveUser | UpalaInstruction::SetScore => ([SHARED, &[Group, Registry]].concat(), vec![Group]),
+        UpalaInstruction::CleanStorage => ([SHARED, &[SysvarRent]].concat(), vec![Manager, PoolsManager]),
+        UpalaInstruction::Migrate => (
+            [SHARED, &[SystemProgram, SysvarRent, Group, Registry]].concat(),
+            vec![Manager, PoolsManager, Group, Registry],
+        ),
+        UpalaInstruction::Batch => ([SHARED, PROVISION, &[Registry, Shard]].concat(), vec![Manager, Registry, Shard]),
+        UpalaInstruction::Distribute => ([SHARED, &[SplToken, Pool, Group]].concat(), vec![Pool]),
+        UpalaInstruction::CreateShard => (
+            [SHARED, &[SystemProgram, SysvarRent, Registry, Shard]].concat(),
+            vec![Manager, PoolsManager, Registry, Shard],
+        ),
+        UpalaInstruction::GetGroup => (vec![Minter, Group], vec![]),
+        UpalaInstruction::GetMember | UpalaInstruction::ListMembers => (vec![Minter, Group, Registry], vec![]),
+        UpalaInstruction::SetRoot => ([SHARED, &[Group]].concat(), vec![Group]),
+        UpalaInstruction::VerifyMember => (vec![Minter, Group], vec![]),
+        UpalaInstruction::Deposit => ([SHARED, &[SplToken, Pool, Group, UserAt]].concat(), vec![Pool, Group, UserAt]),
+        UpalaInstruction::Claim => {
+            ([SHARED, &[SplToken, Pool, Group, User, UserAt, Registry]].concat(), vec![Pool, Group, UserAt])
+        }
+    };
+    let mut roles = roles;
+    roles.sort_by_key(|role| *role as u8);
+    (roles, writable)
+}
+
+/// Cost of one instruction of the corpus
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct Cost {
+    pub units: u64,
+    pub heap: u64,
+    pub invocations: u64,
+}
+
+/// Collects the `Program ...` lines the runtime logs
+pub struct Capture {
+    lines: Mutex<Vec<String>>,
+}
+
+impl log::Log for Capture {
+    fn enabled(&self, _: &log::Metadata) -> bool {
+        true
+    }
+
+    fn log(&self, record: &log::Record) {
+        let line = record.args().to_string();
+        if line.starts_with("Program ") {
+            self.lines.lock().unwrap().push(line);
+        }
+    }
+
+    fn flush(&self) {}
+}
+
+impl Capture {
+    /// Logger of the process, the runtime logs through the `log` crate and
+    /// the first logger set wins
+    pub fn install() -> &'static Capture {
+        let capture: &'static Capture = Box::leak(Box::new(Capture { lines: Mutex::new(Vec::new()) }));
+        let _ = log::set_logger(capture);
+        log::set_max_level(log::LevelFilter::Debug);
+        capture
+    }
+
+    pub fn take(&self) -> Vec<String> {
+        std::mem::take(&mut *self.lines.lock().unwrap())
+    }
+}
+
+/// Compute units the program consumed, from the log of its transaction
+pub fn units(lines: &[String], program_id: &Pubkey) -> u64 {
+    let consumed = format!("Program {} consumed ", program_id);
+    lines
+        .iter()
+        .find_map(|line| line.strip_prefix(consumed.as_str()))
+        .and_then(|rest| rest.split(' ').next())
+        .and_then(|units| units.parse().ok())
+        .expect("no compute units consumed by the program in the log")
+}
+
+/// Heap bytes used, from the `Upala profile:` report of the profiled build
+pub fn heap(lines: &[String]) -> Option<u64> {
+    // Units line, then heap line: instruction, phases, heap used, heap length, 0
+    lines
+        .iter()
+        .position(|line| line == "Program log: Upala profile:")
+        .and_then(|at| lines.get(at + 2))
+        .and_then(|line| line.trim_start_matches("Program log: ").split(", ").nth(2))
+        .and_then(|heap| u64::from_str_radix(heap.trim_start_matches("0x"), 16).ok())
+}
+
+/// Cross-program invocations made by the program
+pub fn invocations(lines: &[String]) -> u64 {
+    lines.iter().filter(|line| line.ends_with(" invoke [2]")).count() as u64
+}
+
+/// Reads the cost of the instruction from the log of its transaction
+pub fn cost(lines: &[String], program_id: &Pubkey) -> Cost {
+    Cost {
+        units: units(lines, program_id),
+        heap: heap(lines).expect("no profile report in the log, is the program built with UPALA_PROFILE?"),
+        invocations: invocations(lines),
+    }
+}
+
+/// Accounts of the manager, their group and token account, and three users
+pub struct UpalaAccounts {
+    pub program_id: Pubkey,
+    pub spl_token: Pubkey,
+    pub manager: Pubkey,
+    pub minter: Pubkey,
+    pub pools_manager: Pubkey,
+    pub pool: Pubkey,
+    pub group: Pubkey,
+    pub registry: Pubkey,
+    pub manager_at: Pubkey,
+    pub shard: Pubkey,
+    pub shard_registry: Pubkey,
+    pub users: Vec<(Pubkey, Pubkey)>,
+}
+
+impl UpalaAccounts {
+    pub fn new(program_id: Pubkey, manager: Pubkey, minter: Pubkey) -> Self {
+        let address = |seeds: &[&[u8]]| Pubkey::find_program_address(seeds, &program_id).0;
+        let pools_manager = address(&[minter.as_ref(), program_id.as_ref()]);
+        let pool = address(&[manager.as_ref(), minter.as_ref(), program_id.as_ref()]);
+        let group = address(&[GROUP_SEED, pool.as_ref(), minter.as_ref(), program_id.as_ref()]);
+        let registry = address(&[REGISTRY_SEED, minter.as_ref(), program_id.as_ref()]);
+        let users = (0..3)
+            .map(|_| {
+                let user = Pubkey::new_unique();
+                (user, address(&[user.as_ref(), minter.as_ref(), program_id.as_ref()]))
+            })
+            .collect();
+        let spl_token = Pubkey::from_str(SPL_TOKEN_ID).unwrap();
+        Self {
+            program_id,
+            spl_token,
+            manager,
+            minter,
+            pools_manager,
+            pool,
+            group,
+            registry,
+            manager_at: Pubkey::create_with_seed(&manager, DEPOSIT_SEED, &spl_token).unwrap(),
+            shard: address(&[SHARD_SEED, minter.as_ref(), program_id.as_ref(), &0u16.to_le_bytes()]),
+            shard_registry: address(&[REGISTRY_SEED, minter.as_ref(), program_id.as_ref(), &0u16.to_le_bytes()]),
+            users,
+        }
+    }
+
+    pub fn key(&self, role: Role, user: usize) -> Pubkey {
+        match role {
+            Role::Manager => self.manager,
+            Role::Pool => self.pool,
+            Role::PoolsManager => self.pools_manager,
+            Role::Minter => self.minter,
+            Role::SystemProgram => system_program::id(),
+            Role::SysvarRent => sysvar::rent::id(),
+            Role::SplToken => self.spl_token,
+            Role::Group => self.group,
+            Role::User => self.users[user].0,
+            Role::UserAt => self.users[user].1,
+            Role::Registry => self.registry,
+            Role::Shard => self.pools_manager,
+        }
+    }
+
+    /// Instruction taking the accounts of its schema, the ones of `user`,
+    /// followed by `extra` accounts
+    pub fn instruction(&self, instruction: UpalaInstruction, user: usize, payload: &[u8], extra: &[AccountMeta]) -> Instruction {
+        let (roles, writable) = schema(instruction);
+        let mut accounts: Vec<AccountMeta> = roles
+            .iter()
+            .map(|&role| AccountMeta {
+                pubkey: self.key(role, user),
+                is_signer: role == Role::Manager,
+                is_writable: writable.contains(&role),
+            })
+            .collect();
+        accounts.extend_from_slice(extra);
+        Instruction {
+            program_id: self.program_id,
+            accounts,
+            data: [&[instruction as u8], payload].concat(),
+        }
+    }
+
+    /// Instruction of `instruction` with the accounts of the roles of `keys`
+    /// replaced by their keys
+    pub fn instruction_with(
+        &self,
+        instruction: UpalaInstruction,
+        user: usize,
+        payload: &[u8],
+        keys: &[(Role, Pubkey)],
+    ) -> Instruction {
+        let mut built = self.instruction(instruction, user, payload, &[]);
+        let roles = schema(instruction).0;
+        for (role, key) in keys {
+            let at = roles.iter().position(|other| other == role).expect("role not in the schema");
+            built.accounts[at].pubkey = *key;
+        }
+        built
+    }
+
+    /// gid | 1 | `user` scored `score`: an AddUser creating the token
+    /// account of the user adds that user alone
+    pub fn user_member(&self, user: usize, score: u64) -> Vec<u8> {
+        let mut payload = self.pool.to_bytes().to_vec();
+        payload.push(1);
+        payload.extend_from_slice(self.users[user].0.as_ref());
+        payload.extend_from_slice(&score.to_le_bytes());
+        payload
+    }
+
+    /// gid | count: u8, then the members `first`.. scored by their index
+    pub fn members(&self, first: u64, count: u8, scored: bool) -> Vec<u8> {
+        let mut payload = self.pool.to_bytes().to_vec();
+        payload.push(count);
+        for i in first..first + count as u64 {
+            payload.extend_from_slice(&member(i).to_bytes());
+            if scored {
+                payload.extend_from_slice(&i.to_le_bytes());
+            }
+        }
+        payload
+    }
+}
+
+/// Deterministic member key, the members need no account
+pub fn member(index: u64) -> Pubkey {
+    let mut key = [0u8; 32];
+    key[..8].copy_from_slice(&index.to_le_bytes());
+    key[31] = 0x55;
+    Pubkey::new_from_array(key)
+}
+
+/// Leaf of the member of a UG_Merkle group, as upala_merkle_leaf() hashes it
+pub fn merkle_leaf(uid: &Pubkey, score: u64) -> [u8; 32] {
+    hashv(&[&[0u8], uid.as_ref(), &score.to_le_bytes()]).to_bytes()
+}
+
+/// Parent of two nodes, as upala_merkle_node() hashes it
+pub fn merkle_node(one: &[u8; 32], two: &[u8; 32]) -> [u8; 32] {
+    let (low, high) = if one <= two { (one, two) } else { (two, one) };
+    hashv(&[&[1u8], low, high]).to_bytes()
+}
+
+/// Batched operation: instruction | pool | group | user | user_at | length: u16 | payload
+pub fn operation(instruction: UpalaInstruction, accounts: [u8; 4], payload: &[u8]) -> Vec<u8> {
+    let mut data = vec![instruction as u8];
+    data.extend_from_slice(&accounts);
+    data.extend_from_slice(&(payload.len() as u16).to_le_bytes());
+    data.extend_from_slice(payload);
+    data
+}
+
+/// Initialized mint of `authority`
+pub fn mint_account(authority: &Pubkey, spl_token: &Pubkey) -> Account {
+    let mut data = vec![0u8; MINT_LEN];
+    data[0] = 1; // COption::Some mint authority
+    data[4..36].copy_from_slice(authority.as_ref());
+    data[44] = 0; // decimals
+    data[45] = 1; // is_initialized
+    Account {
+        lamports: Rent::default().minimum_balance(MINT_LEN),
+        data,
+        owner: *spl_token,
+        executable: false,
+        rent_epoch: 0,
+    }
+}
+
+/// SPL token MintTo of `amount` tokens to `destination`
+pub fn mint_to(upala: &UpalaAccounts, authority: &Pubkey, destination: &Pubkey, amount: u64) -> Instruction {
+    Instruction {
+        program_id: upala.spl_token,
+        accounts: vec![
+            AccountMeta::new(upala.minter, false),
+            AccountMeta::new(*destination, false),
+            AccountMeta::new_readonly(*authority, true),
+        ],
+        data: [&[7u8][..], &amount.to_le_bytes()].concat(),
+    }
+}
+
+/// Token account of `owner` at the address made of the seed of the owner,
+/// created and initialized by the payer alone
+pub fn token_account(
+    upala: &UpalaAccounts,
+    owner: &Pubkey,
+    address: &Pubkey,
+    seed: &str,
+) -> (Instruction, Instruction) {
+    let lamports = Rent::default().minimum_balance(TOKEN_ACCOUNT_LEN);
+    let create = system_instruction::create_account_with_seed(
+        owner,
+        address,
+        owner,
+        seed,
+        lamports,
+        TOKEN_ACCOUNT_LEN as u64,
+        &upala.spl_token,
+    );
+    // InitializeAccount3: the owner follows the instruction
+    let initialize = Instruction {
+        program_id: upala.spl_token,
+        accounts: vec![AccountMeta::new(*address, false), AccountMeta::new_readonly(upala.minter, false)],
+        data: [&[18u8][..], owner.as_ref()].concat(),
+    };
+    (create, initialize)
+}
+
+/// Named instructions, the cases named setup_ prepare the next ones and
+/// are not measured
+pub type Corpus = Vec<(&'static str, Instruction)>;
+
+/// Instructions covering every UpalaInstruction, run in order on a fresh
+/// program. The storage is not sharded until the last case, UI_CreateShard
+/// spreading the cleaned storage over 4 shards
+pub fn corpus(upala: &UpalaAccounts, mint_authority: &Pubkey) -> Corpus {
+    let user_meta = |user: usize| {
+        vec![
+            AccountMeta::new_readonly(upala.users[user].0, false),
+            AccountMeta::new(upala.users[user].1, false),
+        ]
+    };
+
+    let mut corpus: Corpus = vec![
+        ("create_pool", upala.instruction(UpalaInstruction::CreatePool, 0, &[], &[])),
+        ("add_user_provision", upala.instruction(UpalaInstruction::AddUser, 0, &upala.user_member(0, 0), &[])),
+        ("add_user_16", upala.instruction(UpalaInstruction::AddUser, 0, &upala.members(1, 16, true), &[])),
+        ("set_score_4", upala.instruction(UpalaInstruction::SetScore, 0, &upala.members(2, 4, true), &[])),
+        ("remove_user_2", upala.instruction(UpalaInstruction::RemoveUser, 0, &upala.members(10, 2, false), &[])),
+        ("get_group", upala.instruction(UpalaInstruction::GetGroup, 0, &[], &[])),
+        ("get_member", upala.instruction(UpalaInstruction::GetMember, 0, &member(5).to_bytes(), &[])),
+        ("list_members_15", upala.instruction(UpalaInstruction::ListMembers, 0, &[0, 0, 0, 0, 25], &[])),
+    ];
+
+    // Two AddUser operations adding two users and creating their token
+    // accounts, then one adding 8 members: the group at 8, then the users
+    // and their token accounts at 9, 10 and 11, 12, the first user, whose
+    // token account exists, at 13, 14
+    let batch = [
+        vec![3u8],
+        operation(UpalaInstruction::AddUser, [u8::MAX, 8, 9, 10], &upala.user_member(1, 0)[..]),
+        operation(UpalaInstruction::AddUser, [u8::MAX, 8, 11, 12], &upala.user_member(2, 0)[..]),
+        operation(UpalaInstruction::AddUser, [u8::MAX, 8, 13, 14], &upala.members(20, 8, true)[..]),
+    ]
+    .concat();
+    let batch_accounts =
+        [vec![AccountMeta::new(upala.group, false)], user_meta(1), user_meta(2), user_meta(0)].concat();
+    corpus.push(("batch_add_user_2_and_8", upala.instruction(UpalaInstruction::Batch, 0, &batch, &batch_accounts)));
+
+    // The pool holds tokens from here on
+    corpus.push(("setup_mint_to_pool", mint_to(upala, mint_authority, &upala.pool, 1_000_000)));
+
+    // Weights 1, 2, 3 to the token accounts of the users at 6, 7 and 8
+    let mut distribute = vec![1u8, 3];
+    for (i, weight) in [1u64, 2, 3].iter().enumerate() {
+        distribute.push(6 + i as u8);
+        distribute.extend_from_slice(&weight.to_le_bytes());
+    }
+    let recipients: Vec<AccountMeta> = upala.users.iter().map(|(_, at)| AccountMeta::new(*at, false)).collect();
+    corpus.push(("distribute_3", upala.instruction(UpalaInstruction::Distribute, 0, &distribute, &recipients)));
+
+    corpus.push(("empty_pool", upala.instruction(UpalaInstruction::EmptyPool, 0, &[], &[])));
+    corpus.push(("migrate_current", upala.instruction(UpalaInstruction::Migrate, 0, &[], &[])));
+    corpus.push(("remove_pool", upala.instruction(UpalaInstruction::RemovePool, 0, &[], &[])));
+
+    // The group of the manager comes back as a UG_Merkle group of two
+    // members, the proof of the first is the leaf of the second
+    let leaves = [merkle_leaf(&member(0), 7), merkle_leaf(&member(1), 8)];
+    let mut set_root = upala.pool.to_bytes().to_vec();
+    set_root.extend_from_slice(&merkle_node(&leaves[0], &leaves[1]));
+    set_root.extend_from_slice(&2u32.to_le_bytes());
+    let mut verify = member(0).to_bytes().to_vec();
+    verify.extend_from_slice(&7u64.to_le_bytes());
+    verify.push(1);
+    verify.extend_from_slice(&leaves[1]);
+    corpus.push(("setup_create_merkle_pool", upala.instruction(UpalaInstruction::CreatePool, 0, &[UG_MERKLE], &[])));
+    corpus.push(("set_root", upala.instruction(UpalaInstruction::SetRoot, 0, &set_root, &[])));
+    corpus.push(("verify_member_depth_1", upala.instruction(UpalaInstruction::VerifyMember, 0, &verify, &[])));
+    corpus.push(("setup_remove_merkle_pool", upala.instruction(UpalaInstruction::RemovePool, 0, &[], &[])));
+
+    // Then as a UG_Rewards group of the first user, scored 5: the manager
+    // deposits 1000 tokens from its own token account and the member
+    // claims them all, so the group holds nothing when it is removed
+    let mut deposit = upala.pool.to_bytes().to_vec();
+    deposit.extend_from_slice(&1000u64.to_le_bytes());
+    corpus.push(("setup_create_rewards_pool", upala.instruction(UpalaInstruction::CreatePool, 0, &[UG_REWARDS], &[])));
+    corpus.push((
+        "setup_add_user_rewards",
+        upala.instruction(UpalaInstruction::AddUser, 0, &upala.user_member(0, 5), &[]),
+    ));
+    let (create, initialize) = token_account(upala, &upala.manager, &upala.manager_at, DEPOSIT_SEED);
+    corpus.push(("setup_create_manager_at", create));
+    corpus.push(("setup_initialize_manager_at", initialize));
+    corpus.push(("setup_mint_to_manager_at", mint_to(upala, mint_authority, &upala.manager_at, 1000)));
+    corpus.push((
+        "deposit",
+        upala.instruction_with(UpalaInstruction::Deposit, 0, &deposit, &[(Role::UserAt, upala.manager_at)]),
+    ));
+    corpus.push(("claim", upala.instruction(UpalaInstruction::Claim, 0, &upala.pool.to_bytes(), &[])));
+    corpus.push(("setup_remove_rewards_pool", upala.instruction(UpalaInstruction::RemovePool, 0, &[], &[])));
+
+    corpus.push(("clean_storage", upala.instruction(UpalaInstruction::CleanStorage, 0, &[], &[])));
+
+    // Shard 0 of 4 and its registry
+    let shard = [(Role::Registry, upala.shard_registry), (Role::Shard, upala.shard)];
+    corpus.push(("create_shard", upala.instruction_with(UpalaInstruction::CreateShard, 0, &[4, 0, 0, 0], &shard)));
+    corpus
+}
+
+/// Runs the corpus one transaction per case and returns the log of the
+/// measured ones. The mint authority signs the instructions that ask for
+/// it
+pub async fn replay(
+    banks_client: &mut BanksClient,
+    payer: &Keypair,
+    mint_authority: &Keypair,
+    capture: &Capture,
+    corpus: Corpus,
+) -> Vec<(&'static str, Vec<String>)> {
+    let mut logs = Vec::new();
+    for (case, instruction) in corpus {
+        let recent_blockhash = banks_client.get_latest_blockhash().await.unwrap();
+        let mut signers = vec![payer];
+        if instruction.accounts.iter().any(|meta| meta.is_signer && meta.pubkey == mint_authority.pubkey()) {
+            signers.push(mint_authority);
+        }
+        let mut transaction = Transaction::new_with_payer(&[instruction], Some(&payer.pubkey()));
+        transaction.sign(&signers, recent_blockhash);
+        capture.take();
+        banks_client
+            .process_transaction(transaction)
+            .await
+            .unwrap_or_else(|err| panic!("{} failed: {:?}\n{}", case, err, capture.take().join("\n")));
+        if !case.starts_with("setup_") {
+            logs.push((case, capture.take()));
+        }
+    }
+    logs
+}
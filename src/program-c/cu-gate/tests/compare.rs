@@ -0,0 +1,126 @@
+//! Replays the corpus on the C program and on the Rust program side by
+//! side and prints, per case, the compute units, the heap bytes and the
+//! cross-program invocations of each, then the size of their binaries.
+//!
+//! The C costs come from `helloworld.so`, the program as deployed, and its
+//! heap from `helloworld_profile.so`, the only build that reports it. The
+//! Rust program is `helloworld_rust.so`; it reports no heap, and a case it
+//! does not implement is shown as `-`.
+//!
+//! Run with `make -C src/program-c compare`, which builds the three
+//! programs and points `SBF_OUT_DIR` to them.
+
+use solana_program_test::*;
+use solana_sdk::{
+    account::Account,
+    instruction::{AccountMeta, Instruction},
+    pubkey::Pubkey,
+    signature::{Keypair, Signer},
+};
+use std::{collections::BTreeMap, fs, path::PathBuf, str::FromStr};
+use upala_cu_gate::*;
+
+const C_PROGRAM: &str = "helloworld";
+const C_PROFILE_PROGRAM: &str = "helloworld_profile";
+const RUST_PROGRAM: &str = "helloworld_rust";
+
+/// Cost of a case on one program, the heap is None when the build does
+/// not report it
+#[derive(Clone, Copy, Default)]
+struct Measure {
+    units: u64,
+    heap: Option<u64>,
+    invocations: u64,
+}
+
+/// Cases the Rust program implements. It is still the greeting of the
+/// template: the instruction data is ignored and the first account, owned
+/// by the program, counts the calls. Porting the Upala instructions is out
+/// of the scope of the comparison, a case ported later goes here under its
+/// name in `corpus()`
+fn rust_corpus(program_id: &Pubkey, greeted: &Pubkey) -> Corpus {
+    vec![(
+        "greet",
+        Instruction { program_id: *program_id, accounts: vec![AccountMeta::new(*greeted, false)], data: vec![0] },
+    )]
+}
+
+fn binary_size(program: &str) -> Option<u64> {
+    let dir = std::env::var("SBF_OUT_DIR").or_else(|_| std::env::var("BPF_OUT_DIR")).ok()?;
+    fs::metadata(PathBuf::from(dir).join(format!("{}.so", program))).ok().map(|metadata| metadata.len())
+}
+
+fn column<T: ToString>(value: Option<T>) -> String {
+    value.map_or_else(|| "-".to_string(), |value| value.to_string())
+}
+
+#[tokio::test]
+async fn test_compare() {
+    let capture = Capture::install();
+
+    let c_id = Pubkey::new_unique();
+    let c_profile_id = Pubkey::new_unique();
+    let rust_id = Pubkey::new_unique();
+    let minter = Pubkey::new_unique();
+    let mint_authority = Keypair::new();
+    let greeted = Pubkey::new_unique();
+    let mut program_test = ProgramTest::default();
+    program_test.add_program(C_PROGRAM, c_id, None);
+    program_test.add_program(C_PROFILE_PROGRAM, c_profile_id, None);
+    program_test.add_program(RUST_PROGRAM, rust_id, None);
+    program_test.add_account(minter, mint_account(&mint_authority.pubkey(), &Pubkey::from_str(SPL_TOKEN_ID).unwrap()));
+    program_test.add_account(
+        greeted,
+        Account { lamports: 5, data: vec![0; std::mem::size_of::<u32>()], owner: rust_id, ..Account::default() },
+    );
+
+    let (mut banks_client, payer, _) = program_test.start().await;
+
+    // The cases in the order of the corpus, then the ones of the Rust program alone
+    let mut cases: Vec<&str> = Vec::new();
+
+    // Every program gets its own storage and group, the PDAs follow the program id
+    let mut c: BTreeMap<&str, Measure> = BTreeMap::new();
+    let c_corpus = corpus(&UpalaAccounts::new(c_id, payer.pubkey(), minter), &mint_authority.pubkey());
+    for (case, lines) in replay(&mut banks_client, &payer, &mint_authority, capture, c_corpus).await {
+        cases.push(case);
+        c.insert(case, Measure { units: units(&lines, &c_id), heap: None, invocations: invocations(&lines) });
+    }
+    let profiled = corpus(&UpalaAccounts::new(c_profile_id, payer.pubkey(), minter), &mint_authority.pubkey());
+    for (case, lines) in replay(&mut banks_client, &payer, &mint_authority, capture, profiled).await {
+        c.entry(case).or_default().heap = heap(&lines);
+    }
+
+    let mut rust: BTreeMap<&str, Measure> = BTreeMap::new();
+    let ported = rust_corpus(&rust_id, &greeted);
+    for (case, lines) in replay(&mut banks_client, &payer, &mint_authority, capture, ported).await {
+        if !c.contains_key(case) {
+            cases.push(case);
+        }
+        rust.insert(case, Measure { units: units(&lines, &rust_id), heap: None, invocations: invocations(&lines) });
+    }
+
+    println!(
+        "{:<24} {:>8} {:>8} {:>5} {:>10} {:>9} {:>8}",
+        "case", "C units", "C heap", "C cpi", "Rust units", "Rust heap", "Rust cpi"
+    );
+    for case in cases {
+        let (c, rust) = (c.get(case), rust.get(case));
+        println!(
+            "{:<24} {:>8} {:>8} {:>5} {:>10} {:>9} {:>8}",
+            case,
+            column(c.map(|m| m.units)),
+            column(c.and_then(|m| m.heap)),
+            column(c.map(|m| m.invocations)),
+            column(rust.map(|m| m.units)),
+            column(rust.and_then(|m| m.heap)),
+            column(rust.map(|m| m.invocations)),
+        );
+    }
+    println!(
+        "binary bytes: C {}, C profiled {}, Rust {}",
+        column(binary_size(C_PROGRAM)),
+        column(binary_size(C_PROFILE_PROGRAM)),
+        column(binary_size(RUST_PROGRAM))
+    );
+}
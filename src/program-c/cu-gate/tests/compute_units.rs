@@ -0,0 +1,93 @@
+//! Replays a fixed corpus of Upala instructions on the BPF build of the C
+//! program and compares their costs with `compute_units.baseline`.
+//!
+//! Every case records the compute units the program consumed, the heap
+//! bytes it used, read from the `Upala profile:` report of the profiled
+//! build, and the number of cross-program invocations it made. A case
+//! costing more than its baseline fails the test; `UPALA_CU_BLESS=1`
+//! writes the current costs to the baseline instead.
+//!
+//! Run with `make -C src/program-c cu-gate`, which builds
+//! `helloworld_profile.so` and points `SBF_OUT_DIR` to it.
+
+use solana_program_test::*;
+use solana_sdk::{
+    pubkey::Pubkey,
+    signature::{Keypair, Signer},
+};
+use std::{collections::BTreeMap, fs, path::PathBuf, str::FromStr};
+use upala_cu_gate::*;
+
+fn baseline_path() -> PathBuf {
+    PathBuf::from(env!("CARGO_MANIFEST_DIR")).join("compute_units.baseline")
+}
+
+/// Baseline lines: case units heap invocations, `#` starts a comment
+fn read_baseline() -> BTreeMap<String, Cost> {
+    let text = fs::read_to_string(baseline_path()).unwrap_or_default();
+    text.lines()
+        .map(|line| line.split('#').next().unwrap().trim())
+        .filter(|line| !line.is_empty())
+        .map(|line| {
+            let fields: Vec<&str> = line.split_whitespace().collect();
+            assert_eq!(fields.len(), 4, "malformed baseline line: {}", line);
+            let value = |i: usize| fields[i].parse::<u64>().expect("malformed baseline value");
+            (fields[0].to_string(), Cost { units: value(1), heap: value(2), invocations: value(3) })
+        })
+        .collect()
+}
+
+fn write_baseline(costs: &[(String, Cost)]) {
+    let mut text = String::from(
+        "# Costs of the Upala instructions of tests/compute_units.rs, written by\n\
+         # UPALA_CU_BLESS=1 make cu-gate\n\
+         # case units heap invocations\n",
+    );
+    for (case, cost) in costs {
+        text += &format!("{} {} {} {}\n", case, cost.units, cost.heap, cost.invocations);
+    }
+    fs::write(baseline_path(), text).expect("cannot write the baseline");
+}
+
+#[tokio::test]
+async fn test_compute_units() {
+    let capture = Capture::install();
+
+    let program_id = Pubkey::new_unique();
+    let minter = Pubkey::new_unique();
+    let mint_authority = Keypair::new();
+    let mut program_test = ProgramTest::new("helloworld_profile", program_id, None);
+    program_test.add_account(minter, mint_account(&mint_authority.pubkey(), &Pubkey::from_str(SPL_TOKEN_ID).unwrap()));
+
+    let (mut banks_client, payer, _) = program_test.start().await;
+    let upala = UpalaAccounts::new(program_id, payer.pubkey(), minter);
+    let corpus = corpus(&upala, &mint_authority.pubkey());
+    let costs: Vec<(String, Cost)> = replay(&mut banks_client, &payer, &mint_authority, capture, corpus)
+        .await
+        .iter()
+        .map(|(case, lines)| (case.to_string(), cost(lines, &program_id)))
+        .collect();
+
+    for (case, cost) in &costs {
+        println!("{:<24} {:>8} units {:>6} heap bytes {:>3} invocations", case, cost.units, cost.heap, cost.invocations);
+    }
+
+    if std::env::var("UPALA_CU_BLESS").is_ok() {
+        write_baseline(&costs);
+        return;
+    }
+
+    let baseline = read_baseline();
+    let mut regressions = Vec::new();
+    for (case, cost) in &costs {
+        match baseline.get(case) {
+            None => regressions.push(format!("{}: no baseline, record it with UPALA_CU_BLESS=1", case)),
+            Some(base) if cost.units > base.units || cost.heap > base.heap || cost.invocations > base.invocations => {
+                regressions.push(format!("{}: {:?}, baseline {:?}", case, cost, base))
+            }
+            Some(base) if cost != base => println!("{} improved on its baseline, bless it to keep the gain", case),
+            Some(_) => {}
+        }
+    }
+    assert!(regressions.is_empty(), "compute units regressions:\n{}", regressions.join("\n"));
+}
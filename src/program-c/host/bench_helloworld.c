@@ -0,0 +1,278 @@
+/**
+ * @brief Host micro-benchmarks of the Upala program
+ *
+ * Times the hot paths of the program built natively against the host SDK,
+ * at the data sizes of a cluster: a full pools_manager storage, groups of
+ * up to some 16000 members, the largest instructions. The numbers are
+ * host nanoseconds, they compare the versions of the code and do not
+ * stand for compute units. Prints one line per benchmark:
+ * name, size, iterations, nanoseconds per operation.
+ */
+#define _POSIX_C_SOURCE 200809L     // clock_gettime()
+
+#include "../src/helloworld/helloworld.c"
+#include "fixture.h"
+#include "../snapshot/upala_snapshot.h"
+
+#include <stdio.h>
+#include <time.h>
+
+/// Time a benchmark runs for at least
+const static uint64_t BENCH_MIN_NS = 200 * 1000 * 1000;
+
+/// Keeps the compiler from dropping the benchmarked calls
+static volatile uint64_t bench_sink;
+
+typedef void (*BenchFn)(void *state);
+
+static uint64_t bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+/// Runs `fn` in rounds doubling the iterations until the run is long
+/// enough to time, prints the last round
+static void bench_run(const char *name, uint64_t size, BenchFn fn, void *state)
+{
+    for (uint64_t iterations = 1;; iterations *= 2)
+    {
+        const uint64_t start = bench_now();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            fn(state);
+        }
+        const uint64_t elapsed = bench_now() - start;
+        if (elapsed >= BENCH_MIN_NS || iterations >= (1ull << 40))
+        {
+            printf("%-28s %8lu %12lu %12.1f\n", name, (unsigned long) size,
+                   (unsigned long) iterations, (double) elapsed / (double) iterations);
+            return;
+        }
+    }
+}
+
+/// Groups of the storage, more than one instruction can grow it by
+#define BENCH_GROUPS 1024
+
+typedef struct
+{
+    HostWorld  *world;
+    SolPubkey   keys[BENCH_GROUPS];
+    uint64_t    next;
+    uint64_t    members;                    // Members of the group before the operation
+    uint8_t     data[1 + SIZE_PUBKEY + 1 + UINT8_MAX * sizeof (UpalaAccount)];
+    uint64_t    data_len;
+    uint8_t    *input;
+    uint8_t    *group;                      // Data of the group before the operation
+    SplAccount  spl;
+    UpalaSnapshot snapshot;
+    UpalaSnapshot registry;
+} BenchState;
+
+/// Fills the storage with BENCH_GROUPS groups, growing it as the
+/// instructions creating them do
+static void bench_fill_storage(BenchState *state)
+{
+    UpalaContext ctx;
+    host_world_context(state->world, &ctx);
+    state->keys[0] = state->world->keys[UA_Pool];
+    for (uint32_t i = 1; i < BENCH_GROUPS; i++)
+    {
+        const UpalaGroup ug = {host_user(i), state->world->keys[UA_Manager]};
+        state->keys[i] = ug.key;
+        ctx.storage_len = ctx.pools_manager->data_len;
+        sol_host_calls_len = 0;
+        upala_storage_reserve(&ctx, ctx.storage->groups_count + 1);
+        upala_insert_group(ctx.storage, &ug);
+    }
+}
+
+/// Gives the group of UpalaGroupFlags `flags` `members` members, the members 0..
+/// The registry holds the keys of the next UINT8_MAX users too, adding them
+/// does not grow it
+static void bench_fill_group(BenchState *state, uint64_t members, uint8_t flags)
+{
+    HostWorld *w = state->world;
+    UpalaContext ctx;
+    host_world_context(w, &ctx);
+    uint32_t users[UINT8_MAX];
+    SolAccountInfo *group = &w->accounts[UA_Group];
+    host_set_len(group, upala_group_data_len(members + UINT8_MAX, flags));
+    sol_memset(group->data + sizeof (UpalaGroupData), 0, group->data_len - sizeof (UpalaGroupData));
+    UpalaGroupData *gd = host_world_group(w);
+    gd->layout.capacity = (uint32_t) group->data_len;
+    gd->flags = flags;
+    gd->accounts_count = 0;
+    sol_memset(&gd->stats, 0, sizeof (UpalaScoreStats));
+    upala_layout_use(&gd->layout, upala_group_used(gd, 0));
+    for (uint32_t i = 0; i < members + UINT8_MAX; i += UINT8_MAX)
+    {
+        const uint8_t count = (uint8_t)(members - i < UINT8_MAX ? members - i : UINT8_MAX);
+        host_members(state->data, UI_AddUser, &gd->key, i, UINT8_MAX);
+        sol_host_calls_len = 0;
+        upala_registry_enter(&ctx, state->data + 1 + SIZE_PUBKEY + 1, UINT8_MAX, users);
+        if (i < members)
+        {
+            upala_group_merge(gd, state->data + 1 + SIZE_PUBKEY + 1, users, count);
+        }
+    }
+    w->lamports[UA_Group] = rent_exempt_minimum(&HOST_RENT, group->data_len);
+    state->members = members;
+    state->group = realloc(state->group, group->data_len);
+    sol_memcpy(state->group, group->data, (int) group->data_len);
+}
+
+static void bench_find_group(void *arg)
+{
+    BenchState *state = arg;
+    UpalaStorage *storage = (UpalaStorage *) state->world->accounts[UA_PoolsManager].data;
+    bench_sink += (uint64_t) upala_find_group(storage, &state->keys[state->next++ % BENCH_GROUPS]);
+}
+
+static void bench_storage_scan(void *arg)
+{
+    BenchState *state = arg;
+    UpalaStorage *storage = upala_storage(&state->world->accounts[UA_PoolsManager]);
+    const uint32_t *index = upala_storage_index(storage);
+    for (uint32_t i = 0; i < storage->groups_count; i++)
+    {
+        bench_sink += upala_storage_group(storage, index[i])->manager.x[0];
+    }
+}
+
+static void bench_find_member(void *arg)
+{
+    BenchState *state = arg;
+    const SolPubkey uid = host_user((uint32_t)(state->members - 1 - state->next++ % 16));
+    const uint32_t user = upala_registry_find(host_world_registry(state->world), &uid);
+    bench_sink += upala_group_find(host_world_group(state->world), user);
+}
+
+/// The 16 best members scored at least a threshold
+static void bench_top_members(void *arg)
+{
+    BenchState *state = arg;
+    UpalaGroupData *gd = host_world_group(state->world);
+    const uint64_t first = upala_group_at_least(gd, state->next++ % state->members);
+    for (uint64_t r = gd->accounts_count; r > first && r + 16 > gd->accounts_count; r--)
+    {
+        bench_sink += upala_group_ranked(gd, r - 1)->score;
+    }
+}
+
+/// The lookup of the snapshot reader
+static void bench_snapshot_find_member(void *arg)
+{
+    BenchState *state = arg;
+    const SolPubkey uid = host_user((uint32_t)(state->members - 1 - state->next++ % 16));
+    bench_sink += (uint64_t) upala_snapshot_find_member(&state->snapshot, &state->registry, &uid);
+}
+
+static void bench_instruction(void *arg)
+{
+    BenchState *state = arg;
+    bench_sink += host_world_run(state->world, state->data, state->data_len, 0);
+}
+
+/// UI_AddUser, the group is copied back for the next run: the copy is
+/// timed too, it costs about as much as the merge moving every member
+static void bench_add_user(void *arg)
+{
+    BenchState *state = arg;
+    bench_instruction(state);
+    SolAccountInfo *group = &state->world->accounts[UA_Group];
+    sol_memcpy(group->data, state->group, (int) group->data_len);
+}
+
+static void bench_spl_deserialize(void *arg)
+{
+    BenchState *state = arg;
+    bench_sink += spl_deserialize(state->world->accounts[UA_Pool].data, &state->spl);
+    bench_sink += state->spl.amount;
+}
+
+static void bench_entrypoint(void *arg)
+{
+    BenchState *state = arg;
+    bench_sink += entrypoint(state->input);
+}
+
+static void bench_input_parse(void *arg)
+{
+    BenchState *state = arg;
+    UpalaInput in;
+    upala_input_parse(state->input, &in);
+    SolAccountInfo accounts[UPALA_MAX_ACCOUNTS];
+    for (uint64_t i = 0; i < in.ka_num; i++)
+    {
+        upala_input_account(&in, i, &accounts[i]);
+    }
+    bench_sink += accounts[in.ka_num - 1].data_len;
+}
+
+int main(void)
+{
+    static const uint64_t GROUP_SIZES[] = {256, 4096, 16384};
+
+    printf("%-28s %8s %12s %12s\n", "benchmark", "size", "iterations", "ns/op");
+
+    BenchState state = {0};
+    state.world = host_world_new();
+    host_world_create(state.world, 1000000, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    *state.world->accounts[UA_UserAt].owner = state.world->keys[UA_SplToken];
+    bench_fill_storage(&state);
+
+    bench_run("storage/find_group", BENCH_GROUPS, bench_find_group, &state);
+    bench_run("storage/scan", BENCH_GROUPS, bench_storage_scan, &state);
+    bench_run("spl/deserialize", SPL_TOKEN_ACCOUNT_DATA_LEN, bench_spl_deserialize, &state);
+
+    for (size_t i = 0; i < SOL_ARRAY_SIZE(GROUP_SIZES); i++)
+    {
+        const uint64_t size = GROUP_SIZES[i];
+        bench_fill_group(&state, size, UG_ScoreIndex);
+        bench_run("group/top_16_at_least", size, bench_top_members, &state);
+        state.data_len = host_members(state.data, UI_SetScore, &state.world->keys[UA_Pool],
+                                      (uint32_t)(size - 16), 16);
+        bench_run("indexed/set_score_16", size, bench_instruction, &state);
+
+        bench_fill_group(&state, size, 0);
+        bench_run("group/find_member", size, bench_find_member, &state);
+        upala_snapshot_view(&state.snapshot, state.world->accounts[UA_Group].data,
+                            host_len(&state.world->accounts[UA_Group]));
+        upala_snapshot_view(&state.registry, state.world->accounts[UA_Registry].data,
+                            host_len(&state.world->accounts[UA_Registry]));
+        bench_run("snapshot/find_member", size, bench_snapshot_find_member, &state);
+
+        state.data_len = host_members(state.data, UI_AddUser, &state.world->keys[UA_Pool],
+                                      (uint32_t) size, UINT8_MAX);
+        bench_run("instruction/add_user_255", size, bench_add_user, &state);
+
+        // The members added last
+        state.data_len = host_members(state.data, UI_SetScore, &state.world->keys[UA_Pool],
+                                      (uint32_t)(size - 16), 16);
+        bench_run("instruction/set_score_16", size, bench_instruction, &state);
+    }
+
+    // The whole input of an instruction passing UPALA_MAX_ACCOUNTS accounts,
+    // decoded by the entrypoint or all of them
+    bench_fill_group(&state, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    const uint64_t count = host_world_accounts(state.world, UI_SetScore, 0);
+    SolAccountInfo accounts[UPALA_MAX_ACCOUNTS];
+    for (uint64_t i = 0; i < UPALA_MAX_ACCOUNTS; i++)
+    {
+        accounts[i] = i < count ? state.world->ka[i] : state.world->accounts[UA_RolesCount + i % HOST_EXTRA_ACCOUNTS];
+    }
+    state.data_len = host_members(state.data, UI_SetScore, &state.world->keys[UA_Pool], 0, 1);
+    state.input = calloc(1, host_input_len(accounts, UPALA_MAX_ACCOUNTS, state.data_len));
+    host_serialize(state.input, accounts, UPALA_MAX_ACCOUNTS, state.data, state.data_len,
+                   &state.world->program_id);
+    bench_run("input/decode_all", UPALA_MAX_ACCOUNTS, bench_input_parse, &state);
+    bench_run("input/entrypoint_set_score", UPALA_MAX_ACCOUNTS, bench_entrypoint, &state);
+
+    free(state.input);
+    free(state.group);
+    host_world_free(state.world);
+    return 0;
+}
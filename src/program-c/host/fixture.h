@@ -0,0 +1,445 @@
+#pragma once
+/**
+ * @brief Accounts of the Upala instructions for the host tests and benchmarks
+ *
+ * Included after helloworld.c. The world holds one account per
+ * UpalaAccountRole and HOST_EXTRA_ACCOUNTS more for the instructions
+ * addressing accounts by index. The keys of the program accounts are
+ * their program addresses, derived by the host SDK like the program does.
+ * Every account data is preceded by its length, as in the serialized
+ * input, so the program can resize it.
+ */
+#include <solana_sdk.h>
+
+#include <stdlib.h>
+
+#define HOST_EXTRA_ACCOUNTS 8
+#define HOST_ACCOUNTS (UA_RolesCount + HOST_EXTRA_ACCOUNTS)
+
+/// Data room of an account, a group of some 26000 members
+#define HOST_DATA_ROOM (1024 * 1024)
+
+/// Rent of the clusters: 3480 lamports per byte-year, exempt for 2 years
+const static UpalaRent HOST_RENT = {3480, 0x4000000000000000ull};
+
+typedef struct
+{
+    SolPubkey       program_id;
+    SolPubkey       keys[HOST_ACCOUNTS];
+    uint64_t        lamports[HOST_ACCOUNTS];
+    SolPubkey       owners[HOST_ACCOUNTS];
+    uint8_t        *data[HOST_ACCOUNTS];
+    SolAccountInfo  accounts[HOST_ACCOUNTS];
+    SolAccountInfo  ka[UPALA_MAX_ACCOUNTS];     // Accounts of the last instruction
+    SolParameters   params;                     // Of host_world_context()
+} HostWorld;
+
+/// Deterministic key looking random, as the keys of a cluster do
+static SolPubkey host_key(uint32_t seed)
+{
+    SolPubkey key;
+    const SolBytes bytes = {(const uint8_t *) &seed, sizeof (seed)};
+    sol_sha256(&bytes, 1, key.x);
+    return key;
+}
+
+/// Program address of the seeds with its canonical bump seed
+static SolPubkey host_address(const SolSignerSeed *seeds, int seeds_len,
+                              const SolPubkey *program_id, uint8_t *bump_seed)
+{
+    SolPubkey key;
+    uint8_t bump;
+    sol_try_find_program_address(seeds, seeds_len, program_id, &key, &bump);
+    if (bump_seed)
+    {
+        *bump_seed = bump;
+    }
+    return key;
+}
+
+static uint64_t host_len(const SolAccountInfo *account)
+{
+    return *(uint64_t *)(account->data - sizeof (uint64_t));
+}
+
+static void host_set_len(SolAccountInfo *account, uint64_t len)
+{
+    *(uint64_t *)(account->data - sizeof (uint64_t)) = len;
+    account->data_len = len;
+}
+
+/// Key of the user account `index`, HOST_EXTRA_ACCOUNTS users have accounts
+static SolPubkey host_user(uint32_t index)
+{
+    return host_key(1000 + index);
+}
+
+/// Creates the world of a manager who has no group yet: no program
+/// account exists, the manager signs and pays
+static HostWorld *host_world_new(void)
+{
+    HostWorld *w = calloc(1, sizeof (HostWorld));
+    sol_host_reset();
+
+    w->program_id = host_key(1);
+    sol_host_program_id = w->program_id;
+    for (int i = 0; i < HOST_ACCOUNTS; i++)
+    {
+        w->keys[i] = host_user((uint32_t) i);
+        w->data[i] = calloc(1, sizeof (uint64_t) + HOST_DATA_ROOM);
+        w->accounts[i] = (SolAccountInfo){&w->keys[i], &w->lamports[i], 0,
+                                          w->data[i] + sizeof (uint64_t), &w->owners[i],
+                                          0, false, false, false};
+    }
+
+    SolAccountInfo *a = w->accounts;
+    w->keys[UA_Manager]        = host_key(2);
+    w->keys[UA_Minter]         = host_key(3);
+    w->keys[UA_SplToken]       = spl_program_id;
+    w->keys[UA_SystemProgram]  = system_program_id;
+    w->keys[UA_SysvarRent]     = rent_sysvar_id;
+    w->lamports[UA_Manager]    = 1000000000;
+    a[UA_Manager].is_signer    = true;
+    a[UA_SystemProgram].executable = true;
+    a[UA_SplToken].executable  = true;
+    host_set_len(&a[UA_SysvarRent], sizeof (UpalaRent) + sizeof (uint8_t));
+    sol_memcpy(a[UA_SysvarRent].data, &HOST_RENT, sizeof (HOST_RENT));
+
+    const SolSignerSeed pta_seeds[] = {
+        {w->keys[UA_Minter].x, SIZE_PUBKEY},
+        {w->program_id.x, SIZE_PUBKEY}
+    };
+    w->keys[UA_PoolsManager] = host_address(pta_seeds, SOL_ARRAY_SIZE(pta_seeds), &w->program_id, NULL);
+
+    const SolSignerSeed pool_seeds[] = {
+        {w->keys[UA_Manager].x, SIZE_PUBKEY},
+        {w->keys[UA_Minter].x, SIZE_PUBKEY},
+        {w->program_id.x, SIZE_PUBKEY}
+    };
+    w->keys[UA_Pool] = host_address(pool_seeds, SOL_ARRAY_SIZE(pool_seeds), &w->program_id, NULL);
+
+    const SolSignerSeed group_seeds[] = {
+        {UPALA_GROUP_SEED, sizeof (UPALA_GROUP_SEED)},
+        {w->keys[UA_Pool].x, SIZE_PUBKEY},
+        {w->keys[UA_Minter].x, SIZE_PUBKEY},
+        {w->program_id.x, SIZE_PUBKEY}
+    };
+    w->keys[UA_Group] = host_address(group_seeds, SOL_ARRAY_SIZE(group_seeds), &w->program_id, NULL);
+
+    const SolSignerSeed user_seeds[] = {
+        {w->keys[UA_User].x, SIZE_PUBKEY},
+        {w->keys[UA_Minter].x, SIZE_PUBKEY},
+        {w->program_id.x, SIZE_PUBKEY}
+    };
+    w->keys[UA_UserAt] = host_address(user_seeds, SOL_ARRAY_SIZE(user_seeds), &w->program_id, NULL);
+
+    const SolSignerSeed registry_seeds[] = {
+        {UPALA_REGISTRY_SEED, sizeof (UPALA_REGISTRY_SEED)},
+        {w->keys[UA_Minter].x, SIZE_PUBKEY},
+        {w->program_id.x, SIZE_PUBKEY}
+    };
+    w->keys[UA_Registry] = host_address(registry_seeds, SOL_ARRAY_SIZE(registry_seeds), &w->program_id, NULL);
+
+    for (int i = 0; i < HOST_ACCOUNTS; i++)
+    {
+        a[i].is_writable = !a[i].executable && i != UA_SysvarRent && i != UA_Minter;
+    }
+    return w;
+}
+
+static void host_world_free(HostWorld *w)
+{
+    for (int i = 0; i < HOST_ACCOUNTS; i++)
+    {
+        free(w->data[i]);
+    }
+    free(w);
+}
+
+/// Gives the manager the state UI_CreatePool leaves: the storage holding
+/// the group, the pool token account holding `balance` and the group
+/// account of UpalaGroupFlags `flags` with room for `capacity` members.
+/// The registry of the user keys is created empty
+static void host_world_create(HostWorld *w, uint64_t balance, uint64_t capacity, uint8_t flags)
+{
+    SolAccountInfo *a = w->accounts;
+
+    SolAccountInfo *storage = &a[UA_PoolsManager];
+    *storage->owner = w->program_id;
+    w->lamports[UA_PoolsManager] = rent_exempt_minimum(&HOST_RENT, upala_storage_data_len(UPALA_STORAGE_INITIAL_CAPACITY));
+    host_set_len(storage, upala_storage_data_len(UPALA_STORAGE_INITIAL_CAPACITY));
+    upala_storage_init(storage, UINT8_MAX, &w->keys[UA_Manager]);
+
+    SolAccountInfo *pool = &a[UA_Pool];
+    *pool->owner = w->keys[UA_SplToken];
+    w->lamports[UA_Pool] = rent_exempt_minimum(&HOST_RENT, SPL_TOKEN_ACCOUNT_DATA_LEN);
+    host_set_len(pool, SPL_TOKEN_ACCOUNT_DATA_LEN);
+    sol_memcpy(pool->data, w->keys[UA_Minter].x, SIZE_PUBKEY);
+    sol_memcpy(pool->data + SIZE_PUBKEY, w->keys[UA_PoolsManager].x, SIZE_PUBKEY);
+    sol_memcpy(pool->data + 2 * SIZE_PUBKEY, &balance, sizeof (balance));
+    pool->data[2 * SIZE_PUBKEY + sizeof (uint64_t) + sizeof (uint32_t) + SIZE_PUBKEY] = Initialized;
+
+    SolAccountInfo *group = &a[UA_Group];
+    *group->owner = w->program_id;
+    w->lamports[UA_Group] = rent_exempt_minimum(&HOST_RENT, upala_group_data_len(capacity, flags));
+    host_set_len(group, upala_group_data_len(capacity, flags));
+    UpalaGroupData *gd = (UpalaGroupData *) group->data;
+    upala_layout_init(&gd->layout, UL_Group, UPALA_GROUP_VERSION, UINT8_MAX,
+                      group->data_len, sizeof (UpalaGroupData));
+    gd->key = w->keys[UA_Pool];
+    gd->manager = w->keys[UA_Manager];
+    gd->pool_bump = UINT8_MAX;
+    gd->flags = flags;
+    upala_layout_use(&gd->layout, upala_group_used(gd, 0));
+
+    const UpalaGroup ug = {w->keys[UA_Pool], w->keys[UA_Manager]};
+    upala_insert_group((UpalaStorage *) storage->data, &ug);
+
+    SolAccountInfo *registry = &a[UA_Registry];
+    *registry->owner = w->program_id;
+    w->lamports[UA_Registry] = rent_exempt_minimum(&HOST_RENT, upala_registry_data_len(UPALA_REGISTRY_INITIAL_CAPACITY));
+    host_set_len(registry, upala_registry_data_len(UPALA_REGISTRY_INITIAL_CAPACITY));
+    upala_registry_init(registry, &w->keys[UA_Minter], UINT8_MAX);
+}
+
+/// Points the shard and registry roles at the accounts of shard `shard`
+static void host_world_shard_keys(HostWorld *w, uint16_t shard)
+{
+    const uint8_t index[] = {(uint8_t) shard, (uint8_t) (shard >> 8)};
+    const SolSignerSeed shard_seeds[] = {
+        {UPALA_SHARD_SEED, sizeof (UPALA_SHARD_SEED)},
+        {w->keys[UA_Minter].x, SIZE_PUBKEY},
+        {w->program_id.x, SIZE_PUBKEY},
+        {index, sizeof (index)}
+    };
+    w->keys[UA_Shard] = host_address(shard_seeds, SOL_ARRAY_SIZE(shard_seeds), &w->program_id, NULL);
+
+    const SolSignerSeed registry_seeds[] = {
+        {UPALA_REGISTRY_SEED, sizeof (UPALA_REGISTRY_SEED)},
+        {w->keys[UA_Minter].x, SIZE_PUBKEY},
+        {w->program_id.x, SIZE_PUBKEY},
+        {index, sizeof (index)}
+    };
+    w->keys[UA_Registry] = host_address(registry_seeds, SOL_ARRAY_SIZE(registry_seeds), &w->program_id, NULL);
+}
+
+/// Spreads the storage of host_world_create() over `shards_count` shards:
+/// the group moves to the account of its shard, which takes its registry
+static void host_world_shard(HostWorld *w, uint16_t shards_count)
+{
+    SolAccountInfo *a = w->accounts;
+    const uint16_t shard = upala_shard_of(&w->keys[UA_Pool], shards_count);
+    host_world_shard_keys(w, shard);
+
+    SolAccountInfo *root = &a[UA_PoolsManager];
+    SolAccountInfo *account = &a[UA_Shard];
+    *account->owner = w->program_id;
+    w->lamports[UA_Shard] = w->lamports[UA_PoolsManager];
+    host_set_len(account, root->data_len);
+    sol_memcpy(account->data, root->data, (int) root->data_len);
+    UpalaStorage *storage = (UpalaStorage *) account->data;
+    storage->shards_count = shards_count;
+    storage->shard = shard;
+
+    upala_storage_init(root, UINT8_MAX, &w->keys[UA_Manager]);
+    ((UpalaStorage *) root->data)->shards_count = shards_count;
+
+    UpalaRegistry *registry = (UpalaRegistry *) a[UA_Registry].data;
+    registry->shards_count = shards_count;
+    registry->shard = shard;
+}
+
+static UpalaStorage *host_world_storage(HostWorld *w)
+{
+    return upala_storage(&w->accounts[UA_PoolsManager]);
+}
+
+static UpalaGroupData *host_world_group(HostWorld *w)
+{
+    return (UpalaGroupData *) w->accounts[UA_Group].data;
+}
+
+static UpalaRegistry *host_world_registry(HostWorld *w)
+{
+    return upala_registry_layout(w->accounts[UA_Registry].data, host_len(&w->accounts[UA_Registry]));
+}
+
+/// Member of the group of key host_user(index), NULL when it is not a member
+static UpalaMember *host_world_member(HostWorld *w, uint32_t index)
+{
+    const SolPubkey uid = host_user(index);
+    const uint32_t user = upala_registry_find(host_world_registry(w), &uid);
+    UpalaGroupData *group = host_world_group(w);
+    const uint64_t pos = user == UPALA_NO_USER ? UINT64_MAX : upala_group_find(group, user);
+    return pos == UINT64_MAX ? NULL : upala_group_member(group, pos);
+}
+
+/// Context of an instruction of the manager, for the functions of the
+/// program taking one outside of an instruction
+static void host_world_context(HostWorld *w, UpalaContext *ctx)
+{
+    SolAccountInfo *a = w->accounts;
+    w->params = (SolParameters){.ka = a, .ka_num = UA_RolesCount, .program_id = &w->program_id};
+    sol_memset(ctx, 0, sizeof (*ctx));
+    ctx->params         = &w->params;
+    ctx->manager        = &a[UA_Manager];
+    ctx->pools_manager  = &a[UA_PoolsManager];
+    ctx->minter         = &a[UA_Minter];
+    ctx->system_program = &a[UA_SystemProgram];
+    ctx->sysvar_rent    = &a[UA_SysvarRent];
+    ctx->spl_token      = &a[UA_SplToken];
+    ctx->registry       = &a[UA_Registry];
+    ctx->rent           = HOST_RENT;
+    ctx->shard_account  = &a[UA_Shard];
+    ctx->storage_account = &a[UA_PoolsManager];
+    ctx->storage        = host_world_storage(w);
+    ctx->storage_len    = a[UA_PoolsManager].data_len;
+    ctx->users          = host_world_registry(w);
+    ctx->registry_len   = a[UA_Registry].data_len;
+    ctx->pta_seeds[0]   = (SolSignerSeed){w->keys[UA_Minter].x, SIZE_PUBKEY};
+    ctx->pta_seeds[1]   = (SolSignerSeed){w->program_id.x, SIZE_PUBKEY};
+    ctx->pta_seeds[2]   = (SolSignerSeed){&ctx->pta.bump_seed, 1};
+    ctx->pta.seed       = ctx->pta_seeds;
+    ctx->pta.seed_len   = SOL_ARRAY_SIZE(ctx->pta_seeds);
+    ctx->pta.key        = w->keys[UA_PoolsManager];
+    ctx->pta.bump_seed  = UINT8_MAX;
+}
+
+/// Lays out the accounts of the instruction schema followed by `extra`
+/// accounts, the first HOST_EXTRA_ACCOUNTS ones, and returns their count
+static uint64_t host_world_accounts(HostWorld *w, uint8_t instruction, int extra)
+{
+    const UpalaAccountSchema *schema = upala_schema(instruction);
+    uint64_t count = 0;
+    for (int role = 0; schema && role < UA_RolesCount; role++)
+    {
+        if (schema->accounts & UA(role))
+        {
+            w->ka[count++] = w->accounts[role];
+        }
+    }
+    for (int i = 0; i < extra; i++)
+    {
+        w->ka[count++] = w->accounts[UA_RolesCount + i];
+    }
+    for (uint64_t i = 0; i < count; i++)
+    {
+        w->ka[i].data_len = host_len(&w->ka[i]);
+    }
+    return count;
+}
+
+/// Runs the instruction `data` on the world
+static uint64_t host_world_run(HostWorld *w, const uint8_t *data, uint64_t data_len, int extra)
+{
+    SolParameters params = {
+        .ka         = w->ka,
+        .ka_num     = host_world_accounts(w, data_len > 0 ? data[0] : UINT8_MAX, extra),
+        .data       = data,
+        .data_len   = data_len,
+        .program_id = &w->program_id
+    };
+    sol_host_calls_len = 0;
+    const uint64_t result = processing(&params);
+    for (int i = 0; i < HOST_ACCOUNTS; i++)
+    {
+        w->accounts[i].data_len = host_len(&w->accounts[i]);
+    }
+    return result;
+}
+
+/// Serializes the accounts and the instruction the way the loader does,
+/// an account repeating an earlier key is a duplicate, into `input` of
+/// host_input_len() bytes
+static uint64_t host_input_len(const SolAccountInfo *accounts, uint64_t count, uint64_t data_len)
+{
+    uint64_t len = sizeof (uint64_t);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        len += UPALA_INPUT_DATA_LEN + 2 * sizeof (uint64_t) + accounts[i].data_len +
+               MAX_PERMITTED_DATA_INCREASE + sizeof (uint64_t);
+    }
+    return len + sizeof (uint64_t) + data_len + SIZE_PUBKEY;
+}
+
+static uint64_t host_serialize(uint8_t *input,
+                               const SolAccountInfo *accounts, uint64_t count,
+                               const uint8_t *data, uint64_t data_len,
+                               const SolPubkey *program_id)
+{
+    uint8_t *p = input;
+    *(uint64_t *) p = count;
+    p += sizeof (uint64_t);
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        const SolAccountInfo *account = &accounts[i];
+        uint64_t duplicate = 0;
+        while (duplicate < i && !SolPubkey_same(accounts[duplicate].key, account->key))
+        {
+            duplicate++;
+        }
+        if (duplicate < i)
+        {
+            memset(p, 0, sizeof (uint64_t));
+            p[0] = (uint8_t) duplicate;
+            p += sizeof (uint64_t);
+            continue;
+        }
+
+        p[0] = UPALA_INPUT_NOT_DUPLICATE;
+        p[1] = account->is_signer;
+        p[2] = account->is_writable;
+        p[3] = account->executable;
+        memset(p + 4, 0, sizeof (uint32_t));
+        p += 4 * sizeof (uint8_t) + sizeof (uint32_t);
+        memcpy(p, account->key->x, SIZE_PUBKEY);
+        p += SIZE_PUBKEY;
+        memcpy(p, account->owner->x, SIZE_PUBKEY);
+        p += SIZE_PUBKEY;
+        memcpy(p, account->lamports, sizeof (uint64_t));
+        p += sizeof (uint64_t);
+        memcpy(p, &account->data_len, sizeof (uint64_t));
+        p += sizeof (uint64_t);
+        memcpy(p, account->data, account->data_len);
+        memset(p + account->data_len, 0, MAX_PERMITTED_DATA_INCREASE);
+        p += account->data_len + MAX_PERMITTED_DATA_INCREASE;
+        p = (uint8_t *) upala_input_align(p);
+        memcpy(p, &account->rent_epoch, sizeof (uint64_t));
+        p += sizeof (uint64_t);
+    }
+
+    memcpy(p, &data_len, sizeof (uint64_t));
+    p += sizeof (uint64_t);
+    memcpy(p, data, data_len);
+    p += data_len;
+    memcpy(p, program_id->x, SIZE_PUBKEY);
+    p += SIZE_PUBKEY;
+    return (uint64_t)(p - input);
+}
+
+/// Instruction data of an operation on the members of the group:
+/// instruction | gid | count: u8, then `count` entries of the members
+/// `first`.. scored by their index for UI_AddUser and UI_SetScore
+static uint64_t host_members(uint8_t *data, uint8_t instruction, const SolPubkey *gid,
+                             uint32_t first, uint8_t count)
+{
+    uint8_t *p = data;
+    *p++ = instruction;
+    memcpy(p, gid->x, SIZE_PUBKEY);
+    p += SIZE_PUBKEY;
+    *p++ = count;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const SolPubkey uid = host_user(i);
+        memcpy(p, uid.x, SIZE_PUBKEY);
+        p += SIZE_PUBKEY;
+        if (instruction != UI_RemoveUser)
+        {
+            const uint64_t score = i;
+            memcpy(p, &score, sizeof (score));
+            p += sizeof (score);
+        }
+    }
+    return (uint64_t)(p - data);
+}
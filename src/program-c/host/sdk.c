@@ -0,0 +1,403 @@
+/**
+ * @brief Host syscalls of the stand-in SDK, see solana_sdk.h
+ */
+#include <solana_sdk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/// Compute units of a transaction, as the runtime grants them
+#define SOL_HOST_COMPUTE_UNITS 200000
+
+uint8_t      sol_host_heap[HEAP_LENGTH] __attribute__((aligned(8)));
+SolHostCall  sol_host_calls[SOL_HOST_MAX_CALLS];
+uint64_t     sol_host_calls_len;
+SolPubkey    sol_host_program_id;
+uint8_t      sol_host_return_data[MAX_RETURN_DATA];
+uint64_t     sol_host_return_data_len;
+
+static uint64_t sol_host_units = SOL_HOST_COMPUTE_UNITS;
+
+static bool sol_host_verbose(void)
+{
+    static int verbose = -1;
+    if (verbose < 0)
+    {
+        verbose = getenv("SOL_HOST_VERBOSE") != NULL;
+    }
+    return verbose;
+}
+
+static void sol_host_spend(void)
+{
+    if (sol_host_units > 0)
+    {
+        sol_host_units--;
+    }
+}
+
+void sol_host_reset(void)
+{
+    sol_host_calls_len = 0;
+    sol_host_return_data_len = 0;
+    sol_host_units = SOL_HOST_COMPUTE_UNITS;
+    memset(sol_host_heap, 0, sizeof (uint64_t));
+}
+
+void sol_log_(const char *message, uint64_t len)
+{
+    sol_host_spend();
+    if (sol_host_verbose())
+    {
+        printf("Program log: %.*s\n", (int) len, message);
+    }
+}
+
+void sol_log_64_(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5)
+{
+    sol_host_spend();
+    if (sol_host_verbose())
+    {
+        printf("Program log: %#lx, %#lx, %#lx, %#lx, %#lx\n",
+               (unsigned long) arg1, (unsigned long) arg2, (unsigned long) arg3,
+               (unsigned long) arg4, (unsigned long) arg5);
+    }
+}
+
+void sol_log_compute_units_(void)
+{
+    sol_host_spend();
+    if (sol_host_verbose())
+    {
+        printf("Program consumption: %lu units remaining\n", (unsigned long) sol_host_units);
+    }
+}
+
+static void sol_host_print_hex(const char *prefix, const uint8_t *bytes, uint64_t len)
+{
+    printf("%s", prefix);
+    for (uint64_t i = 0; i < len; i++)
+    {
+        printf("%02x", bytes[i]);
+    }
+    printf("\n");
+}
+
+void sol_log_pubkey(const SolPubkey *pubkey)
+{
+    sol_host_spend();
+    if (sol_host_verbose())
+    {
+        sol_host_print_hex("Program log: ", pubkey->x, SIZE_PUBKEY);
+    }
+}
+
+void sol_log_array(const uint8_t *array, int len)
+{
+    sol_host_spend();
+    if (sol_host_verbose())
+    {
+        sol_host_print_hex("Program log: ", array, (uint64_t) len);
+    }
+}
+
+void sol_log_data(SolBytes *data, uint64_t data_len)
+{
+    sol_host_spend();
+    if (sol_host_verbose())
+    {
+        printf("Program data:");
+        for (uint64_t i = 0; i < data_len; i++)
+        {
+            printf(" ");
+            for (uint64_t j = 0; j < data[i].len; j++)
+            {
+                printf("%02x", data[i].addr[j]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+void sol_set_return_data(const uint8_t *bytes, uint64_t bytes_len)
+{
+    sol_host_spend();
+    if (bytes_len > MAX_RETURN_DATA)
+    {
+        fprintf(stderr, "sol_set_return_data: %lu bytes\n", (unsigned long) bytes_len);
+        abort();
+    }
+    memcpy(sol_host_return_data, bytes, bytes_len);
+    sol_host_return_data_len = bytes_len;
+    if (sol_host_verbose())
+    {
+        sol_host_print_hex("Program return: ", bytes, bytes_len);
+    }
+}
+
+uint64_t sol_remaining_compute_units(void)
+{
+    sol_host_spend();
+    return sol_host_units;
+}
+
+void sol_panic_(const char *file, uint64_t len, uint64_t line, uint64_t column)
+{
+    fprintf(stderr, "Panicked in %.*s at %lu:%lu\n", (int) len, file,
+            (unsigned long) line, (unsigned long) column);
+    abort();
+}
+
+void *sol_calloc(size_t nitems, size_t size)
+{
+    return calloc(nitems, size);
+}
+
+void sol_free(void *ptr)
+{
+    free(ptr);
+}
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+typedef struct
+{
+    uint32_t  state[8];
+    uint8_t   block[64];
+    uint64_t  block_len;
+    uint64_t  total_len;
+} Sha256;
+
+static uint32_t sha256_rotr(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_compress(Sha256 *sha, const uint8_t *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16 |
+               (uint32_t) block[4 * i + 2] << 8 | (uint32_t) block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        const uint32_t s0 = sha256_rotr(w[i - 15], 7) ^ sha256_rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = sha256_rotr(w[i - 2], 17) ^ sha256_rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3];
+    uint32_t e = sha->state[4], f = sha->state[5], g = sha->state[6], h = sha->state[7];
+    for (int i = 0; i < 64; i++)
+    {
+        const uint32_t t1 = h + (sha256_rotr(e, 6) ^ sha256_rotr(e, 11) ^ sha256_rotr(e, 25)) +
+                            ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+        const uint32_t t2 = (sha256_rotr(a, 2) ^ sha256_rotr(a, 13) ^ sha256_rotr(a, 22)) +
+                            ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    sha->state[0] += a; sha->state[1] += b; sha->state[2] += c; sha->state[3] += d;
+    sha->state[4] += e; sha->state[5] += f; sha->state[6] += g; sha->state[7] += h;
+}
+
+static void sha256_init(Sha256 *sha)
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(sha->state, init, sizeof (init));
+    sha->block_len = 0;
+    sha->total_len = 0;
+}
+
+static void sha256_update(Sha256 *sha, const uint8_t *data, uint64_t len)
+{
+    sha->total_len += len;
+    while (len > 0)
+    {
+        const uint64_t take = len < 64 - sha->block_len ? len : 64 - sha->block_len;
+        memcpy(sha->block + sha->block_len, data, take);
+        sha->block_len += take;
+        data += take;
+        len -= take;
+        if (sha->block_len == 64)
+        {
+            sha256_compress(sha, sha->block);
+            sha->block_len = 0;
+        }
+    }
+}
+
+static void sha256_final(Sha256 *sha, uint8_t *result)
+{
+    const uint64_t bits = sha->total_len * 8;
+    const uint8_t one = 0x80, zero = 0;
+    sha256_update(sha, &one, 1);
+    while (sha->block_len != 56)
+    {
+        sha256_update(sha, &zero, 1);
+    }
+    uint8_t length[8];
+    for (int i = 0; i < 8; i++)
+    {
+        length[i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    sha256_update(sha, length, sizeof (length));
+    for (int i = 0; i < 8; i++)
+    {
+        result[4 * i]     = (uint8_t)(sha->state[i] >> 24);
+        result[4 * i + 1] = (uint8_t)(sha->state[i] >> 16);
+        result[4 * i + 2] = (uint8_t)(sha->state[i] >> 8);
+        result[4 * i + 3] = (uint8_t) sha->state[i];
+    }
+}
+
+uint64_t sol_sha256(const SolBytes *bytes, int bytes_len, uint8_t *result)
+{
+    sol_host_spend();
+    Sha256 sha;
+    sha256_init(&sha);
+    for (int i = 0; i < bytes_len; i++)
+    {
+        sha256_update(&sha, bytes[i].addr, bytes[i].len);
+    }
+    sha256_final(&sha, result);
+    return SUCCESS;
+}
+
+static const char PDA_MARKER[] = "ProgramDerivedAddress";
+
+static uint64_t sol_host_program_address(const SolSignerSeed *seeds, int seeds_len,
+                                         const uint8_t *bump_seed,
+                                         const SolPubkey *program_id, SolPubkey *address)
+{
+    if (seeds_len > MAX_SEEDS)
+    {
+        return MAX_SEED_LENGTH_EXCEEDED;
+    }
+
+    Sha256 sha;
+    sha256_init(&sha);
+    for (int i = 0; i < seeds_len; i++)
+    {
+        if (seeds[i].len > MAX_SEED_LEN)
+        {
+            return MAX_SEED_LENGTH_EXCEEDED;
+        }
+        sha256_update(&sha, seeds[i].addr, seeds[i].len);
+    }
+    if (bump_seed)
+    {
+        sha256_update(&sha, bump_seed, 1);
+    }
+    sha256_update(&sha, program_id->x, SIZE_PUBKEY);
+    sha256_update(&sha, (const uint8_t *) PDA_MARKER, sizeof (PDA_MARKER) - 1);
+    sha256_final(&sha, address->x);
+    return SUCCESS;
+}
+
+uint64_t sol_create_program_address(const SolSignerSeed *seeds, int seeds_len,
+                                    const SolPubkey *program_id,
+                                    SolPubkey *program_address)
+{
+    sol_host_spend();
+    return sol_host_program_address(seeds, seeds_len, NULL, program_id, program_address);
+}
+
+uint64_t sol_try_find_program_address(const SolSignerSeed *seeds, int seeds_len,
+                                      const SolPubkey *program_id,
+                                      SolPubkey *program_address,
+                                      uint8_t *bump_seed)
+{
+    sol_host_spend();
+    const uint8_t bump = UINT8_MAX;
+    const uint64_t result = sol_host_program_address(seeds, seeds_len, &bump, program_id, program_address);
+    if (result == SUCCESS)
+    {
+        *bump_seed = bump;
+    }
+    return result;
+}
+
+uint64_t sol_invoke_signed_c(const SolInstruction *instruction,
+                             const SolAccountInfo *account_infos, int account_infos_len,
+                             const SolSignerSeeds *signers_seeds, int signers_seeds_len)
+{
+    sol_host_spend();
+    if (sol_host_calls_len == SOL_HOST_MAX_CALLS)
+    {
+        fprintf(stderr, "More than %d cross-program invocations\n", SOL_HOST_MAX_CALLS);
+        abort();
+    }
+
+    SolPubkey signers[MAX_SEEDS];
+    if (signers_seeds_len > MAX_SEEDS)
+    {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    for (int i = 0; i < signers_seeds_len; i++)
+    {
+        const uint64_t err = sol_host_program_address(signers_seeds[i].addr, (int) signers_seeds[i].len,
+                                                      NULL, &sol_host_program_id, &signers[i]);
+        if (err != SUCCESS)
+        {
+            return err;
+        }
+    }
+
+    // Every account of the instruction is passed to the invocation, the
+    // signers sign the transaction or are the program addresses of the seeds
+    for (uint64_t i = 0; i < instruction->account_len; i++)
+    {
+        const SolAccountMeta *meta = &instruction->accounts[i];
+        const SolAccountInfo *info = NULL;
+        for (int j = 0; j < account_infos_len && !info; j++)
+        {
+            if (SolPubkey_same(meta->pubkey, account_infos[j].key))
+            {
+                info = &account_infos[j];
+            }
+        }
+        if (!info)
+        {
+            return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+        }
+
+        bool signed_by = !meta->is_signer || info->is_signer;
+        for (int j = 0; j < signers_seeds_len && !signed_by; j++)
+        {
+            signed_by = SolPubkey_same(meta->pubkey, &signers[j]);
+        }
+        if (!signed_by)
+        {
+            return ERROR_MISSING_REQUIRED_SIGNATURES;
+        }
+    }
+
+    SolHostCall *call = &sol_host_calls[sol_host_calls_len++];
+    memset(call, 0, sizeof (*call));
+    call->program_id = *instruction->program_id;
+    call->account_len = instruction->account_len;
+    for (uint64_t i = 0; i < instruction->account_len && i < SOL_ARRAY_SIZE(call->accounts); i++)
+    {
+        call->accounts[i] = *instruction->accounts[i].pubkey;
+    }
+    call->data_len = instruction->data_len;
+    memcpy(call->data, instruction->data,
+           instruction->data_len < sizeof (call->data) ? instruction->data_len : sizeof (call->data));
+    call->signed_by_program = signers_seeds_len > 0;
+    (void) signers_seeds;
+    return SUCCESS;
+}
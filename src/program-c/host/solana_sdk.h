@@ -0,0 +1,230 @@
+#pragma once
+/**
+ * @brief Host stand-in of the Solana C SDK
+ *
+ * Builds the program natively, without the BPF toolchain, for the host
+ * tests and benchmarks. The types, constants and calls mirror the ones of
+ * the SDK the program uses, the syscalls are implemented by sdk.c:
+ *   - the logs are printed only with SOL_HOST_VERBOSE set in the environment,
+ *   - the cross-program invocations are recorded in sol_host_calls and
+ *     succeed, they change no account; their accounts must be passed and
+ *     their signers sign or be program addresses of sol_host_program_id,
+ *   - the program addresses are SHA-256 of the seeds, the program id and
+ *     "ProgramDerivedAddress", as on chain, without the curve check: the
+ *     first bump seed tried, 255, is the canonical one,
+ *   - the data the program returns is kept in sol_host_return_data,
+ *   - the compute units are counted down by one per syscall.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SUCCESS 0
+
+#define TO_BUILTIN(error) ((uint64_t)(error) << 32)
+
+#define ERROR_CUSTOM_ZERO                   TO_BUILTIN(1)
+#define ERROR_INVALID_ARGUMENT              TO_BUILTIN(2)
+#define ERROR_INVALID_INSTRUCTION_DATA      TO_BUILTIN(3)
+#define ERROR_INVALID_ACCOUNT_DATA          TO_BUILTIN(4)
+#define ERROR_ACCOUNT_DATA_TOO_SMALL        TO_BUILTIN(5)
+#define ERROR_INSUFFICIENT_FUNDS            TO_BUILTIN(6)
+#define ERROR_INCORRECT_PROGRAM_ID          TO_BUILTIN(7)
+#define ERROR_MISSING_REQUIRED_SIGNATURES   TO_BUILTIN(8)
+#define ERROR_ACCOUNT_ALREADY_INITIALIZED   TO_BUILTIN(9)
+#define ERROR_UNINITIALIZED_ACCOUNT         TO_BUILTIN(10)
+#define ERROR_NOT_ENOUGH_ACCOUNT_KEYS       TO_BUILTIN(11)
+#define ERROR_ACCOUNT_BORROW_FAILED         TO_BUILTIN(12)
+#define MAX_SEED_LENGTH_EXCEEDED            TO_BUILTIN(13)
+#define INVALID_SEEDS                       TO_BUILTIN(14)
+
+#define SIZE_PUBKEY 32
+
+#define MAX_PERMITTED_DATA_INCREASE (1024 * 10)
+
+/// Largest data a program returns to its caller
+#define MAX_RETURN_DATA 1024
+
+#define MAX_SEEDS 16
+
+#define MAX_SEED_LEN 32
+
+#define SOL_ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+typedef struct
+{
+    uint8_t x[SIZE_PUBKEY];
+} SolPubkey;
+
+static bool SolPubkey_same(const SolPubkey *one, const SolPubkey *two)
+{
+    return memcmp(one->x, two->x, SIZE_PUBKEY) == 0;
+}
+
+typedef struct
+{
+    SolPubkey  *key;
+    uint64_t   *lamports;
+    uint64_t    data_len;
+    uint8_t    *data;
+    SolPubkey  *owner;
+    uint64_t    rent_epoch;
+    bool        is_signer;
+    bool        is_writable;
+    bool        executable;
+} SolAccountInfo;
+
+typedef struct
+{
+    SolAccountInfo   *ka;
+    uint64_t          ka_num;
+    const uint8_t    *data;
+    uint64_t          data_len;
+    const SolPubkey  *program_id;
+} SolParameters;
+
+typedef struct
+{
+    const uint8_t  *addr;
+    uint64_t        len;
+} SolBytes;
+
+typedef struct
+{
+    SolPubkey  *pubkey;
+    bool        is_writable;
+    bool        is_signer;
+} SolAccountMeta;
+
+typedef struct
+{
+    SolPubkey       *program_id;
+    SolAccountMeta  *accounts;
+    uint64_t         account_len;
+    uint8_t         *data;
+    uint64_t         data_len;
+} SolInstruction;
+
+typedef struct
+{
+    const uint8_t  *addr;
+    uint64_t        len;
+} SolSignerSeed;
+
+typedef struct
+{
+    const SolSignerSeed  *addr;
+    uint64_t              len;
+} SolSignerSeeds;
+
+/// The heap of the program is a host buffer, laid out like the BPF one
+extern uint8_t sol_host_heap[];
+#define HEAP_START_ADDRESS ((uint64_t) sol_host_heap)
+#define HEAP_LENGTH (uint64_t)(32 * 1024)
+
+static void sol_memcpy(void *dst, const void *src, int len)
+{
+    memcpy(dst, src, (size_t) len);
+}
+
+static int sol_memcmp(const void *s1, const void *s2, int n)
+{
+    return memcmp(s1, s2, (size_t) n);
+}
+
+static void sol_memset(void *b, int c, size_t len)
+{
+    memset(b, c, len);
+}
+
+static size_t sol_strlen(const char *s)
+{
+    return strlen(s);
+}
+
+void sol_log_(const char *message, uint64_t len);
+#define sol_log(message) sol_log_(message, sol_strlen(message))
+
+void sol_log_64_(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5);
+#define sol_log_64 sol_log_64_
+
+void sol_log_compute_units_(void);
+#define sol_log_compute_units() sol_log_compute_units_()
+
+void sol_log_pubkey(const SolPubkey *pubkey);
+
+void sol_log_array(const uint8_t *array, int len);
+
+void sol_log_data(SolBytes *data, uint64_t data_len);
+
+void sol_set_return_data(const uint8_t *bytes, uint64_t bytes_len);
+
+uint64_t sol_remaining_compute_units(void);
+
+void sol_panic_(const char *file, uint64_t len, uint64_t line, uint64_t column);
+#define sol_panic() sol_panic_(__FILE__, sizeof(__FILE__), __LINE__, 0)
+
+#define sol_assert(expr) \
+    if (!(expr)) {       \
+        sol_panic();     \
+    }
+
+void *sol_calloc(size_t nitems, size_t size);
+void sol_free(void *ptr);
+
+uint64_t sol_sha256(const SolBytes *bytes, int bytes_len, uint8_t *result);
+
+uint64_t sol_create_program_address(const SolSignerSeed *seeds, int seeds_len,
+                                    const SolPubkey *program_id,
+                                    SolPubkey *program_address);
+
+uint64_t sol_try_find_program_address(const SolSignerSeed *seeds, int seeds_len,
+                                      const SolPubkey *program_id,
+                                      SolPubkey *program_address,
+                                      uint8_t *bump_seed);
+
+uint64_t sol_invoke_signed_c(const SolInstruction *instruction,
+                             const SolAccountInfo *account_infos, int account_infos_len,
+                             const SolSignerSeeds *signers_seeds, int signers_seeds_len);
+
+static uint64_t sol_invoke_signed(const SolInstruction *instruction,
+                                  const SolAccountInfo *account_infos, int account_infos_len,
+                                  const SolSignerSeeds *signers_seeds, int signers_seeds_len)
+{
+    return sol_invoke_signed_c(instruction, account_infos, account_infos_len,
+                               signers_seeds, signers_seeds_len);
+}
+
+static uint64_t sol_invoke(const SolInstruction *instruction,
+                           const SolAccountInfo *account_infos, int account_infos_len)
+{
+    return sol_invoke_signed_c(instruction, account_infos, account_infos_len, NULL, 0);
+}
+
+/// Cross-program invocation recorded by the host
+typedef struct
+{
+    SolPubkey  program_id;
+    SolPubkey  accounts[8];             // Keys of the first instruction accounts
+    uint64_t   account_len;
+    uint8_t    data[64];                // First bytes of the instruction data
+    uint64_t   data_len;
+    bool       signed_by_program;       // Invoked with signer seeds
+} SolHostCall;
+
+#define SOL_HOST_MAX_CALLS 512
+
+extern SolHostCall sol_host_calls[SOL_HOST_MAX_CALLS];
+extern uint64_t    sol_host_calls_len;
+
+/// Program running on the host, the program addresses of the signer
+/// seeds of an invocation are derived from it
+extern SolPubkey   sol_host_program_id;
+
+/// Data of the last sol_set_return_data
+extern uint8_t     sol_host_return_data[MAX_RETURN_DATA];
+extern uint64_t    sol_host_return_data_len;
+
+/// Forgets the recorded invocations, the return data, the heap and restores the compute units
+void sol_host_reset(void);
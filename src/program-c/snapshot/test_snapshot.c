@@ -0,0 +1,114 @@
+#define _DEFAULT_SOURCE     // mkstemp()
+
+#include "../src/helloworld/helloworld.c"
+#include "../host/fixture.h"
+#include "upala_snapshot.h"
+#include <criterion/criterion.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/// Writes the account data to a temporary file, returns its path
+static void write_snapshot(const SolAccountInfo *account, char path[32])
+{
+    strcpy(path, "/tmp/upala_snapshotXXXXXX");
+    const int fd = mkstemp(path);
+    cr_assert(fd >= 0);
+    cr_assert(write(fd, account->data, host_len(account)) == (ssize_t) host_len(account));
+    close(fd);
+}
+
+Test(snapshot, storage_and_group) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 777, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+    uint8_t data[1 + SIZE_PUBKEY + 1 + UINT8_MAX * sizeof (UpalaAccount)];
+    const uint64_t len = host_members(data, UI_AddUser, &w->keys[UA_Pool], 0, 100);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+
+    UpalaContext ctx;
+    host_world_context(w, &ctx);
+    for (uint32_t i = 1; i < 20; i++)
+    {
+        const UpalaGroup ug = {host_user(500 + i), w->keys[UA_Manager]};
+        cr_assert(upala_storage_reserve(&ctx, ctx.storage->groups_count + 1) == SUCCESS);
+        cr_assert(upala_insert_group(ctx.storage, &ug) == SUCCESS);
+    }
+
+    char path[32];
+    UpalaSnapshot snapshot;
+    write_snapshot(&w->accounts[UA_PoolsManager], path);
+    cr_assert(upala_snapshot_open(&snapshot, path) == 0 && snapshot.kind == US_Storage);
+    UpalaGroupIter groups;
+    upala_snapshot_groups(&snapshot, &groups);
+    const UpalaGroup *ug, *previous = NULL;
+    uint64_t count = 0;
+    while ((ug = upala_group_next(&groups)))
+    {
+        cr_assert(!previous || upala_pubkey_cmp(&previous->key, &ug->key) < 0);
+        previous = ug;
+        count++;
+    }
+    cr_assert(count == 20);
+    ug = upala_snapshot_find_group(&snapshot, &w->keys[UA_Pool]);
+    cr_assert(ug && SolPubkey_same(&ug->manager, &w->keys[UA_Manager]));
+    cr_assert(!upala_snapshot_find_member(&snapshot, &snapshot, &w->keys[UA_Pool]));
+    upala_snapshot_close(&snapshot);
+    unlink(path);
+
+    char registry_path[32];
+    UpalaSnapshot registry;
+    write_snapshot(&w->accounts[UA_Registry], registry_path);
+    cr_assert(upala_snapshot_open(&registry, registry_path) == 0 && registry.kind == US_Registry);
+    write_snapshot(&w->accounts[UA_Group], path);
+    cr_assert(upala_snapshot_open(&snapshot, path) == 0 && snapshot.kind == US_Group);
+    UpalaMemberIter members;
+    upala_snapshot_members(&snapshot, &members);
+    count = 0;
+    uint64_t sum = 0;
+    for (const UpalaMember *member, *last = NULL; (member = upala_member_next(&members)); last = member, count++)
+    {
+        cr_assert(!last || last->user < member->user);
+        const SolPubkey uid = host_user((uint32_t) member->score);
+        cr_assert(SolPubkey_same(upala_snapshot_user(&registry, member->user), &uid));
+        sum += member->score;
+    }
+    cr_assert(count == 100 && sum == 99 * 100 / 2);
+    const SolPubkey uid = host_user(77), stranger = host_user(100);
+    const UpalaMember *member = upala_snapshot_find_member(&snapshot, &registry, &uid);
+    cr_assert(member && member->score == 77);
+    cr_assert(!upala_snapshot_find_member(&snapshot, &registry, &stranger));
+    cr_assert(!upala_snapshot_user(&registry, 100) && !upala_snapshot_user(&snapshot, 0));
+    upala_snapshot_close(&snapshot);
+    upala_snapshot_close(&registry);
+    unlink(path);
+    unlink(registry_path);
+
+    write_snapshot(&w->accounts[UA_Pool], path);
+    cr_assert(upala_snapshot_open(&snapshot, path) == 0 && snapshot.kind == US_SplAccount);
+    cr_assert(snapshot.spl.amount == 777 && SolPubkey_same(snapshot.spl.mint, &w->keys[UA_Minter]));
+    upala_snapshot_close(&snapshot);
+    unlink(path);
+    host_world_free(w);
+}
+
+Test(snapshot, rejects_unknown_data) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    UpalaGroupData *gd = host_world_group(w);
+
+    // Members counted past the bytes in use
+    gd->accounts_count = 3;
+    char path[32];
+    UpalaSnapshot snapshot;
+    write_snapshot(&w->accounts[UA_Group], path);
+    cr_assert(upala_snapshot_open(&snapshot, path) == EINVAL);
+    unlink(path);
+
+    gd->accounts_count = 0;
+    cr_assert(upala_snapshot_view(&snapshot, w->accounts[UA_Group].data, host_len(&w->accounts[UA_Group])));
+    cr_assert(!upala_snapshot_view(&snapshot, w->accounts[UA_Group].data + 8, host_len(&w->accounts[UA_Group]) - 8));
+    cr_assert(upala_snapshot_open(&snapshot, "/nonexistent/upala") == ENOENT);
+    host_world_free(w);
+}
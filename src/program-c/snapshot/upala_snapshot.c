@@ -0,0 +1,150 @@
+/**
+ * @brief Zero-copy reader of Upala account snapshots
+ */
+#define _DEFAULT_SOURCE     // madvise()
+
+#include "upala_snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool upala_snapshot_view(UpalaSnapshot *snapshot, uint8_t *data, uint64_t len)
+{
+    snapshot->data = data;
+    snapshot->len = len;
+    snapshot->mapped = false;
+    snapshot->storage = NULL;
+    snapshot->group = NULL;
+    snapshot->registry = NULL;
+    snapshot->kind = US_Unknown;
+    if (((uintptr_t) data % UPALA_RECORD_ALIGN) != 0)
+    {
+        return false;
+    }
+
+    if ((snapshot->storage = upala_storage_layout(data, len)))
+    {
+        snapshot->kind = US_Storage;
+    }
+    else if ((snapshot->group = upala_group_layout(data, len)))
+    {
+        snapshot->kind = US_Group;
+    }
+    else if ((snapshot->registry = upala_registry_layout(data, len)))
+    {
+        snapshot->kind = US_Registry;
+    }
+    else if (len == SPL_TOKEN_ACCOUNT_DATA_LEN && spl_deserialize(data, &snapshot->spl) &&
+             *snapshot->spl.state != Uninitialized)
+    {
+        snapshot->kind = US_SplAccount;
+    }
+    return snapshot->kind != US_Unknown;
+}
+
+int upala_snapshot_open(UpalaSnapshot *snapshot, const char *path)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        const int err = errno;
+        close(fd);
+        return err;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return EINVAL;
+    }
+
+    // Private read-only mapping: the pages are read once, in order
+    uint8_t *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int err = errno;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return err;
+    }
+    madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+    if (!upala_snapshot_view(snapshot, data, (uint64_t) st.st_size))
+    {
+        munmap(data, (size_t) st.st_size);
+        snapshot->data = NULL;
+        return EINVAL;
+    }
+    snapshot->mapped = true;
+    return 0;
+}
+
+void upala_snapshot_close(UpalaSnapshot *snapshot)
+{
+    if (snapshot->mapped)
+    {
+        munmap(snapshot->data, (size_t) snapshot->len);
+    }
+    snapshot->data = NULL;
+    snapshot->mapped = false;
+    snapshot->kind = US_Unknown;
+}
+
+void upala_snapshot_groups(const UpalaSnapshot *snapshot, UpalaGroupIter *it)
+{
+    it->storage = snapshot->storage;
+    it->next = 0;
+}
+
+const UpalaGroup *upala_group_next(UpalaGroupIter *it)
+{
+    if (!it->storage || it->next >= it->storage->groups_count)
+    {
+        return NULL;
+    }
+    return upala_storage_group(it->storage, upala_storage_index(it->storage)[it->next++]);
+}
+
+const UpalaGroup *upala_snapshot_find_group(const UpalaSnapshot *snapshot, const SolPubkey *gid)
+{
+    return snapshot->storage ? upala_find_group(snapshot->storage, gid) : NULL;
+}
+
+void upala_snapshot_members(const UpalaSnapshot *snapshot, UpalaMemberIter *it)
+{
+    it->group = snapshot->group;
+    it->next = 0;
+}
+
+const UpalaMember *upala_member_next(UpalaMemberIter *it)
+{
+    if (!it->group || it->next >= it->group->accounts_count)
+    {
+        return NULL;
+    }
+    return &it->group->members[it->next++];
+}
+
+const SolPubkey *upala_snapshot_user(const UpalaSnapshot *registry, uint32_t index)
+{
+    return registry->registry ? upala_registry_user(registry->registry, index) : NULL;
+}
+
+const UpalaMember *upala_snapshot_find_member(const UpalaSnapshot *group, const UpalaSnapshot *registry,
+                                              const SolPubkey *uid)
+{
+    if (!group->group || !registry->registry)
+    {
+        return NULL;
+    }
+    const uint32_t user = upala_registry_find(registry->registry, uid);
+    const uint64_t i = user != UPALA_NO_USER ? upala_group_find(group->group, user) : UINT64_MAX;
+    return i != UINT64_MAX ? &group->group->members[i] : NULL;
+}
@@ -0,0 +1,84 @@
+#pragma once
+/**
+ * @brief Zero-copy reader of Upala account snapshots
+ *
+ * A snapshot is the raw data of one account, as written by
+ * `solana account <address> --output-file <file>` or fetched over RPC:
+ * the pools_manager storage, a group account, the registry of the user
+ * keys or an SPL token account.
+ * The files are mapped read-only and validated in place with the layouts
+ * of accounts.h, the ones the program writes; the iterators and lookups
+ * return pointers into the mapping, nothing is copied.
+ *
+ * Built natively against the SDK types of host/solana_sdk.h.
+ */
+#include <solana_sdk.h>
+#include "../src/helloworld/accounts.h"
+
+typedef enum
+{
+    US_Unknown,
+    US_Storage,         // pools_manager, UpalaStorage
+    US_Group,           // Group account, UpalaGroupData
+    US_Registry,        // Registry of the user keys, UpalaRegistry
+    US_SplAccount,      // SPL token account, SplAccount
+} UpalaSnapshotKind;
+
+typedef struct
+{
+    uint8_t            *data;
+    uint64_t            len;
+    bool                mapped;     // `data` is a mapping of upala_snapshot_open()
+    UpalaSnapshotKind   kind;
+    UpalaStorage       *storage;    // With US_Storage
+    UpalaGroupData     *group;      // With US_Group
+    UpalaRegistry      *registry;   // With US_Registry
+    SplAccount          spl;        // With US_SplAccount, pointing into `data`
+} UpalaSnapshot;
+
+/// Maps the snapshot file and validates it, returns 0 or an errno value:
+/// EINVAL when the data is no account of a known layout
+int upala_snapshot_open(UpalaSnapshot *snapshot, const char *path);
+
+/// Validates `len` bytes of account data in place, the snapshot points
+/// into `data`, which must stay valid and 8-byte aligned. False when the
+/// data is no account of a known layout
+bool upala_snapshot_view(UpalaSnapshot *snapshot, uint8_t *data, uint64_t len);
+
+/// Unmaps a snapshot of upala_snapshot_open()
+void upala_snapshot_close(UpalaSnapshot *snapshot);
+
+/// Groups of a storage in the order of their keys
+typedef struct
+{
+    UpalaStorage  *storage;
+    uint64_t       next;
+} UpalaGroupIter;
+
+void upala_snapshot_groups(const UpalaSnapshot *snapshot, UpalaGroupIter *it);
+
+/// Next group of the iterator, NULL past the last one
+const UpalaGroup *upala_group_next(UpalaGroupIter *it);
+
+/// Group `gid` of a storage snapshot by binary search, NULL when absent
+const UpalaGroup *upala_snapshot_find_group(const UpalaSnapshot *snapshot, const SolPubkey *gid);
+
+/// Members of a group in the order of their registry indexes
+typedef struct
+{
+    UpalaGroupData  *group;
+    uint64_t         next;
+} UpalaMemberIter;
+
+void upala_snapshot_members(const UpalaSnapshot *snapshot, UpalaMemberIter *it);
+
+/// Next member of the iterator, NULL past the last one
+const UpalaMember *upala_member_next(UpalaMemberIter *it);
+
+/// Key of the user `index` of a registry snapshot, NULL past the users
+const SolPubkey *upala_snapshot_user(const UpalaSnapshot *registry, uint32_t index);
+
+/// Member `uid` of a group snapshot, its index taken from the registry
+/// snapshot, by the member filter and binary search. NULL when absent
+const UpalaMember *upala_snapshot_find_member(const UpalaSnapshot *group, const UpalaSnapshot *registry,
+                                              const SolPubkey *uid);
@@ -0,0 +1,825 @@
+#pragma once
+/**
+ * @brief Data of the accounts the Upala program reads and writes
+ *
+ * The SPL token account, the pools_manager storage, the group account
+ * and the registry layouts with their read helpers, shared by the program
+ * and the native snapshot library of host/. Nothing here depends on the instruction
+ * being processed: the helpers take the account data and its length.
+ */
+#include <solana_sdk.h>
+#include "layout.h"
+
+typedef enum
+{
+    /// Account is not yet initialized
+    Uninitialized,
+    /// Account is initialized; the account owner and/or delegate may perform permitted operations
+    /// on this account
+    Initialized,
+    /// Account has been frozen by the mint freeze authority. Neither the account owner nor
+    /// the delegate are able to perform operations on this account.
+    Frozen,
+} SplAccountState;
+
+typedef struct {
+    SolPubkey *mint; // The mint associated with this account
+    SolPubkey *owner; // The owner of this account.
+    uint64_t   amount;// The amount of tokens this account holds.
+    uint32_t   delegate_is_set;
+    SolPubkey *delegate; // If `delegate` is `Some` then `delegated_amount` represents
+                         // the amount authorized by the delegate
+    SplAccountState *state; // The account's state
+    uint32_t   native_is_set;
+    uint64_t   is_native;  // If is_some, this is a native token, and the value logs the rent-exempt reserve. An Account
+                           // is required to be rent-exempt, so the value is used by the Processor to ensure that wrapped
+                           // SOL accounts do not drop below this threshold.
+    uint64_t   delegated_amount; // The amount delegated
+    uint32_t   close_authority_is_set;
+    SolPubkey *close_authority; // Optional authority to close the account.
+} SplAccount;
+
+const static size_t SPL_TOKEN_ACCOUNT_DATA_LEN = 165;
+
+
+static bool spl_deserialize(const uint8_t *data, SplAccount *account)
+{
+    if (NULL == data || NULL == account)
+    {
+        return false;
+    }
+    account->mint = (SolPubkey *) data;
+    data += SIZE_PUBKEY;
+
+    account->owner = (SolPubkey *) data;
+    data += SIZE_PUBKEY;
+
+    account->amount = *(uint64_t *) data;
+    data += sizeof (uint64_t);
+
+    account->delegate_is_set = *(uint32_t *) data;
+    data += sizeof (uint32_t);
+
+    account->delegate = (SolPubkey *) NULL;
+    if (account->delegate_is_set)
+    {
+        account->delegate = (SolPubkey *) data;
+    }
+    data += SIZE_PUBKEY;
+
+    account->state = (SplAccountState *) data;
+    data += sizeof (uint8_t);
+
+    account->native_is_set  = *(uint32_t *) data;
+    data += sizeof (uint32_t);
+
+    account->is_native = 0;
+    if (account->native_is_set)
+    {
+        account->is_native = *(uint64_t *) data;
+    }
+    data += sizeof (uint64_t);
+
+    account->delegated_amount = *(uint64_t *) data;
+    data += sizeof (uint64_t);
+
+    account->close_authority_is_set = *(uint32_t *) data;
+    data += sizeof (uint32_t);
+
+    account->close_authority = (SolPubkey *) NULL;
+    if (account->close_authority_is_set)
+    {
+        account->close_authority = (SolPubkey *) data;
+    }
+    data += SIZE_PUBKEY;
+
+    return true;
+}
+
+/// Member given by its key, as the instructions hold them
+typedef struct
+{
+    SolPubkey  key;
+    uint64_t   score;
+} UpalaAccount;
+
+/// Member of a group: the index of its key in the registry
+typedef struct
+{
+    uint32_t   user;
+    uint32_t   reserved;
+    uint64_t   score;
+} UpalaMember;
+
+/// Record of the group in the pools_manager storage
+typedef struct
+{
+    SolPubkey     key;
+    SolPubkey     manager;
+} UpalaGroup;
+
+/// Options of a group, chosen when the group is created
+typedef enum
+{
+    UG_ScoreIndex = 1,  // Keeps the ranks of the members by score
+    UG_Merkle     = 2,  // Keeps the Merkle root of the members instead of the members
+    UG_Rewards    = 4,  // Pays the pool deposits out to the members by score, see UpalaRewards
+} UpalaGroupFlags;
+
+/// The group flags UI_CreatePool accepts, UG_Merkle goes with no other
+const static uint8_t UPALA_GROUP_FLAGS = UG_ScoreIndex | UG_Merkle | UG_Rewards;
+
+/// Commitment of a UG_Merkle group to its members, in place of the member
+/// records: the account keeps this size whatever the number of members
+typedef struct
+{
+    SolPubkey  root;        // Of the tree of upala_merkle_leaf(), zero without members
+    uint32_t   members;     // Leaves of the tree, as the manager gives them
+    uint32_t   reserved;
+} UpalaMerkle;
+
+/// Rewards of a UG_Rewards group, past the room of the member records
+///
+/// `per_score` adds up the tokens deposited per unit of score, a 64.64
+/// fixed point number, so a deposit is spread over the members in one
+/// step. The checkpoint of a member, one u64 per member of the room past
+/// this record, is the part of `score * per_score` it is not owed: the
+/// member is owed the difference, and claims it in one step. The products
+/// and the checkpoints wrap around, their differences do not.
+typedef struct
+{
+    uint64_t  per_score[2];  // Low word first
+    uint64_t  held;          // Tokens of the pool owed to the members
+    uint64_t  deposited;     // Tokens deposited since the group was created
+} UpalaRewards;
+
+/// Aggregates of the member scores, kept up to date by every change of
+/// the members so that the readers do not scan the group
+typedef struct
+{
+    uint64_t  sum;
+    uint64_t  min;          // 0 without members
+    uint64_t  max;
+    uint32_t  min_count;    // Members scored `min`
+    uint32_t  max_count;    // Members scored `max`
+} UpalaScoreStats;
+
+/// Layout of the group account data
+///
+/// Every group keeps its members in its own account derived from the
+/// group id, the account grows with the number of members. The layout
+/// header keeps the bump seed of the group account. A UG_Merkle group
+/// keeps an UpalaMerkle instead, and no member record.
+///
+/// The members are held by the registry index of their key, the member
+/// records are sorted by index, an index is a member once. With
+/// UG_ScoreIndex the room of the member records is followed by the ranks:
+/// the positions of the members as u32, ordered by score then by index,
+/// so the members above a score are found by binary search. With
+/// UG_Rewards the UpalaRewards and the checkpoints of the members come
+/// between the member records and the ranks. The member filter ends the
+/// account, past the bytes in use.
+typedef struct
+{
+    UpalaLayout      layout;
+    SolPubkey        key;
+    SolPubkey        manager;
+    uint32_t         accounts_count;
+    uint8_t          pool_bump;     // Canonical bump seed of the pool account
+    uint8_t          flags;         // UpalaGroupFlags
+    UpalaScoreStats  stats;
+    UpalaMember      members[];
+} UpalaGroupData;
+
+/// Current version of the group account layout
+const static uint8_t UPALA_GROUP_VERSION = 1;
+
+/// Compares public keys for equality as four 64-bit words
+static bool upala_pubkey_same(const SolPubkey *one, const SolPubkey *two)
+{
+    const uint64_t *a = (const uint64_t *) one->x;
+    const uint64_t *b = (const uint64_t *) two->x;
+    return ((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a[2] ^ b[2]) | (a[3] ^ b[3])) == 0;
+}
+
+/// Orders public keys by comparing them as four 64-bit words
+static int upala_pubkey_cmp(const SolPubkey *one, const SolPubkey *two)
+{
+    const uint64_t *a = (const uint64_t *) one->x;
+    const uint64_t *b = (const uint64_t *) two->x;
+    for (size_t i = 0; i < SIZE_PUBKEY / sizeof (uint64_t); i++)
+    {
+        if (a[i] != b[i])
+        {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/// Bytes a member takes: its record, its checkpoint with UG_Rewards, its
+/// rank with UG_ScoreIndex and its byte of the member filter
+static uint64_t upala_group_entry_len(uint8_t flags)
+{
+    return sizeof (UpalaMember) + ((flags & UG_Rewards) ? sizeof (uint64_t) : 0) +
+           ((flags & UG_ScoreIndex) ? sizeof (uint32_t) : 0) + sizeof (uint8_t);
+}
+
+/// Bytes of the group past its header whatever its room
+static uint64_t upala_group_fixed_len(uint8_t flags)
+{
+    return sizeof (UpalaGroupData) + ((flags & UG_Rewards) ? sizeof (UpalaRewards) : 0);
+}
+
+/// Data length of a group account with room for `capacity` members
+static uint64_t upala_group_data_len(uint64_t capacity, uint8_t flags)
+{
+    if (flags & UG_Merkle)
+    {
+        return sizeof (UpalaGroupData) + sizeof (UpalaMerkle);
+    }
+    return upala_group_fixed_len(flags) + capacity * upala_group_entry_len(flags);
+}
+
+static uint64_t upala_group_capacity(const UpalaGroupData *group)
+{
+    const uint64_t fixed_len = upala_group_fixed_len(group->flags);
+    if ((group->flags & UG_Merkle) || group->layout.capacity < fixed_len)
+    {
+        return 0;
+    }
+    return (group->layout.capacity - fixed_len) / upala_group_entry_len(group->flags);
+}
+
+/// Offset of the UpalaRewards, past the room of the member records
+static uint64_t upala_group_rewards_offset(const UpalaGroupData *group)
+{
+    return sizeof (UpalaGroupData) + upala_group_capacity(group) * sizeof (UpalaMember);
+}
+
+/// Offset of the checkpoints, past the UpalaRewards
+static uint64_t upala_group_checkpoints_offset(const UpalaGroupData *group)
+{
+    return upala_group_rewards_offset(group) + sizeof (UpalaRewards);
+}
+
+/// Offset of the ranks, past the room of the member records and of the
+/// checkpoints
+static uint64_t upala_group_ranks_offset(const UpalaGroupData *group)
+{
+    if (group->flags & UG_Rewards)
+    {
+        return upala_group_checkpoints_offset(group) + upala_group_capacity(group) * sizeof (uint64_t);
+    }
+    return upala_group_rewards_offset(group);
+}
+
+/// Bytes in use by the group holding `count` members
+static uint64_t upala_group_used(const UpalaGroupData *group, uint64_t count)
+{
+    if (group->flags & UG_Merkle)
+    {
+        return sizeof (UpalaGroupData) + sizeof (UpalaMerkle);
+    }
+    if (group->flags & UG_ScoreIndex)
+    {
+        return upala_group_ranks_offset(group) + count * sizeof (uint32_t);
+    }
+    if (group->flags & UG_Rewards)
+    {
+        return upala_group_checkpoints_offset(group) + count * sizeof (uint64_t);
+    }
+    return sizeof (UpalaGroupData) + count * sizeof (UpalaMember);
+}
+
+/// Offset of the member filter, past the room of the ranks
+static uint64_t upala_group_filter_offset(const UpalaGroupData *group)
+{
+    const uint64_t ranks_len = (group->flags & UG_ScoreIndex) ? upala_group_capacity(group) * sizeof (uint32_t) : 0;
+    return upala_group_ranks_offset(group) + ranks_len;
+}
+
+static UpalaMember *upala_group_member(UpalaGroupData *group, uint64_t i)
+{
+    return UPALA_LAYOUT_AT(&group->layout, UpalaMember,
+                           sizeof (UpalaGroupData) + i * sizeof (UpalaMember));
+}
+
+/// Commitment of the members, NULL without UG_Merkle
+static UpalaMerkle *upala_group_merkle(UpalaGroupData *group)
+{
+    if (!(group->flags & UG_Merkle))
+    {
+        return NULL;
+    }
+    return UPALA_LAYOUT_AT(&group->layout, UpalaMerkle, sizeof (UpalaGroupData));
+}
+
+/// Rewards of the group, NULL without UG_Rewards
+static UpalaRewards *upala_group_rewards(UpalaGroupData *group)
+{
+    if (!(group->flags & UG_Rewards))
+    {
+        return NULL;
+    }
+    return UPALA_LAYOUT_AT(&group->layout, UpalaRewards, upala_group_rewards_offset(group));
+}
+
+/// Checkpoints of the members, NULL without UG_Rewards
+static uint64_t *upala_group_checkpoints(UpalaGroupData *group)
+{
+    if (!(group->flags & UG_Rewards))
+    {
+        return NULL;
+    }
+    return upala_layout_at(&group->layout, upala_group_checkpoints_offset(group),
+                           group->accounts_count * sizeof (uint64_t), _Alignof (uint64_t));
+}
+
+/// `score * per_score`, the rewards of the score since the group was
+/// created, modulo 2^64
+static uint64_t upala_rewards_accrued(const UpalaRewards *rewards, uint64_t score)
+{
+    const __uint128_t low = (__uint128_t) score * rewards->per_score[0];
+    return score * rewards->per_score[1] + (uint64_t)(low >> 64);
+}
+
+/// Tokens the member at `i` is owed, 0 without UG_Rewards
+static uint64_t upala_group_pending(UpalaGroupData *group, uint64_t i)
+{
+    const UpalaRewards *rewards = upala_group_rewards(group);
+    const uint64_t *checkpoints = upala_group_checkpoints(group);
+    if (!rewards || !checkpoints || i >= group->accounts_count)
+    {
+        return 0;
+    }
+    return upala_rewards_accrued(rewards, upala_group_member(group, i)->score) - checkpoints[i];
+}
+
+/// Ranks of the members, NULL without UG_ScoreIndex
+static uint32_t *upala_group_ranks(UpalaGroupData *group)
+{
+    if (!(group->flags & UG_ScoreIndex))
+    {
+        return NULL;
+    }
+    return upala_layout_at(&group->layout, upala_group_ranks_offset(group),
+                           group->accounts_count * sizeof (uint32_t), _Alignof (uint32_t));
+}
+
+/// First of the `ranked` ranks whose member does not come before the
+/// score and the user index, the first rank of the score for user 0
+static uint64_t upala_group_rank_search(UpalaGroupData *group, const uint32_t *ranks, uint64_t ranked,
+                                        uint64_t score, uint32_t user)
+{
+    uint64_t lo = 0;
+    uint64_t hi = ranked;
+    while (lo < hi)
+    {
+        const uint64_t mid = (lo + hi) / 2;
+        const UpalaMember *member = upala_group_member(group, ranks[mid]);
+        const bool before = member->score < score || (member->score == score && member->user < user);
+        if (before) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/// Member of rank `r`, the ranks go from the lowest score up: the top k
+/// members are the ranks count - k to count - 1. NULL without UG_ScoreIndex
+static UpalaMember *upala_group_ranked(UpalaGroupData *group, uint64_t r)
+{
+    const uint32_t *ranks = upala_group_ranks(group);
+    if (!ranks || r >= group->accounts_count)
+    {
+        return NULL;
+    }
+    return upala_group_member(group, ranks[r]);
+}
+
+/// First rank scored at least `threshold`, the ranks from there up hold
+/// the members above the threshold. UINT64_MAX without UG_ScoreIndex
+static uint64_t upala_group_at_least(UpalaGroupData *group, uint64_t threshold)
+{
+    const uint32_t *ranks = upala_group_ranks(group);
+    if (!ranks)
+    {
+        return UINT64_MAX;
+    }
+    return upala_group_rank_search(group, ranks, group->accounts_count, threshold, 0);
+}
+
+/// Bits a user sets in the member filter
+const static uint64_t UPALA_FILTER_PROBES = 3;
+
+/// Member filter: a Bloom filter of the member indexes, 8 bits per member
+/// of the room. NULL without room
+static uint8_t *upala_group_filter(UpalaGroupData *group)
+{
+    const uint64_t capacity = upala_group_capacity(group);
+    const uint64_t offset = upala_group_filter_offset(group);
+    if (capacity == 0 || offset + capacity > group->layout.capacity)
+    {
+        return NULL;
+    }
+    return (uint8_t *) group + offset;
+}
+
+/// Bit of the user index for the probe `probe` of a filter of `bits`
+/// bits. The indexes are dense, a multiplicative hash spreads them
+static uint64_t upala_filter_bit(uint32_t user, uint64_t probe, uint64_t bits)
+{
+    const uint64_t hash = user * 0x9e3779b97f4a7c15ull;
+    return ((hash >> 32) + probe * ((hash & UINT32_MAX) | 1)) % bits;
+}
+
+/// False when the user is not a member, true when it may be one: about 3
+/// users in 100 that are not members pass a full group
+static bool upala_group_may_hold(UpalaGroupData *group, uint32_t user)
+{
+    const uint8_t *filter = upala_group_filter(group);
+    if (!filter)
+    {
+        return group->accounts_count > 0;
+    }
+    const uint64_t bits = upala_group_capacity(group) * 8;
+    for (uint64_t probe = 0; probe < UPALA_FILTER_PROBES; probe++)
+    {
+        const uint64_t bit = upala_filter_bit(user, probe, bits);
+        if (!(filter[bit / 8] & (1u << (bit % 8))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Binary search of the member by user index
+///
+/// Returns true if the user is a member, `pos` is set to the position of
+/// the member or to the position where it has to be inserted.
+static bool upala_group_search(UpalaGroupData *group, uint32_t user, uint64_t *pos)
+{
+    uint64_t lo = 0;
+    uint64_t hi = group->accounts_count;
+    while (lo < hi)
+    {
+        const uint64_t mid = (lo + hi) / 2;
+        const uint32_t member = upala_group_member(group, mid)->user;
+        if (member == user)
+        {
+            *pos = mid;
+            return true;
+        }
+        if (member < user) lo = mid + 1;
+        else hi = mid;
+    }
+    *pos = lo;
+    return false;
+}
+
+/// Position of the member in the group, UINT64_MAX when it is not a member.
+/// The filter turns most of the other users away before the search
+static uint64_t upala_group_find(UpalaGroupData *group, uint32_t user)
+{
+    uint64_t pos;
+    if (!upala_group_may_hold(group, user) || !upala_group_search(group, user, &pos))
+    {
+        return UINT64_MAX;
+    }
+    return pos;
+}
+
+/// Group data of `len` bytes, NULL unless it holds a group of the current
+/// layout with its members and ranks within the bytes in use
+static UpalaGroupData *upala_group_layout(uint8_t *data, uint64_t len)
+{
+    const UpalaLayout *layout = upala_layout_data(data, len, UL_Group);
+    if (!layout || layout->version != UPALA_GROUP_VERSION ||
+        layout->capacity < sizeof (UpalaGroupData))
+    {
+        return NULL;
+    }
+
+    UpalaGroupData *ug = (UpalaGroupData *) data;
+    if ((ug->flags & ~UPALA_GROUP_FLAGS) != 0 || ((ug->flags & UG_Merkle) && ug->flags != UG_Merkle) ||
+        ug->accounts_count > upala_group_capacity(ug) ||
+        layout->used != upala_group_used(ug, ug->accounts_count))
+    {
+        return NULL;
+    }
+    return ug;
+}
+
+/// First byte of the hashed leaves and nodes, a leaf never passes for a node
+const static uint8_t UPALA_MERKLE_LEAF = 0;
+const static uint8_t UPALA_MERKLE_NODE = 1;
+
+/// Longest proof, of a tree of 2^32 members
+const static uint64_t UPALA_MERKLE_MAX_DEPTH = 32;
+
+/// Leaf of the member: SHA-256 of UPALA_MERKLE_LEAF | uid | score: u64
+static void upala_merkle_leaf(const SolPubkey *uid, uint64_t score, SolPubkey *leaf)
+{
+    const SolBytes bytes[] = {
+        {&UPALA_MERKLE_LEAF, sizeof (uint8_t)},
+        {uid->x, SIZE_PUBKEY},
+        {(const uint8_t *) &score, sizeof (score)}
+    };
+    sol_sha256(bytes, SOL_ARRAY_SIZE(bytes), leaf->x);
+}
+
+/// Parent of two nodes: SHA-256 of UPALA_MERKLE_NODE and the two nodes in
+/// the order of their bytes, a proof needs no side of its nodes
+static void upala_merkle_node(const SolPubkey *one, const SolPubkey *two, SolPubkey *node)
+{
+    const bool ordered = sol_memcmp(one->x, two->x, SIZE_PUBKEY) <= 0;
+    const SolBytes bytes[] = {
+        {&UPALA_MERKLE_NODE, sizeof (uint8_t)},
+        {(ordered ? one : two)->x, SIZE_PUBKEY},
+        {(ordered ? two : one)->x, SIZE_PUBKEY}
+    };
+    sol_sha256(bytes, SOL_ARRAY_SIZE(bytes), node->x);
+}
+
+/// True when the `depth` nodes of the proof lead from the leaf of the
+/// member up to the root
+static bool upala_merkle_verify(const SolPubkey *root, const SolPubkey *uid, uint64_t score,
+                                const SolPubkey *proof, uint64_t depth)
+{
+    SolPubkey node;
+    upala_merkle_leaf(uid, score, &node);
+    for (uint64_t i = 0; i < depth; i++)
+    {
+        upala_merkle_node(&node, &proof[i], &node);
+    }
+    return upala_pubkey_same(&node, root);
+}
+
+/// Registry index of no user
+const static uint32_t UPALA_NO_USER = UINT32_MAX;
+
+/// Layout of the registry account data
+///
+/// The registry keeps the key of every member of the groups once, the
+/// groups hold the index of the key. The keys stay where they are
+/// registered, an index never changes. The room of the keys is followed
+/// by the order: the indexes as u32 sorted by key, so a key is found by
+/// binary search. The layout header keeps the bump seed of the registry
+/// address, the minter binds the registry to the storage of the minter
+/// without deriving the address again. A storage that is not sharded has
+/// one registry that every UI_AddUser of the minter writes; a sharded
+/// storage has a registry per shard, for the members of the groups of the
+/// shard.
+typedef struct
+{
+    UpalaLayout  layout;
+    SolPubkey    minter;
+    uint32_t     users_count;
+    uint16_t     shards_count;  // Of the storage, 0 when it is not sharded
+    uint16_t     shard;
+    SolPubkey    users[];
+} UpalaRegistry;
+
+/// Current version of the registry layout
+const static uint8_t UPALA_REGISTRY_VERSION = 1;
+
+/// Data length of a registry with room for `capacity` keys
+static uint64_t upala_registry_data_len(uint64_t capacity)
+{
+    return sizeof (UpalaRegistry) + capacity * (SIZE_PUBKEY + sizeof (uint32_t));
+}
+
+static uint64_t upala_registry_capacity(const UpalaRegistry *registry)
+{
+    if (registry->layout.capacity < sizeof (UpalaRegistry))
+    {
+        return 0;
+    }
+    return (registry->layout.capacity - sizeof (UpalaRegistry)) / (SIZE_PUBKEY + sizeof (uint32_t));
+}
+
+/// Offset of the order, past the room of the keys
+static uint64_t upala_registry_order_offset(const UpalaRegistry *registry)
+{
+    return sizeof (UpalaRegistry) + upala_registry_capacity(registry) * SIZE_PUBKEY;
+}
+
+/// Bytes in use by the registry holding `count` keys
+static uint64_t upala_registry_used(const UpalaRegistry *registry, uint64_t count)
+{
+    return upala_registry_order_offset(registry) + count * sizeof (uint32_t);
+}
+
+/// Key of the user index, NULL past the registered keys
+static SolPubkey *upala_registry_user(UpalaRegistry *registry, uint64_t user)
+{
+    if (user >= registry->users_count)
+    {
+        return NULL;
+    }
+    return UPALA_LAYOUT_AT(&registry->layout, SolPubkey, sizeof (UpalaRegistry) + user * SIZE_PUBKEY);
+}
+
+static uint32_t *upala_registry_order(UpalaRegistry *registry)
+{
+    return upala_layout_at(&registry->layout, upala_registry_order_offset(registry),
+                           registry->users_count * sizeof (uint32_t), _Alignof (uint32_t));
+}
+
+/// Binary search of the key in the order
+///
+/// Returns true if the key is registered, `pos` is set to the position of
+/// its index in the order or to the position where it has to be inserted.
+static bool upala_registry_search(UpalaRegistry *registry, const SolPubkey *key, uint64_t *pos)
+{
+    const uint32_t *order = upala_registry_order(registry);
+    uint64_t lo = 0;
+    uint64_t hi = order ? registry->users_count : 0;
+    while (lo < hi)
+    {
+        const uint64_t mid = (lo + hi) / 2;
+        const SolPubkey *user = upala_registry_user(registry, order[mid]);
+        if (!user)
+        {
+            break;
+        }
+        const int cmp = upala_pubkey_cmp(user, key);
+        if (cmp == 0)
+        {
+            *pos = mid;
+            return true;
+        }
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *pos = lo;
+    return false;
+}
+
+/// Index of the key, UPALA_NO_USER when it is not registered
+static uint32_t upala_registry_find(UpalaRegistry *registry, const SolPubkey *key)
+{
+    uint64_t pos;
+    if (!upala_registry_search(registry, key, &pos))
+    {
+        return UPALA_NO_USER;
+    }
+    return upala_registry_order(registry)[pos];
+}
+
+/// Registry data of `len` bytes, NULL unless it holds the current layout
+static UpalaRegistry *upala_registry_layout(uint8_t *data, uint64_t len)
+{
+    const UpalaLayout *layout = upala_layout_data(data, len, UL_Registry);
+    if (!layout || layout->version != UPALA_REGISTRY_VERSION ||
+        layout->capacity < sizeof (UpalaRegistry))
+    {
+        return NULL;
+    }
+
+    UpalaRegistry *registry = (UpalaRegistry *) data;
+    if (registry->users_count > upala_registry_capacity(registry) ||
+        layout->used != upala_registry_used(registry, registry->users_count))
+    {
+        return NULL;
+    }
+    return registry;
+}
+
+/// Layout of the pools_manager account data
+///
+/// Groups are stored in the order of creation, the room of the group
+/// records is followed by the index: the slots of the groups as u32 sorted
+/// by the group key, so a group can be found by binary search. The account
+/// grows with the groups and shrinks when they are removed. The layout
+/// header keeps the bump seed of the pools_manager address.
+///
+/// A sharded storage spreads the groups over `shards_count` shard
+/// accounts of this layout, the shard of a group follows from its key,
+/// see upala_shard_of(). The pools_manager then holds no group, the
+/// instructions on different shards do not write a common account.
+///
+/// The authority is the manager who created the storage, copied to its
+/// shards. Only it cleans the storage and it gets the rent given back when
+/// the storage shrinks.
+typedef struct
+{
+    UpalaLayout layout;
+    uint32_t    groups_count;
+    uint16_t    shards_count;   // 0 when the storage is not sharded
+    uint16_t    shard;          // Index of the shard account
+    SolPubkey   authority;
+    UpalaGroup  groups[];
+} UpalaStorage;
+
+/// Current version of the storage layout
+const static uint8_t UPALA_STORAGE_VERSION = 1;
+
+/// Data length of a storage with room for `capacity` groups
+static uint64_t upala_storage_data_len(uint64_t capacity)
+{
+    return sizeof (UpalaStorage) + capacity * (sizeof (UpalaGroup) + sizeof (uint32_t));
+}
+
+static uint64_t upala_storage_capacity(const UpalaStorage *storage)
+{
+    if (storage->layout.capacity < sizeof (UpalaStorage))
+    {
+        return 0;
+    }
+    return (storage->layout.capacity - sizeof (UpalaStorage)) / (sizeof (UpalaGroup) + sizeof (uint32_t));
+}
+
+/// Offset of the index, past the room of the group records
+static uint64_t upala_storage_index_offset(const UpalaStorage *storage)
+{
+    return sizeof (UpalaStorage) + upala_storage_capacity(storage) * sizeof (UpalaGroup);
+}
+
+/// Bytes in use by the storage holding `groups_count` groups
+static uint64_t upala_storage_used(const UpalaStorage *storage, uint64_t groups_count)
+{
+    return upala_storage_index_offset(storage) + groups_count * sizeof (uint32_t);
+}
+
+static UpalaGroup *upala_storage_group(UpalaStorage *storage, uint64_t slot)
+{
+    return UPALA_LAYOUT_AT(&storage->layout, UpalaGroup, sizeof (UpalaStorage) + slot * sizeof (UpalaGroup));
+}
+
+/// Slots of the groups sorted by the group key
+static uint32_t *upala_storage_index(UpalaStorage *storage)
+{
+    return upala_layout_at(&storage->layout, upala_storage_index_offset(storage),
+                           storage->groups_count * sizeof (uint32_t), _Alignof (uint32_t));
+}
+
+/// Storage data of `len` bytes, NULL unless it holds the current layout
+static UpalaStorage *upala_storage_layout(uint8_t *data, uint64_t len)
+{
+    const UpalaLayout *layout = upala_layout_data(data, len, UL_Storage);
+    if (!layout || layout->version != UPALA_STORAGE_VERSION ||
+        layout->capacity < sizeof (UpalaStorage))
+    {
+        return NULL;
+    }
+
+    UpalaStorage *storage = (UpalaStorage *) data;
+    if (storage->groups_count > upala_storage_capacity(storage) ||
+        layout->used != upala_storage_used(storage, storage->groups_count))
+    {
+        return NULL;
+    }
+    return storage;
+}
+
+/// Largest number of shards of a storage
+const static uint16_t UPALA_MAX_SHARDS = 64;
+
+/// Shard of the group `gid` in a storage of `shards_count` shards, the
+/// keys being hashes their first word spreads the groups evenly
+static uint16_t upala_shard_of(const SolPubkey *gid, uint16_t shards_count)
+{
+    return (uint16_t) (*(const uint64_t *) gid->x % shards_count);
+}
+
+/// Binary search of the group in the storage index
+///
+/// Returns true if the group exists, `pos` is set to the position of the
+/// group in the index or to the position where it has to be inserted.
+static bool upala_find_group_pos(UpalaStorage *storage, const SolPubkey *gid, uint32_t *pos)
+{
+    const uint32_t *index = upala_storage_index(storage);
+    size_t lo = 0;
+    size_t hi = index ? storage->groups_count : 0;
+    while (lo < hi)
+    {
+        const size_t mid = (lo + hi) / 2;
+        const UpalaGroup *ug = upala_storage_group(storage, index[mid]);
+        if (!ug)
+        {
+            break;
+        }
+        const int cmp = upala_pubkey_cmp(&ug->key, gid);
+        if (cmp == 0)
+        {
+            *pos = (uint32_t) mid;
+            return true;
+        }
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *pos = (uint32_t) lo;
+    return false;
+}
+
+static UpalaGroup *upala_find_group(UpalaStorage *storage, const SolPubkey *gid)
+{
+    uint32_t pos;
+    if (!upala_find_group_pos(storage, gid, &pos))
+    {
+        return NULL;
+    }
+    return upala_storage_group(storage, upala_storage_index(storage)[pos]);
+}
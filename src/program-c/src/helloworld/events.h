@@ -0,0 +1,76 @@
+#pragma once
+/**
+ * @brief Upala events and debug logs
+ *
+ * Every state change is reported by one binary record, emitted with a
+ * single sol_log_data call ("Program data:" line of the transaction log).
+ * The first field of a record starts with the UpalaEventKind byte, the
+ * fields are little-endian and not padded. Needs an SDK providing
+ * sol_log_data().
+ *
+ * Text dumps are debug only: define DEBUG_LOG to build them in.
+ */
+#include <solana_sdk.h>
+
+//#define DEBUG_LOG
+
+typedef enum
+{
+    UE_GroupCreated = 1,  // kind | gid | manager
+    UE_GroupRemoved,      // kind | gid
+    UE_UserAdded,         // kind | gid | count: u8, then count * (uid | score: u64)
+    UE_PoolEmptied,       // kind | pool | recipient | amount: u64, one per payout
+    UE_StorageCleaned,    // kind | pools_manager
+    UE_ScoreSet,          // kind | gid | count: u8, then count * (uid | score: u64)
+    UE_UserRemoved,       // kind | gid | count: u8, then count * uid
+    UE_ShardCreated,      // kind | shard | shard index: u16 | shards count: u16
+    UE_RootSet,           // kind | gid | root | members: u32
+    UE_Deposited,         // kind | gid | source token account | amount: u64
+    UE_Claimed,           // kind | gid | uid | amount: u64
+} UpalaEventKind;
+
+/// Largest fixed part of an event
+#define UPALA_EVENT_MAX_LEN (sizeof (uint8_t) + 2 * SIZE_PUBKEY + sizeof (uint64_t))
+
+typedef struct
+{
+    uint8_t  data[UPALA_EVENT_MAX_LEN];
+    uint64_t len;
+} UpalaEvent;
+
+static void upala_event_begin(UpalaEvent *event, UpalaEventKind kind)
+{
+    event->data[0] = (uint8_t) kind;
+    event->len = sizeof (uint8_t);
+}
+
+static void upala_event_put(UpalaEvent *event, const void *value, uint64_t len)
+{
+    sol_memcpy(event->data + event->len, value, len);
+    event->len += len;
+}
+
+static void upala_event_put_pubkey(UpalaEvent *event, const SolPubkey *key)
+{
+    upala_event_put(event, key->x, SIZE_PUBKEY);
+}
+
+/// Emits the event, `tail` is logged as the second field without copying
+static void upala_event_emit(const UpalaEvent *event, const uint8_t *tail, uint64_t tail_len)
+{
+    SolBytes fields[] = {
+        {event->data, event->len},
+        {tail, tail_len}
+    };
+    sol_log_data(fields, tail ? SOL_ARRAY_SIZE(fields) : 1);
+}
+
+#ifdef DEBUG_LOG
+#define upala_debug(message)        sol_log(message)
+#define upala_debug_pubkey(key)     sol_log_pubkey(key)
+#define upala_debug_64(...)         sol_log_64(__VA_ARGS__)
+#else
+#define upala_debug(message)
+#define upala_debug_pubkey(key)
+#define upala_debug_64(...)
+#endif
@@ -2,9 +2,28 @@
  * @brief C-based Helloworld BPF program
  */
 #include <solana_sdk.h>
+#include "profile.h"
+#include "events.h"
+#include "queries.h"
+#include "layout.h"
+#include "accounts.h"
+#include "input.h"
+#include "keys.h"
 
 //#define DEBUG_INSTRUCTION_DATA
 
+/// Create a new account
+///
+/// # Account references
+///   0. [WRITE, SIGNER] Funding account
+///   1. [WRITE, SIGNER] New account
+/// # Payload
+///   0. this cmd - uint32_t
+///   1. lamports - uint64_t
+///   2. space - uint64_t
+///   3. owner - SolPubkey    // Owner program account
+const static uint32_t SI_CREATE_ACCOUNT = 0;
+
 /// Assign account to a program
 ///
 /// # Account references
@@ -82,92 +101,7 @@ const static uint8_t TI_TRANSFER = 3;
 ///   }
 const static uint8_t TI_APPROVE = 4;
 
-typedef enum
-{
-    /// Account is not yet initialized
-    Uninitialized,
-    /// Account is initialized; the account owner and/or delegate may perform permitted operations
-    /// on this account
-    Initialized,
-    /// Account has been frozen by the mint freeze authority. Neither the account owner nor
-    /// the delegate are able to perform operations on this account.
-    Frozen,
-} SplAccountState;
-
-typedef struct {
-    SolPubkey *mint; // The mint associated with this account
-    SolPubkey *owner; // The owner of this account.
-    uint64_t   amount;// The amount of tokens this account holds.
-    uint32_t   delegate_is_set;
-    SolPubkey *delegate; // If `delegate` is `Some` then `delegated_amount` represents
-                         // the amount authorized by the delegate
-    SplAccountState *state; // The account's state
-    uint32_t   native_is_set;
-    uint64_t   is_native;  // If is_some, this is a native token, and the value logs the rent-exempt reserve. An Account
-                           // is required to be rent-exempt, so the value is used by the Processor to ensure that wrapped
-                           // SOL accounts do not drop below this threshold.
-    uint64_t   delegated_amount; // The amount delegated
-    uint32_t   close_authority_is_set;
-    SolPubkey *close_authority; // Optional authority to close the account.
-} SplAccount;
-
-const static size_t SPL_TOKEN_ACCOUNT_DATA_LEN = 165;
-
-
-static bool spl_deserialize(const uint8_t *data, SplAccount *account)
-{
-    if (NULL == data || NULL == account)
-    {
-        return false;
-    }
-    account->mint = (SolPubkey *) data;
-    data += SIZE_PUBKEY;
-
-    account->owner = (SolPubkey *) data;
-    data += SIZE_PUBKEY;
-
-    account->amount = *(uint64_t *) data;
-    data += sizeof (uint64_t);
-
-    account->delegate_is_set = *(uint32_t *) data;
-    data += sizeof (uint32_t);
-
-    account->delegate = (SolPubkey *) NULL;
-    if (account->delegate_is_set)
-    {
-        account->delegate = (SolPubkey *) data;
-    }
-    data += SIZE_PUBKEY;
-
-    account->state = (SplAccountState *) data;
-    data += sizeof (uint8_t);
-
-    account->native_is_set  = *(uint32_t *) data;
-    data += sizeof (uint32_t);
-
-    account->is_native = 0;
-    if (account->native_is_set)
-    {
-        account->is_native = *(uint64_t *) data;
-    }
-    data += sizeof (uint64_t);
-
-    account->delegated_amount = *(uint64_t *) data;
-    data += sizeof (uint64_t);
-
-    account->close_authority_is_set = *(uint32_t *) data;
-    data += sizeof (uint32_t);
-
-    account->close_authority = (SolPubkey *) NULL;
-    if (account->close_authority_is_set)
-    {
-        account->close_authority = (SolPubkey *) data;
-    }
-    data += SIZE_PUBKEY;
-
-    return true;
-}
-
+#ifdef DEBUG_LOG
 static void spl_log_account(const SplAccount *account)
 {
     sol_log("SPL account info:");
@@ -200,6 +134,7 @@ static void spl_log_account(const SplAccount *account)
     }
     else sol_log("Optional authority to close the account not set");
 }
+#endif
 
 typedef enum
 {
@@ -209,12 +144,133 @@ typedef enum
     UI_AddUser,      // 3
     UI_RemoveUser,   // 4
     UI_SetScore,     // 5
-    UI_CleanStorage  // 6
+    UI_CleanStorage, // 6
+    UI_Migrate,      // 7
+    UI_Batch,        // 8
+    UI_Distribute,   // 9
+    UI_CreateShard,  // 10
+    UI_GetGroup,     // 11
+    UI_GetMember,    // 12
+    UI_ListMembers,  // 13
+    UI_SetRoot,      // 14
+    UI_VerifyMember, // 15
+    UI_Deposit,      // 16
+    UI_Claim         // 17
 } UpalaInstruction;
 
-static uint64_t transfer_to_ata(SolAccountInfo *payer,
-                                SolAccountInfo *ata,
-                                SolAccountInfo *system_program);
+/// How UI_Distribute reads the values of the recipients
+typedef enum
+{
+    UD_Amounts,      // Token amounts
+    UD_Weights,      // Shares of the pool balance
+} UpalaDistribution;
+
+/// Roles of the instruction accounts, an instruction takes the accounts
+/// of its schema in the order of their roles
+typedef enum
+{
+    UA_Manager,         // Group manager, pays for the new accounts
+    UA_Pool,            // Token account of the group pool, the group id
+    UA_PoolsManager,    // Storage of the groups, authority of the pools
+    UA_Minter,
+    UA_SystemProgram,
+    UA_SysvarRent,
+    UA_SplToken,
+    UA_Group,           // Group account
+    UA_User,
+    UA_UserAt,          // Token account of the user
+    UA_Registry,        // Registry of the user keys
+    UA_Shard,           // Shard of a sharded storage, holding the group
+    UA_RolesCount
+} UpalaAccountRole;
+
+#define UA(role) (1u << (role))
+
+/// Accounts of an instruction: the ones it reads and the ones it writes
+typedef struct
+{
+    uint16_t  accounts;     // Roles of the instruction accounts
+    uint16_t  writable;     // Roles of the accounts written
+    uint16_t  optional;     // Trailing roles the instruction may go without
+    bool      indexed;      // More accounts follow, addressed by index in the payload
+    bool      query;        // Writes nothing, answers with the return data
+} UpalaAccountSchema;
+
+/// The accounts shared by the instructions: manager, storage and minter
+#define UA_SHARED (UA(UA_Manager) | UA(UA_PoolsManager) | UA(UA_Minter))
+
+/// Accounts the instructions create: the payer, the programs and the rent
+#define UA_PROVISION (UA(UA_SystemProgram) | UA(UA_SysvarRent) | UA(UA_SplToken))
+
+const static UpalaAccountSchema UPALA_SCHEMAS[] = {
+    [UI_CreatePool]   = {UA_SHARED | UA_PROVISION | UA(UA_Pool) | UA(UA_Group) | UA(UA_Shard),
+                         UA(UA_Manager) | UA(UA_Pool) | UA(UA_Group), UA(UA_Shard), false},
+    [UI_EmptyPool]    = {UA_SHARED | UA(UA_SplToken) | UA(UA_Pool) | UA(UA_Group) | UA(UA_UserAt) | UA(UA_Shard),
+                         UA(UA_Pool) | UA(UA_UserAt), UA(UA_Shard), false},
+    [UI_RemovePool]   = {UA_SHARED | UA(UA_SysvarRent) | UA(UA_Pool) | UA(UA_Group) | UA(UA_Shard),
+                         UA(UA_Manager) | UA(UA_Group), UA(UA_Shard), false},
+    [UI_AddUser]      = {UA_SHARED | UA_PROVISION | UA(UA_Group) | UA(UA_User) | UA(UA_UserAt) | UA(UA_Registry) |
+                         UA(UA_Shard),
+                         UA(UA_Manager) | UA(UA_Group) | UA(UA_UserAt) | UA(UA_Registry), UA(UA_Shard), false},
+    [UI_RemoveUser]   = {UA_SHARED | UA(UA_Group) | UA(UA_Registry) | UA(UA_Shard), UA(UA_Group), UA(UA_Shard), false},
+    [UI_SetScore]     = {UA_SHARED | UA(UA_Group) | UA(UA_Registry) | UA(UA_Shard), UA(UA_Group), UA(UA_Shard), false},
+    [UI_CleanStorage] = {UA_SHARED | UA(UA_SysvarRent) | UA(UA_Shard), UA(UA_Manager), UA(UA_Shard), false},
+    [UI_Migrate]      = {UA_SHARED | UA(UA_SystemProgram) | UA(UA_SysvarRent) | UA(UA_Group) | UA(UA_Registry),
+                         UA(UA_Manager) | UA(UA_PoolsManager) | UA(UA_Group) | UA(UA_Registry),
+                         UA(UA_Group) | UA(UA_Registry), false},
+    [UI_Batch]        = {UA_SHARED | UA_PROVISION | UA(UA_Registry) | UA(UA_Shard),
+                         UA(UA_Manager) | UA(UA_Registry), 0, true},
+    [UI_Distribute]   = {UA_SHARED | UA(UA_SplToken) | UA(UA_Pool) | UA(UA_Group) | UA(UA_Shard), UA(UA_Pool),
+                         UA(UA_Shard), true},
+    [UI_CreateShard]  = {UA_SHARED | UA(UA_SystemProgram) | UA(UA_SysvarRent) | UA(UA_Registry) | UA(UA_Shard),
+                         UA(UA_Manager) | UA(UA_PoolsManager) | UA(UA_Registry) | UA(UA_Shard), 0, false},
+    [UI_GetGroup]     = {UA(UA_Minter) | UA(UA_Group), 0, 0, false, true},
+    [UI_GetMember]    = {UA(UA_Minter) | UA(UA_Group) | UA(UA_Registry), 0, 0, false, true},
+    [UI_ListMembers]  = {UA(UA_Minter) | UA(UA_Group) | UA(UA_Registry), 0, 0, false, true},
+    [UI_SetRoot]      = {UA_SHARED | UA(UA_Group) | UA(UA_Shard), UA(UA_Group), UA(UA_Shard), false},
+    [UI_VerifyMember] = {UA(UA_Minter) | UA(UA_Group), 0, 0, false, true},
+    [UI_Deposit]      = {UA_SHARED | UA(UA_SplToken) | UA(UA_Pool) | UA(UA_Group) | UA(UA_UserAt),
+                         UA(UA_Pool) | UA(UA_Group) | UA(UA_UserAt), 0, false},
+    [UI_Claim]        = {UA_SHARED | UA(UA_SplToken) | UA(UA_Pool) | UA(UA_Group) | UA(UA_User) | UA(UA_UserAt) |
+                         UA(UA_Registry),
+                         UA(UA_Pool) | UA(UA_Group) | UA(UA_UserAt), 0, false},
+};
+
+/// Schema of the instruction, NULL for an unknown one
+static const UpalaAccountSchema *upala_schema(uint8_t instruction)
+{
+    return instruction < SOL_ARRAY_SIZE(UPALA_SCHEMAS) ? &UPALA_SCHEMAS[instruction] : NULL;
+}
+
+static uint64_t upala_schema_count(uint16_t roles)
+{
+    uint64_t count = 0;
+    for (; roles != 0; roles &= roles - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+static uint64_t transfer_lamports(SolAccountInfo *payer,
+                                  SolAccountInfo *recipient,
+                                  SolAccountInfo *system_program,
+                                  uint64_t        lamports);
+
+static uint64_t transfer_tokens(SolAccountInfo *source,
+                                SolAccountInfo *destination,
+                                SolAccountInfo *owner,
+                                SolAccountInfo *spl_token,
+                                uint64_t        amount);
+
+static uint64_t create_account(      SolAccountInfo *payer,
+                                     SolAccountInfo *account,
+                               const SolSignerSeed  *account_signer_seeds,
+                                     uint64_t        account_signer_seeds_len,
+                                     SolAccountInfo *system_program,
+                                     uint64_t        lamports,
+                                     uint64_t        space,
+                               const SolPubkey      *owner);
 
 static uint64_t allocate_space_for_ata(      SolAccountInfo *ata,
                                        const SolSignerSeed  *ata_signer_seeds,
@@ -226,7 +282,7 @@ static uint64_t assign_ata(      SolAccountInfo *ata,
                            const SolSignerSeed  *ata_signer_seeds,
                                  uint64_t        ata_signer_seeds_len,
                                  SolAccountInfo *system_program,
-                                 SolAccountInfo *spl_token);
+                           const SolPubkey      *owner);
 
 static uint64_t initialize_ata(      SolAccountInfo *ata,
                                      SolAccountInfo *minter,
@@ -252,471 +308,3149 @@ typedef struct
     uint8_t              bump_seed;
 } SolInnerAccount;
 
-typedef struct
-{
-    UpalaInstruction  *instriction;
-    uint64_t           data_len;
-    uint8_t           *data;
-} UpalaInstractionData;
+/// Seed prefix of the group accounts, keeps them apart from the
+/// associated token accounts derived from the same keys
+const static uint8_t UPALA_GROUP_SEED[] = {'g', 'r', 'o', 'u', 'p'};
 
-typedef struct
-{
-    SolPubkey  key;
-    uint64_t   score;
-} UpalaAccount;
+/// Number of members a new group account has room for
+const static uint32_t UPALA_GROUP_INITIAL_CAPACITY = 8;
+
+/// Seed prefix of the registry account
+const static uint8_t UPALA_REGISTRY_SEED[] = {'u', 's', 'e', 'r', 's'};
 
+/// Number of keys a new registry has room for
+const static uint32_t UPALA_REGISTRY_INITIAL_CAPACITY = 64;
+
+/// Number of groups a new pools_manager storage has room for
+const static uint32_t UPALA_STORAGE_INITIAL_CAPACITY = 8;
+
+/// Seed prefix of the shard accounts of a sharded storage
+const static uint8_t UPALA_SHARD_SEED[] = {'s', 'h', 'a', 'r', 'd'};
+
+/// Shard of an instruction that has neither a shard account nor a registry
+const static uint16_t UPALA_NO_SHARD = UINT16_MAX;
+
+/// Bytes of account metadata the rent is charged for besides the data
+const static uint64_t ACCOUNT_STORAGE_OVERHEAD = 128;
+
+/// Rent parameters of the cluster, as the rent sysvar holds them
 typedef struct
 {
-    SolPubkey     key;
-    SolPubkey     manager;
-    uint8_t       accounts_count;
-    UpalaAccount  accounts[10];
-} UpalaGroup;
+    uint64_t  lamports_per_byte_year;
+    uint64_t  exemption_threshold;      // Bits of an f64 count of years
+} UpalaRent;
 
-static bool upala_deserialize(const uint8_t *data, UpalaInstractionData *ui_data)
+/// Reads the rent parameters, fails unless the account is the rent sysvar
+static bool upala_rent_load(const SolAccountInfo *sysvar_rent, UpalaRent *rent)
 {
-    if (NULL == data || NULL == ui_data)
+    if (!SolPubkey_same(sysvar_rent->key, &rent_sysvar_id) ||
+        sysvar_rent->data_len < 2 * sizeof (uint64_t))
     {
         return false;
     }
+    sol_memcpy(rent, sysvar_rent->data, sizeof (UpalaRent));
 
-    ui_data->instriction = (UpalaInstruction*) data;
-    data += sizeof (uint8_t);
-
-    ui_data->data_len = *(uint64_t*) data;
-    data += sizeof (uint64_t);
+    // Neither infinity nor NaN, the exemption threshold is a number of years
+    return ((rent->exemption_threshold >> 52) & 0x7ff) != 0x7ff;
+}
 
-    if (*ui_data->instriction == UI_CreatePool)
+/// Rent-exempt minimum balance of an account, computed like the runtime
+/// does: (overhead + data) * lamports per byte-year * threshold, rounded
+/// down. The threshold is an f64, multiplied as its integer mantissa and
+/// exponent since the program has no floating point.
+static uint64_t rent_exempt_minimum(const UpalaRent *rent, uint64_t data_len)
+{
+    const uint64_t bits = rent->exemption_threshold;
+    const int64_t  exponent = (int64_t)((bits >> 52) & 0x7ff);
+    if ((bits >> 63) != 0 || exponent == 0)
     {
-        // NOP
+        return 0;   // Negative, zero or subnormal threshold
     }
-    else if (*ui_data->instriction == UI_EmptyPool)
+
+    const uint64_t mantissa = (bits & ((1ull << 52) - 1)) | (1ull << 52);
+    const int64_t  shift = exponent - 1075;
+    if (shift >= 0 || shift <= -128)
     {
-        // NOP
+        return shift >= 0 ? UINT64_MAX : 0;
     }
 
-
-    return true;
+    const __uint128_t lamports = (__uint128_t)((ACCOUNT_STORAGE_OVERHEAD + data_len) * rent->lamports_per_byte_year)
+                               * mantissa >> -shift;
+    return lamports > UINT64_MAX ? UINT64_MAX : (uint64_t) lamports;
 }
 
-
-static void upala_log_group(const uint8_t *_data, const SolPubkey *gid)
+/// Rank of the member at `pos` among the `ranked` first ranks
+static uint64_t upala_group_rank_of(UpalaGroupData *group, const uint32_t *ranks, uint64_t ranked, uint64_t pos)
 {
-    uint8_t *d = (uint8_t *)sol_calloc(MAX_PERMITTED_DATA_INCREASE, sizeof (uint8_t));
-    sol_memcpy(d, _data, MAX_PERMITTED_DATA_INCREASE);
-
-    const uint8_t groups_count = *(uint8_t*)d;
-    d += sizeof (uint8_t);
-
-    sol_log("Number of groups: ->");
-    sol_log_64(0,0,0,0, groups_count);
+    const UpalaMember *member = upala_group_member(group, pos);
+    return upala_group_rank_search(group, ranks, ranked, member->score, member->user);
+}
 
-    bool finded_ug = false;
-    UpalaGroup *ug = NULL;
-    for (size_t i = 0; i < groups_count; i++)
+/// Ranks the member at `pos` among the `ranked` first ranks
+static void upala_group_rank_insert(UpalaGroupData *group, uint32_t *ranks, uint64_t ranked, uint64_t pos)
+{
+    const UpalaMember *member = upala_group_member(group, pos);
+    const uint64_t r = upala_group_rank_search(group, ranks, ranked, member->score, member->user);
+    for (uint64_t i = ranked; i > r; i--)
     {
-        ug = (UpalaGroup *) d;
-        if (SolPubkey_same(&ug->key, gid))
-        {
-            finded_ug = true;
-            break;
-        }
-        d += sizeof (UpalaGroup);
+        ranks[i] = ranks[i - 1];
     }
+    ranks[r] = (uint32_t) pos;
+}
 
-    if (finded_ug)
+/// Drops the rank `r` of the `ranked` ranks
+static void upala_group_rank_erase(uint32_t *ranks, uint64_t ranked, uint64_t r)
+{
+    for (uint64_t i = r; i + 1 < ranked; i++)
     {
-        sol_log("Group id: ->");
-        sol_log_pubkey(&ug->key);
-        sol_log("Group manager id: ->");
-        sol_log_pubkey(&ug->manager);
-        sol_log("Num of accounts: ->");
-        sol_log_64(0,0,0,0, ug->accounts_count);
-        // -----------------------------------
-
-        sol_log("#Users");
-        for (size_t j = 0; j < ug->accounts_count; j++)
-        {
-            UpalaAccount uas = ug->accounts[j];
-            sol_log("User id: ->");
-            sol_log_pubkey(&uas.key);
-            sol_log("The score of user: ->");
-            sol_log_64(0,0,0,0, uas.score);
-        }
+        ranks[i] = ranks[i + 1];
     }
+    ranks[ranked - 1] = 0;
 }
 
-uint64_t processing(SolParameters *params)
+/// Counts a score in the aggregates of a group holding `members` members,
+/// the callers check that the sum does not overflow
+static void upala_stats_add(UpalaScoreStats *stats, uint64_t members, uint64_t score)
 {
-    if (params->ka_num < 7)
+    stats->sum += score;
+    if (members == 0)
     {
-        sol_log("Greeted account not included in the instruction");
-        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+        stats->min = stats->max = score;
+        stats->min_count = stats->max_count = 1;
+        return;
     }
 
-    // Get accounts
-    SolAccountInfo *manager_account             = &params->ka[0];
-    SolAccountInfo *pool_at_account             = &params->ka[1];
-    SolAccountInfo *pools_manager_account       = &params->ka[2];
-
-    SolAccountInfo *minter_account              = &params->ka[3];
-    SolAccountInfo *upala_account               = &params->ka[4];
-    SolAccountInfo *system_program_account      = &params->ka[5];
-    SolAccountInfo *sysvar_rent_account         = &params->ka[6];
-    SolAccountInfo *spl_token_account           = &params->ka[7];
-
-    SolAccountInfo *user_account                = &params->ka[8];
-    SolAccountInfo *user_at_account             = &params->ka[9];
+    if (score < stats->min)
+    {
+        stats->min = score;
+        stats->min_count = 1;
+    }
+    else if (score == stats->min)
+    {
+        stats->min_count += 1;
+    }
 
-    // The account must be owned by the program in order to modify its data
-    if (!SolPubkey_same(manager_account->owner, system_program_account->key))
+    if (score > stats->max)
     {
-        return ERROR_INCORRECT_PROGRAM_ID;
+        stats->max = score;
+        stats->max_count = 1;
+    }
+    else if (score == stats->max)
+    {
+        stats->max_count += 1;
     }
+}
 
-    if (params->data_len == 0)
+/// Sets the lowest and the highest score from the members: the ends of
+/// the ranks, or a scan of the group without UG_ScoreIndex
+static void upala_group_stats_bounds(UpalaGroupData *group)
+{
+    UpalaScoreStats *stats = &group->stats;
+    const uint64_t count = group->accounts_count;
+    stats->min = stats->max = 0;
+    stats->min_count = stats->max_count = 0;
+    if (count == 0)
     {
-        return ERROR_INVALID_INSTRUCTION_DATA;
+        return;
     }
 
-    SolInnerAccount *ata = (SolInnerAccount *) sol_calloc(1, sizeof (SolInnerAccount));
+    const uint32_t *ranks = upala_group_ranks(group);
+    if (ranks)
     {
-        const uint64_t ata_seeds_count  = 4;
-        SolSignerSeed* ata_seeds        = (SolSignerSeed*)sol_calloc(ata_seeds_count, sizeof (SolSignerSeed));
+        stats->min = upala_group_member(group, ranks[0])->score;
+        stats->max = upala_group_member(group, ranks[count - 1])->score;
+        stats->min_count = (uint32_t)(stats->min == stats->max ? count
+                         : upala_group_rank_search(group, ranks, count, stats->min + 1, 0));
+        stats->max_count = (uint32_t)(count - upala_group_rank_search(group, ranks, count, stats->max, 0));
+        return;
+    }
 
-        ata_seeds[0] = (SolSignerSeed){manager_account->key->x, SIZE_PUBKEY};
-        ata_seeds[1] = (SolSignerSeed){minter_account->key->x, SIZE_PUBKEY};
-        ata_seeds[2] = (SolSignerSeed){upala_account->key->x, SIZE_PUBKEY};
-        ata_seeds[3] = (SolSignerSeed){0, 0};
+    const uint64_t sum = stats->sum;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        upala_stats_add(stats, i, upala_group_member(group, i)->score);
+    }
+    stats->sum = sum;
+}
 
-        sol_try_find_program_address(ata_seeds, (ata_seeds_count - 1),
-                                     upala_account->key,
-                                     &ata->key, &ata->bump_seed);
-        sol_log("Finded associated token account id:");
-        sol_log_pubkey(&ata->key);
+/// Takes a score out of the bounds of the aggregates, they are searched
+/// again only when the last member holding the lowest or the highest
+/// score is gone
+static void upala_group_stats_drop(UpalaGroupData *group, uint64_t score)
+{
+    UpalaScoreStats *stats = &group->stats;
+    bool bounds = group->accounts_count == 0;
+    if (score == stats->min)
+    {
+        bounds |= --stats->min_count == 0;
+    }
+    if (score == stats->max)
+    {
+        bounds |= --stats->max_count == 0;
+    }
+    if (bounds)
+    {
+        upala_group_stats_bounds(group);
+    }
+}
 
-        if (!SolPubkey_same(pool_at_account->key, &ata->key))
+/// Counts the aggregates of the members from scratch, fails when the sum
+/// of the scores overflows
+static bool upala_group_stats_count(UpalaGroupData *group)
+{
+    sol_memset(&group->stats, 0, sizeof (UpalaScoreStats));
+    for (uint64_t i = 0; i < group->accounts_count; i++)
+    {
+        const uint64_t score = upala_group_member(group, i)->score;
+        if (group->stats.sum + score < group->stats.sum)
         {
-            sol_log("Error: Associated address does not match seed derivation");
-            return INVALID_SEEDS;
+            return false;
         }
-
-        ata_seeds[ata_seeds_count - 1] = (SolSignerSeed){&ata->bump_seed, 1};
-        ata->seed     = (const SolSignerSeed*)ata_seeds;
-        ata->seed_len = ata_seeds_count;
+        upala_stats_add(&group->stats, i, score);
     }
+    return true;
+}
 
-    SolInnerAccount *pta = (SolInnerAccount *) sol_calloc(1, sizeof (SolInnerAccount));
+/// Spreads `amount` tokens over the `sum` of the scores, each unit of
+/// score is owed amount / sum tokens more: the rounding stays unspread.
+/// Fails without a score to spread them over
+static bool upala_rewards_spread(UpalaRewards *rewards, uint64_t amount, uint64_t sum)
+{
+    if (sum == 0)
     {
-        const uint64_t pta_seeds_count  = 3;
-        SolSignerSeed* pta_seeds        = (SolSignerSeed*)sol_calloc(pta_seeds_count, sizeof (SolSignerSeed));
+        return false;
+    }
+    const __uint128_t step = ((__uint128_t) amount << 64) / sum;
+    const __uint128_t per_score = (((__uint128_t) rewards->per_score[1] << 64) | rewards->per_score[0]) + step;
+    rewards->per_score[0] = (uint64_t) per_score;
+    rewards->per_score[1] = (uint64_t)(per_score >> 64);
+    return true;
+}
 
-        pta_seeds[0] = (SolSignerSeed){minter_account->key->x, SIZE_PUBKEY};
-        pta_seeds[1] = (SolSignerSeed){upala_account->key->x, SIZE_PUBKEY};
-        pta_seeds[2] = (SolSignerSeed){0, 0};
+/// Sets the bits of the user in the member filter
+static void upala_group_filter_add(UpalaGroupData *group, uint32_t user)
+{
+    uint8_t *filter = upala_group_filter(group);
+    if (!filter)
+    {
+        return;
+    }
+    const uint64_t bits = upala_group_capacity(group) * 8;
+    for (uint64_t probe = 0; probe < UPALA_FILTER_PROBES; probe++)
+    {
+        const uint64_t bit = upala_filter_bit(user, probe, bits);
+        filter[bit / 8] |= (uint8_t)(1u << (bit % 8));
+    }
+}
 
-        sol_try_find_program_address(pta_seeds, (pta_seeds_count - 1),
-                                     upala_account->key,
-                                     &pta->key, &pta->bump_seed);
-        sol_log("Finded associated token account id:");
-        sol_log_pubkey(&pta->key);
+/// Sets the member filter from the members. The removed members keep
+/// their bits until then, the filter only lets more users through
+static void upala_group_filter_build(UpalaGroupData *group)
+{
+    uint8_t *filter = upala_group_filter(group);
+    if (!filter)
+    {
+        return;
+    }
+    sol_memset(filter, 0, upala_group_capacity(group));
+    for (uint64_t i = 0; i < group->accounts_count; i++)
+    {
+        upala_group_filter_add(group, upala_group_member(group, i)->user);
+    }
+}
 
-        if (!SolPubkey_same(pools_manager_account->key, &pta->key))
+/// Orders of the items sorted by upala_sort_items()
+typedef enum
+{
+    UO_Key,     // UpalaAccount records by key
+    UO_User,    // UpalaMember records by user index
+    UO_Rank,    // UpalaMember records by score then by user index
+    UO_Index,   // u32 values
+} UpalaOrder;
+
+/// Whether the item `a` of `base` comes before the item `b` in the order
+static bool upala_item_before(const void *base, uint32_t a, uint32_t b, UpalaOrder order)
+{
+    const UpalaMember *members = (const UpalaMember *) base;
+    switch (order)
+    {
+    case UO_Key:
+        return upala_pubkey_cmp(&((const UpalaAccount *) base)[a].key, &((const UpalaAccount *) base)[b].key) < 0;
+    case UO_Rank:
+        if (members[a].score != members[b].score)
         {
-            sol_log("Error: Associated address does not match seed derivation");
-            return INVALID_SEEDS;
+            return members[a].score < members[b].score;
         }
+        return members[a].user < members[b].user;
+    case UO_User:
+        return members[a].user < members[b].user;
+    default:
+        return ((const uint32_t *) base)[a] < ((const uint32_t *) base)[b];
+    }
+}
 
-        pta_seeds[pta_seeds_count - 1] = (SolSignerSeed){&pta->bump_seed, 1};
-        pta->seed     = (const SolSignerSeed*)pta_seeds;
-        pta->seed_len = pta_seeds_count;
-
-        //init pools_manager_account
-        if (!SolPubkey_same(pools_manager_account->owner, params->program_id))
+/// Heap sort of the `count` items, indexes of the records of `base`
+static void upala_sort_items(const void *base, uint32_t *items, uint64_t count, UpalaOrder order)
+{
+    uint64_t start = count / 2;
+    uint64_t end = count;
+    while (end > 1)
+    {
+        if (start > 0)
         {
-            transfer_to_ata(manager_account, pools_manager_account, system_program_account);
-            allocate_space_for_ata(pools_manager_account, pta->seed, pta->seed_len, system_program_account, MAX_PERMITTED_DATA_INCREASE);
-            assign_ata(pools_manager_account, pta->seed, pta->seed_len, system_program_account, upala_account);
+            start--;
+        }
+        else
+        {
+            end--;
+            const uint32_t top = items[0];
+            items[0] = items[end];
+            items[end] = top;
+        }
 
-//            sol_memset(storage, 0, MAX_PERMITTED_DATA_INCREASE);
+        uint64_t root = start;
+        for (uint64_t child = 2 * root + 1; child < end; child = 2 * root + 1)
+        {
+            if (child + 1 < end && upala_item_before(base, items[child], items[child + 1], order))
+            {
+                child++;
+            }
+            if (!upala_item_before(base, items[root], items[child], order))
+            {
+                break;
+            }
+            const uint32_t item = items[root];
+            items[root] = items[child];
+            items[child] = item;
+            root = child;
         }
     }
+}
 
-    uint8_t * storage = pools_manager_account->data;
-
-    const uint8_t upala_instriction_ptr = *(uint8_t *)params->data; params->data += sizeof (uint8_t);
-    UpalaInstruction upala_instriction = (UpalaInstruction)upala_instriction_ptr;
+/// Sets the ranks of the members from scratch
+static void upala_group_rank_all(UpalaGroupData *group)
+{
+    uint32_t *ranks = upala_group_ranks(group);
+    if (!ranks)
+    {
+        return;
+    }
+    for (uint64_t r = 0; r < group->accounts_count; r++)
+    {
+        ranks[r] = (uint32_t) r;
+    }
+    upala_sort_items(group->members, ranks, group->accounts_count, UO_Rank);
+}
 
-    sol_log_64(0,0,0,upala_instriction_ptr,upala_instriction);
-    if (upala_instriction == UI_CreatePool)
+/// Merges `count` new members into the members sorted by user index
+///
+/// `entries` are the uid | score records of the payload, `users` the
+/// registry indexes of their uids. They are sorted, checked against the
+/// members and merged in one pass from the end of the group, the ranks
+/// of the new members likewise. The room is made by upala_group_reserve().
+/// With UG_Rewards the checkpoints move with the records, a new member
+/// is owed nothing of the deposits made before it joined. Fails without
+/// changing the group when a user is a member or given twice, or when the
+/// sum of the scores would overflow.
+static uint64_t upala_group_merge(UpalaGroupData *group, const uint8_t *entries, const uint32_t *users, uint8_t count)
+{
+    const UpalaAccount *fresh = (const UpalaAccount *) entries;
+    uint32_t order[UINT8_MAX];
+    uint64_t sum = group->stats.sum;
+    for (uint32_t j = 0; j < count; j++)
     {
-        sol_log("Called the instruction UI_CreatePool");
-        uint64_t return_value = SUCCESS;
-        if (!SolPubkey_same(pool_at_account->owner, spl_token_account->key))
+        if (sum + fresh[j].score < sum)
         {
-            //init associated_token_account
-            return_value = transfer_to_ata(manager_account, pool_at_account, system_program_account);
-            return_value = allocate_space_for_ata(pool_at_account, ata->seed, ata->seed_len, system_program_account, SPL_TOKEN_ACCOUNT_DATA_LEN);
-            return_value = assign_ata(pool_at_account, ata->seed, ata->seed_len, system_program_account, spl_token_account);
-            return_value = initialize_ata(pool_at_account, minter_account, pools_manager_account, sysvar_rent_account, spl_token_account);
-
-            uint8_t groups_count = *(uint8_t*)storage;
-            groups_count += 1;
-            sol_memcpy(storage, &groups_count, sizeof(uint8_t));
-
-            UpalaGroup ug;
-            ug.key = *pool_at_account->key;
-            ug.manager = *manager_account->key;
-            ug.accounts_count = 0;
-            sol_memcpy(storage + sizeof(uint8_t) + sizeof(SolPubkey) * (groups_count-1),
-                       &ug, sizeof(UpalaGroup));
-            sol_log("Group created");
+            sol_log("Error: The scores of the group overflow");
+            return ERROR_INVALID_ARGUMENT;
         }
-        else sol_log("The group exists");
-
-        upala_log_group(storage, pool_at_account->key);
-
-        return return_value;
+        sum += fresh[j].score;
+        order[j] = j;
     }
-    else if (upala_instriction == UI_EmptyPool)
-    {   sol_log("Called the instruction UI_EmptyPool");
+    upala_sort_items(users, order, count, UO_Index);
 
-        /*SolInnerAccount *dta = (SolInnerAccount *) sol_calloc(1, sizeof (SolInnerAccount));
+    // The filter spares the search of nearly every new member
+    for (uint64_t j = 0; j < count; j++)
+    {
+        const uint32_t user = users[order[j]];
+        uint64_t pos;
+        if ((j > 0 && users[order[j - 1]] == user) ||
+            (upala_group_may_hold(group, user) && upala_group_search(group, user, &pos)))
         {
-            const uint64_t dta_seeds_count  = 4;
-            SolSignerSeed* dta_seeds        = (SolSignerSeed*)sol_calloc(dta_seeds_count, sizeof (SolSignerSeed));
-
-            dta_seeds[0] = (SolSignerSeed){u_account->key->x, SIZE_PUBKEY};
-            dta_seeds[1] = (SolSignerSeed){minter_account->key->x, SIZE_PUBKEY};
-            dta_seeds[2] = (SolSignerSeed){upala_account->key->x, SIZE_PUBKEY};
-            dta_seeds[3] = (SolSignerSeed){0, 0};
-
-            sol_try_find_program_address(dta_seeds, (dta_seeds_count - 1),
-                                         upala_account->key,
-                                         &dta->key, &dta->bump_seed);
-            sol_log("Finded associated token account id:");
-            sol_log_pubkey(&dta->key);
+            sol_log("Error: The user is already a member of the group");
+            return ERROR_INVALID_ARGUMENT;
+        }
+    }
 
-            if (!SolPubkey_same(user_account->key, &dta->key))
+    const uint64_t members = group->accounts_count;
+    const uint64_t total = members + count;
+    if (!upala_layout_use(&group->layout, upala_group_used(group, total)))
+    {
+        return ERROR_ACCOUNT_DATA_TOO_SMALL;
+    }
+    group->accounts_count = (uint32_t) total;
+    UpalaMember *records = upala_group_member(group, 0);
+    const UpalaRewards *rewards = upala_group_rewards(group);
+    uint64_t *checkpoints = upala_group_checkpoints(group);
+
+    // The new members take the places from the end, `order` keeps their
+    // positions in the group
+    uint64_t i = members;
+    for (uint64_t j = count; j > 0;)
+    {
+        const uint32_t user = users[order[j - 1]];
+        if (i > 0 && records[i - 1].user > user)
+        {
+            records[i + j - 1] = records[i - 1];
+            if (checkpoints)
             {
-                sol_log("Error: Associated address does not match seed derivation");
-                return INVALID_SEEDS;
+                checkpoints[i + j - 1] = checkpoints[i - 1];
             }
+            i--;
+            continue;
+        }
+        const uint64_t score = fresh[order[j - 1]].score;
+        records[i + j - 1] = (UpalaMember){user, 0, score};
+        if (checkpoints)
+        {
+            checkpoints[i + j - 1] = upala_rewards_accrued(rewards, score);
+        }
+        upala_stats_add(&group->stats, members + count - j, score);
+        upala_group_filter_add(group, user);
+        order[j - 1] = (uint32_t)(i + j - 1);
+        j--;
+    }
 
-            dta_seeds[dta_seeds_count - 1] = (SolSignerSeed){&dta->bump_seed, 1};
-            dta->seed     = (const SolSignerSeed*)dta_seeds;
-            dta->seed_len = dta_seeds_count;
-        }*/
-
-        sol_log("User SPL account");
-        SplAccount user_spl_info;
-        spl_deserialize(user_at_account->data, &user_spl_info);
-        spl_log_account(&user_spl_info);
-
-        sol_log("Pool SPL account");
-        SplAccount pool_spl_info;
-        spl_deserialize(pool_at_account->data, &pool_spl_info);
-        spl_log_account(&pool_spl_info);
-
-        /// 0. `[writable]` The source account.
-        /// 1. `[writable]` The destination account.
-        /// 2. `[signer]` The source account's owner/delegate.
-        SolAccountMeta arguments[] = {
-            {.pubkey = pool_at_account->key,          .is_writable = true,  .is_signer = false},
-            {.pubkey = user_at_account->key,          .is_writable = true,  .is_signer = false},
-            {.pubkey = pools_manager_account->key,    .is_writable = false, .is_signer = true},
-        };
-
-        uint8_t cmd = TI_TRANSFER;
-        uint64_t amount = (uint64_t)(pool_spl_info.amount);
+    uint32_t *ranks = upala_group_ranks(group);
+    if (!ranks)
+    {
+        return SUCCESS;
+    }
 
-        uint8_t data[sizeof (cmd) + sizeof(amount)];
-        sol_memcpy(data, &cmd, sizeof(cmd));
-        sol_memcpy(data + sizeof(cmd), &amount, sizeof(amount));
-#ifdef DEBUG_INSTRUCTION_DATA
-        sol_log_array(data, SOL_ARRAY_SIZE(data));
-#endif
+    // A member moved up by the new members merged before it: the new
+    // member j went before the old position p when order[j] - j <= p
+    for (uint64_t r = 0; r < members; r++)
+    {
+        uint64_t lo = 0;
+        uint64_t hi = count;
+        while (lo < hi)
+        {
+            const uint64_t mid = (lo + hi) / 2;
+            if (order[mid] - mid <= ranks[r]) lo = mid + 1;
+            else hi = mid;
+        }
+        ranks[r] += (uint32_t) lo;
+    }
 
-        const SolInstruction instruction = {
-            spl_token_account->key,
-            arguments, SOL_ARRAY_SIZE(arguments),
-            data, SOL_ARRAY_SIZE(data)
-        };
+    upala_sort_items(records, order, count, UO_Rank);
+    i = members;
+    for (uint64_t j = count; j > 0;)
+    {
+        if (i > 0 && upala_item_before(records, order[j - 1], ranks[i - 1], UO_Rank))
+        {
+            ranks[i + j - 1] = ranks[i - 1];
+            i--;
+        }
+        else
+        {
+            ranks[i + j - 1] = order[j - 1];
+            j--;
+        }
+    }
+    return SUCCESS;
+}
 
-        const SolAccountInfo account_infos[] = {
-            *pool_at_account,
-            *user_at_account,
-            *pools_manager_account,
-            *spl_token_account,
-        };
+/// Changes the score of the member at `i`, fails when the sum of the
+/// scores would overflow. The member is still owed what it was owed, its
+/// new score counts from the next deposit
+static bool upala_group_set_score(UpalaGroupData *group, uint64_t i, uint64_t score)
+{
+    UpalaMember *member = upala_group_member(group, i);
+    const uint64_t old = member->score;
+    const uint64_t sum = group->stats.sum - old;
+    if (sum + score < sum)
+    {
+        return false;
+    }
 
-        const SolSignerSeeds signers_seeds[] = { {pta->seed, pta->seed_len} };
+    uint64_t *checkpoints = upala_group_checkpoints(group);
+    if (checkpoints)
+    {
+        const uint64_t pending = upala_group_pending(group, i);
+        checkpoints[i] = upala_rewards_accrued(upala_group_rewards(group), score) - pending;
+    }
 
-        return sol_invoke_signed(&instruction,
-                                 account_infos, SOL_ARRAY_SIZE(account_infos),
-                                 signers_seeds, SOL_ARRAY_SIZE(signers_seeds));
+    const uint64_t count = group->accounts_count;
+    uint32_t *ranks = upala_group_ranks(group);
+    if (ranks)
+    {
+        upala_group_rank_erase(ranks, count, upala_group_rank_of(group, ranks, count, i));
     }
-    else if (upala_instriction == UI_AddUser)
+    member->score = score;
+    if (ranks)
     {
-        /*{
-            uint8_t *data_ptr = (uint8_t *)sol_calloc(MAX_PERMITTED_DATA_INCREASE, sizeof (uint8_t));
-            sol_memcpy(data_ptr, storage, MAX_PERMITTED_DATA_INCREASE);
+        upala_group_rank_insert(group, ranks, count - 1, i);
+    }
 
-            uint8_t groups_count = *(uint8_t*)data_ptr;
-            data_ptr += sizeof (uint8_t);
-            sol_log("=== Groups in data ===");
-            sol_log_64(0,0,0,0,groups_count);
+    group->stats.sum = sum;
+    upala_stats_add(&group->stats, count, score);
+    upala_group_stats_drop(group, old);
+    return true;
+}
 
-            for (size_t i = 0; i < groups_count; i++)
-            {
-                UpalaGroup *ug = (UpalaGroup *) data_ptr;
-                sol_log("Group id: ->");
-                sol_log_pubkey(&ug->key);
-                sol_log("Group manager id: ->");
-                sol_log_pubkey(&ug->manager);
-                sol_log("Num of accounts: ->");
-                sol_log_64(0,0,0,0, ug->accounts_count);
-                data_ptr += sizeof (UpalaGroup);
-                sol_log("*-*-*-*-*-*");
-            }
-        }*/
+/// Removes the member at `i`, the members past it move down a place.
+/// The member filter keeps its bits until upala_group_filter_build(), the
+/// member was paid its rewards before, see upala_remove_user()
+///
+/// The removal is O(n) on purpose: the members stay sorted by user index,
+/// which the binary search of every other instruction, the one-pass merge
+/// of UI_AddUser and the positions held by the ranks rely on. A swap with
+/// the last member would save the move but cost a sort or a scan to find
+/// the members again. The records move a whole member at a time.
+static void upala_group_remove(UpalaGroupData *group, uint64_t i)
+{
+    const uint64_t last = group->accounts_count - 1;
+    UpalaMember *last_member = upala_group_member(group, last);
+    const uint64_t score = upala_group_member(group, i)->score;
 
-        if (!SolPubkey_same(user_at_account->owner, spl_token_account->key))
+    uint64_t *checkpoints = upala_group_checkpoints(group);
+    if (checkpoints)
+    {
+        for (uint64_t k = i; k < last; k++)
         {
-            SolInnerAccount *user_ata = (SolInnerAccount *) sol_calloc(1, sizeof (SolInnerAccount));
-            {
-                const uint64_t uset_ata_seeds_count  = 4;
-                SolSignerSeed* uset_ata_seeds        = (SolSignerSeed*)sol_calloc(uset_ata_seeds_count, sizeof (SolSignerSeed));
-
-                uset_ata_seeds[0] = (SolSignerSeed){user_account->key->x, SIZE_PUBKEY};
-                uset_ata_seeds[1] = (SolSignerSeed){minter_account->key->x, SIZE_PUBKEY};
-                uset_ata_seeds[2] = (SolSignerSeed){upala_account->key->x, SIZE_PUBKEY};
-                uset_ata_seeds[3] = (SolSignerSeed){0, 0};
-
-                sol_try_find_program_address(uset_ata_seeds, (uset_ata_seeds_count - 1),
-                                             upala_account->key,
-                                             &user_ata->key, &user_ata->bump_seed);
-                sol_log("Finded associated token account id:");
-                sol_log_pubkey(&user_ata->key);
-
-                if (!SolPubkey_same(user_at_account->key, &user_ata->key))
-                {
-                    sol_log("Error: Associated address does not match seed derivation");
-                    return INVALID_SEEDS;
-                }
-
-                uset_ata_seeds[uset_ata_seeds_count - 1] = (SolSignerSeed){&user_ata->bump_seed, 1};
-                user_ata->seed     = (const SolSignerSeed*)uset_ata_seeds;
-                user_ata->seed_len = uset_ata_seeds_count;
-            }
-
-            //init associated_token_account for new user
-            transfer_to_ata(manager_account, user_at_account, system_program_account);
-            allocate_space_for_ata(user_at_account, user_ata->seed, user_ata->seed_len, system_program_account, SPL_TOKEN_ACCOUNT_DATA_LEN);
-            assign_ata(user_at_account, user_ata->seed, user_ata->seed_len, system_program_account, spl_token_account);
-            initialize_ata(user_at_account, minter_account, user_account, sysvar_rent_account, spl_token_account);
-
-            sol_log("Create associated_token_account for new user");
+            checkpoints[k] = checkpoints[k + 1];
         }
+        checkpoints[last] = 0;
+    }
 
-//        SplAccount spl_info;
-//        spl_deserialize(pool_at_account->data, &spl_info);
-//        spl_log_account(&spl_info);
-
-        const SolPubkey *gid = (SolPubkey *)params->data;
-        params->data += SIZE_PUBKEY;
-
-        const uint8_t uids_count = *(uint8_t *)params->data;
-        params->data += sizeof (uint8_t);
-
-        /*sol_log("=== From client: === ");
-        sol_log("....GID:");
-        sol_log_pubkey(gid);
-        sol_log("....UIDS_COUNT:");
-        sol_log_64(0,0,0,0,uids_count);*/
-
-        uint8_t groups_count = *(uint8_t*)storage;
-        storage += sizeof (uint8_t);
-
-        bool finded_ug = false;
-        UpalaGroup *ug = NULL;
-        for (size_t i = 0; i < groups_count; i++)
+    uint32_t *ranks = upala_group_ranks(group);
+    if (ranks)
+    {
+        upala_group_rank_erase(ranks, last + 1, upala_group_rank_of(group, ranks, last + 1, i));
+        for (uint64_t r = 0; r < last; r++)
         {
-            ug = (UpalaGroup *) storage;
-            if (SolPubkey_same(&ug->key, gid))
+            if (ranks[r] > i)
             {
-                finded_ug = true;
-                break;
+                ranks[r] -= 1;
             }
-            storage += sizeof (UpalaGroup);
         }
+    }
 
-        if (finded_ug)
-        {
-            sol_log("Group id: ->");
-            sol_log_pubkey(&ug->key);
-            sol_log("Group manager id: ->");
-            sol_log_pubkey(&ug->manager);
-            sol_log("Num of accounts: ->");
-            sol_log_64(0,0,0,0, ug->accounts_count);
-            // -----------------------------------
-
-            sol_log("Adding account");
-
-            for (size_t i = 0; i < uids_count; i++)
-            {
-                SolPubkey uid = *(SolPubkey *) params->data;
-                params->data += SIZE_PUBKEY;
-                sol_log("New user id: ->");
-                sol_log_pubkey(&uid);
-
-                uint64_t score = *(uint64_t *) params->data;
-                params->data += sizeof (uint64_t);
-                sol_log("The score of the new user: ->");
-                sol_log_64(0,0,0,0, score);
-
-                UpalaAccount *uas = (UpalaAccount *)ug->accounts;
-                uas[ug->accounts_count++] = (UpalaAccount){uid, score};
-            }
+    UpalaMember *records = upala_group_member(group, 0);
+    for (uint64_t k = i; k < last; k++)
+    {
+        records[k] = records[k + 1];
+    }
+    sol_memset(last_member, 0, sizeof (UpalaMember));
+    group->accounts_count = (uint32_t) last;
+    upala_layout_use(&group->layout, upala_group_used(group, last));
 
-            // -----------------------------------
+    group->stats.sum -= score;
+    upala_group_stats_drop(group, score);
+}
 
-            sol_log("=== All users ===");
-            for (size_t j = 0; j < ug->accounts_count && j < 10; j++)
-            {
-                UpalaAccount uas = ug->accounts[j];
-                sol_log("...User id: ->");
-                sol_log_pubkey(&uas.key);
-                sol_log("...The score of user: ->");
-                sol_log_64(0,0,0,0, uas.score);
-            }
-        }
+/// Changes the data length of an account owned by the program
+///
+/// The runtime reads the length back from the serialized input, where it
+/// precedes the account data, and lets the data grow by at most
+/// MAX_PERMITTED_DATA_INCREASE bytes per instruction.
+static void resize_account(SolAccountInfo *account, uint64_t new_len)
+{
+    if (new_len > account->data_len)
+    {
+        sol_memset(account->data + account->data_len, 0, new_len - account->data_len);
     }
-    else if (upala_instriction == UI_CleanStorage)
+    *(uint64_t *)(account->data - sizeof (uint64_t)) = new_len;
+    account->data_len = new_len;
+}
+
+/// Grows the account owned by the program to `new_len` bytes, the payer
+/// tops up its rent
+static uint64_t upala_account_grow(SolAccountInfo  *account,
+                                   SolAccountInfo  *payer,
+                                   SolAccountInfo  *system_program,
+                                   const UpalaRent *rent,
+                                   uint64_t         new_len)
+{
+    const uint64_t minimum = rent_exempt_minimum(rent, new_len);
+    if (*account->lamports < minimum)
     {
-        sol_memset(storage, 0, MAX_PERMITTED_DATA_INCREASE);
+        const uint64_t err = transfer_lamports(payer, account, system_program,
+                                               minimum - *account->lamports);
+        if (err != SUCCESS)
+        {
+            return err;
+        }
     }
 
+    resize_account(account, new_len);
     return SUCCESS;
 }
 
-static uint64_t transfer_to_ata(SolAccountInfo *payer,
-                                SolAccountInfo *ata,
-                                SolAccountInfo *system_program)
+/// Makes room for `required` members in the group account, the payer
+/// tops up the rent of the grown account. `base_len` is the length of the
+/// account at the start of the instruction, the base of its data growth
+static uint64_t upala_group_reserve(SolAccountInfo  *group_account,
+                                    UpalaGroupData  *group,
+                                    SolAccountInfo  *payer,
+                                    SolAccountInfo  *system_program,
+                                    const UpalaRent *rent,
+                                    uint64_t         base_len,
+                                    uint64_t         required)
 {
-    sol_log("Transfer 2039280 lamports to the new associated token account:");
+    const uint64_t capacity = upala_group_capacity(group);
+    if (required <= capacity)
+    {
+        return SUCCESS;
+    }
 
-    const uint64_t required_lamports = 2039280;
+    uint64_t new_capacity = capacity * 2;
+    if (new_capacity < required)
+    {
+        new_capacity = required;
+    }
 
+    uint64_t new_len = upala_group_data_len(new_capacity, group->flags);
+    if (new_len > base_len + MAX_PERMITTED_DATA_INCREASE)
+    {
+        new_len = upala_group_data_len(required, group->flags);
+        if (new_len > base_len + MAX_PERMITTED_DATA_INCREASE)
+        {
+            sol_log("Error: Too many members added at once");
+            return ERROR_INVALID_ARGUMENT;
+        }
+    }
+
+    const uint64_t err = upala_account_grow(group_account, payer, system_program, rent, new_len);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    // The rewards with the checkpoints, then the ranks, follow the room of
+    // the member records, they move up with it, the last one first. The
+    // member filter grows with the room, it is set again
+    const uint64_t rewards = upala_group_rewards_offset(group);
+    const uint64_t ranks = upala_group_ranks_offset(group);
+    group->layout.capacity = (uint32_t) new_len;
+    const uint64_t rewards_len = (group->flags & UG_Rewards)
+                               ? sizeof (UpalaRewards) + group->accounts_count * sizeof (uint64_t) : 0;
+    const uint64_t ranks_len = (group->flags & UG_ScoreIndex) ? group->accounts_count * sizeof (uint32_t) : 0;
+    upala_layout_move(group_account->data, ranks, upala_group_ranks_offset(group), ranks_len);
+    upala_layout_move(group_account->data, rewards, upala_group_rewards_offset(group), rewards_len);
+    const uint64_t records_end = sizeof (UpalaGroupData) + group->accounts_count * sizeof (UpalaMember);
+    const uint64_t rewards_end = upala_group_rewards_offset(group) + rewards_len;
+    const uint64_t ranks_end = upala_group_ranks_offset(group) + ranks_len;
+    sol_memset(group_account->data + records_end, 0, upala_group_rewards_offset(group) - records_end);
+    sol_memset(group_account->data + rewards_end, 0, upala_group_ranks_offset(group) - rewards_end);
+    sol_memset(group_account->data + ranks_end, 0, new_len - ranks_end);
+    upala_layout_use(&group->layout, upala_group_used(group, group->accounts_count));
+    upala_group_filter_build(group);
+    return SUCCESS;
+}
+
+/// Writes an empty storage of the current layout, cleaned by `authority`
+static void upala_storage_init(SolAccountInfo *account, uint8_t bump_seed, const SolPubkey *authority)
+{
+    sol_memset(account->data, 0, account->data_len);
+    UpalaStorage *storage = (UpalaStorage *) account->data;
+    upala_layout_init(&storage->layout, UL_Storage, UPALA_STORAGE_VERSION, bump_seed,
+                      account->data_len, sizeof (UpalaStorage));
+    storage->authority = *authority;
+    upala_layout_use(&storage->layout, upala_storage_used(storage, 0));
+}
+
+/// Storage held by the pools_manager account, NULL unless it has the
+/// current layout
+static UpalaStorage *upala_storage(const SolAccountInfo *account)
+{
+    return upala_storage_layout(account->data, account->data_len);
+}
+
+static uint64_t upala_insert_group(UpalaStorage *storage, const UpalaGroup *ug)
+{
+    uint32_t pos;
+    if (upala_find_group_pos(storage, &ug->key, &pos))
+    {
+        return ERROR_ACCOUNT_ALREADY_INITIALIZED;
+    }
+    const uint32_t slot = storage->groups_count;
+    if (slot >= upala_storage_capacity(storage) ||
+        !upala_layout_use(&storage->layout, upala_storage_used(storage, slot + 1)))
+    {
+        return ERROR_ACCOUNT_DATA_TOO_SMALL;
+    }
+    sol_memcpy(upala_storage_group(storage, slot), ug, sizeof(UpalaGroup));
+
+    storage->groups_count += 1;
+    uint32_t *index = upala_storage_index(storage);
+    for (size_t i = slot; i > pos; i--)
+    {
+        index[i] = index[i - 1];
+    }
+    index[pos] = slot;
+
+    return SUCCESS;
+}
+
+static uint64_t upala_remove_group(UpalaStorage *storage, const SolPubkey *gid)
+{
+    uint32_t pos;
+    if (!upala_find_group_pos(storage, gid, &pos))
+    {
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    // Keep the groups dense: the last group moves into the freed slot
+    uint32_t *index = upala_storage_index(storage);
+    const uint32_t slot = index[pos];
+    const uint32_t last = storage->groups_count - 1;
+    if (slot != last)
+    {
+        sol_memcpy(upala_storage_group(storage, slot), upala_storage_group(storage, last), sizeof(UpalaGroup));
+        for (size_t i = 0; i < storage->groups_count; i++)
+        {
+            if (index[i] == last)
+            {
+                index[i] = slot;
+                break;
+            }
+        }
+    }
+
+    for (size_t i = pos; i < last; i++)
+    {
+        index[i] = index[i + 1];
+    }
+    index[last] = 0;
+    storage->groups_count = last;
+    sol_memset(upala_storage_group(storage, last), 0, sizeof(UpalaGroup));
+    upala_layout_use(&storage->layout, upala_storage_used(storage, last));
+
+    return SUCCESS;
+}
+
+#ifdef DEBUG_LOG
+static void upala_log_group(const UpalaStorage *storage, UpalaGroupData *ug)
+{
+    sol_log("Number of groups: ->");
+    sol_log_64(0,0,0,0, storage->groups_count);
+
+    sol_log("Group id: ->");
+    sol_log_pubkey(&ug->key);
+    sol_log("Group manager id: ->");
+    sol_log_pubkey(&ug->manager);
+    sol_log("Num of accounts: ->");
+    sol_log_64(0,0,0,0, ug->accounts_count);
+    // -----------------------------------
+
+    sol_log("#Users");
+    for (size_t j = 0; j < ug->accounts_count; j++)
+    {
+        const UpalaMember *uas = upala_group_member(ug, j);
+        sol_log("User index: ->");
+        sol_log_64(0,0,0,0, uas->user);
+        sol_log("The score of user: ->");
+        sol_log_64(0,0,0,0, uas->score);
+    }
+}
+#endif
+
+/// Checks that the account holds the data of the group `gid`
+static UpalaGroupData *upala_group_data(const SolParameters *params,
+                                        const SolAccountInfo *group_account,
+                                        const SolPubkey *gid)
+{
+    if (!SolPubkey_same(group_account->owner, params->program_id))
+    {
+        return NULL;
+    }
+
+    UpalaGroupData *ug = upala_group_layout(group_account->data, group_account->data_len);
+    if (!ug || !upala_pubkey_same(&ug->key, gid))
+    {
+        return NULL;
+    }
+    return ug;
+}
+
+/// Checks that `key` is the program address of the seeds, the last seed
+/// being the known canonical bump seed: one hash instead of the bump search
+static bool upala_check_program_address(const SolSignerSeed *seeds, int seeds_len,
+                                        const SolPubkey *program_id,
+                                        const SolPubkey *key)
+{
+    SolPubkey address;
+    return sol_create_program_address(seeds, seeds_len, program_id, &address) == SUCCESS &&
+           SolPubkey_same(&address, key);
+}
+
+/// Group accounts one instruction may grow, a batch adding members to
+/// more groups grows them over several instructions
+#define UPALA_MAX_GROWN_GROUPS 4
+
+/// Length of a group account at the start of the instruction, the account
+/// being known by its data as a batch may pass it at several indexes
+typedef struct
+{
+    const uint8_t  *data;
+    uint64_t        len;
+} UpalaGroupLen;
+
+/// Accounts and state shared by the operations of one instruction
+typedef struct
+{
+    const SolParameters *params;
+    SolAccountInfo      *manager;
+    SolAccountInfo      *pools_manager;
+    SolAccountInfo      *minter;
+    SolAccountInfo      *system_program;
+    SolAccountInfo      *sysvar_rent;
+    SolAccountInfo      *spl_token;
+    SolAccountInfo      *registry;
+    SolAccountInfo      *shard_account;
+    UpalaRent            rent;
+    SolAccountInfo      *storage_account;   // pools_manager, or the shard of a sharded storage
+    UpalaStorage        *storage;           // Its data, the groups of the instruction
+    uint16_t             shards_count;      // Of the storage, 0 when it is not sharded
+    uint16_t             shard;             // Of the groups of the instruction
+    uint64_t             storage_len;       // Lengths at the start of the instruction,
+    uint64_t             registry_len;      // the bases of the data growth
+    UpalaGroupLen        group_lens[UPALA_MAX_GROWN_GROUPS];  // Of the group accounts grown,
+    uint8_t              group_lens_count;                    // in the order they grew
+    UpalaRegistry       *users;             // Data of the registry, NULL without it
+    SolInnerAccount      pta;               // pools_manager, the pools authority
+    SolSignerSeed        pta_seeds[3];
+} UpalaContext;
+
+/// Writes an empty registry of the current layout
+static void upala_registry_init(SolAccountInfo *account, const SolPubkey *minter, uint8_t bump_seed)
+{
+    sol_memset(account->data, 0, account->data_len);
+    UpalaRegistry *registry = (UpalaRegistry *) account->data;
+    registry->minter = *minter;
+    upala_layout_init(&registry->layout, UL_Registry, UPALA_REGISTRY_VERSION, bump_seed,
+                      account->data_len, sizeof (UpalaRegistry));
+    upala_layout_use(&registry->layout, upala_registry_used(registry, 0));
+}
+
+/// Makes room for `required` keys in the registry, the manager tops up
+/// the rent of the grown account
+static uint64_t upala_registry_reserve(UpalaContext *ctx, uint64_t required)
+{
+    UpalaRegistry *registry = ctx->users;
+    const uint64_t capacity = upala_registry_capacity(registry);
+    if (required <= capacity)
+    {
+        return SUCCESS;
+    }
+
+    uint64_t new_capacity = capacity * 2;
+    if (new_capacity < required)
+    {
+        new_capacity = required;
+    }
+
+    uint64_t new_len = upala_registry_data_len(new_capacity);
+    if (new_len > ctx->registry_len + MAX_PERMITTED_DATA_INCREASE)
+    {
+        new_len = upala_registry_data_len(required);
+        if (new_len > ctx->registry_len + MAX_PERMITTED_DATA_INCREASE)
+        {
+            sol_log("Error: Too many users registered at once");
+            return ERROR_INVALID_ARGUMENT;
+        }
+    }
+
+    const uint64_t err = upala_account_grow(ctx->registry, ctx->manager, ctx->system_program, &ctx->rent, new_len);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    // The order follows the room of the keys, it moves up with it
+    const uint64_t order = upala_registry_order_offset(registry);
+    const uint64_t order_len = registry->users_count * sizeof (uint32_t);
+    registry->layout.capacity = (uint32_t) new_len;
+    upala_layout_move(ctx->registry->data, order, upala_registry_order_offset(registry), order_len);
+    const uint64_t keys_end = sizeof (UpalaRegistry) + registry->users_count * SIZE_PUBKEY;
+    const uint64_t order_end = upala_registry_order_offset(registry) + order_len;
+    sol_memset(ctx->registry->data + keys_end, 0, upala_registry_order_offset(registry) - keys_end);
+    sol_memset(ctx->registry->data + order_end, 0, new_len - order_end);
+    upala_layout_use(&registry->layout, upala_registry_used(registry, registry->users_count));
+    return SUCCESS;
+}
+
+/// Length of the group account at the start of the instruction, recorded
+/// the first time the instruction grows it. NULL once
+/// UPALA_MAX_GROWN_GROUPS group accounts are recorded
+static const uint64_t *upala_group_len(UpalaContext *ctx, const SolAccountInfo *account)
+{
+    for (uint8_t i = 0; i < ctx->group_lens_count; i++)
+    {
+        if (ctx->group_lens[i].data == account->data)
+        {
+            return &ctx->group_lens[i].len;
+        }
+    }
+    if (ctx->group_lens_count == UPALA_MAX_GROWN_GROUPS)
+    {
+        return NULL;
+    }
+
+    UpalaGroupLen *group_len = &ctx->group_lens[ctx->group_lens_count++];
+    group_len->data = account->data;
+    group_len->len = account->data_len;
+    return &group_len->len;
+}
+
+/// Makes room for `required` groups in the storage of the instruction, the
+/// manager tops up the rent of the grown account
+///
+/// The capacity doubles, the growth of one instruction being bounded by
+/// MAX_PERMITTED_DATA_INCREASE bytes: a storage of any size is reached
+/// over several instructions.
+static uint64_t upala_storage_reserve(UpalaContext *ctx, uint64_t required)
+{
+    UpalaStorage *storage = ctx->storage;
+    const uint64_t capacity = upala_storage_capacity(storage);
+    if (required <= capacity)
+    {
+        return SUCCESS;
+    }
+
+    uint64_t new_capacity = capacity * 2;
+    if (new_capacity < required)
+    {
+        new_capacity = required;
+    }
+
+    uint64_t new_len = upala_storage_data_len(new_capacity);
+    if (new_len > ctx->storage_len + MAX_PERMITTED_DATA_INCREASE)
+    {
+        new_len = upala_storage_data_len(required);
+        if (new_len > ctx->storage_len + MAX_PERMITTED_DATA_INCREASE)
+        {
+            sol_log("Error: Too many groups created at once");
+            return ERROR_ACCOUNT_DATA_TOO_SMALL;
+        }
+    }
+
+    const uint64_t err = upala_account_grow(ctx->storage_account, ctx->manager, ctx->system_program, &ctx->rent, new_len);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    // The index follows the room of the groups, it moves up with it
+    const uint64_t index = upala_storage_index_offset(storage);
+    const uint64_t index_len = storage->groups_count * sizeof (uint32_t);
+    storage->layout.capacity = (uint32_t) new_len;
+    upala_layout_move(ctx->storage_account->data, index, upala_storage_index_offset(storage), index_len);
+    const uint64_t groups_end = sizeof (UpalaStorage) + storage->groups_count * sizeof (UpalaGroup);
+    const uint64_t index_end = upala_storage_index_offset(storage) + index_len;
+    sol_memset(ctx->storage_account->data + groups_end, 0, upala_storage_index_offset(storage) - groups_end);
+    sol_memset(ctx->storage_account->data + index_end, 0, new_len - index_end);
+    upala_layout_use(&storage->layout, upala_storage_used(storage, storage->groups_count));
+    return SUCCESS;
+}
+
+/// Gives back the room of the removed groups
+///
+/// Once the groups fill a quarter of the storage it shrinks to twice their
+/// count. The rent above the minimum of the length goes back to the
+/// storage authority when it signs the instruction, otherwise it stays in
+/// the storage until the authority removes a group or cleans the storage.
+static void upala_storage_shrink(UpalaContext *ctx)
+{
+    UpalaStorage *storage = ctx->storage;
+    if (!ctx->sysvar_rent)
+    {
+        return;
+    }
+
+    const uint64_t capacity = upala_storage_capacity(storage);
+    if (capacity > UPALA_STORAGE_INITIAL_CAPACITY && storage->groups_count * 4 <= capacity)
+    {
+        uint64_t new_capacity = storage->groups_count * 2;
+        if (new_capacity < UPALA_STORAGE_INITIAL_CAPACITY)
+        {
+            new_capacity = UPALA_STORAGE_INITIAL_CAPACITY;
+        }
+        const uint64_t new_len = upala_storage_data_len(new_capacity);
+
+        const uint64_t index = upala_storage_index_offset(storage);
+        const uint64_t index_len = storage->groups_count * sizeof (uint32_t);
+        storage->layout.capacity = (uint32_t) new_len;
+        upala_layout_move(ctx->storage_account->data, index, upala_storage_index_offset(storage), index_len);
+        const uint64_t index_end = upala_storage_index_offset(storage) + index_len;
+        sol_memset(ctx->storage_account->data + index_end, 0, new_len - index_end);
+        resize_account(ctx->storage_account, new_len);
+        upala_layout_use(&storage->layout, upala_storage_used(storage, storage->groups_count));
+    }
+
+    if (!ctx->manager->is_signer || !SolPubkey_same(&storage->authority, ctx->manager->key))
+    {
+        return;
+    }
+    const uint64_t minimum = rent_exempt_minimum(&ctx->rent, ctx->storage_account->data_len);
+    if (*ctx->storage_account->lamports > minimum)
+    {
+        *ctx->manager->lamports += *ctx->storage_account->lamports - minimum;
+        *ctx->storage_account->lamports = minimum;
+    }
+}
+
+/// Registers the keys of the `count` records missing from the registry
+///
+/// The records are taken in the order of `items`, or in their order when
+/// `items` is NULL, which must sort them by key. The missing keys are
+/// appended in that order and their indexes merged into the order in one
+/// pass from its end, a key given twice is registered once. `users`, when
+/// not NULL, is set to the index of every record.
+static uint64_t upala_registry_add(UpalaContext *ctx, const UpalaAccount *records,
+                                   const uint32_t *items, uint64_t count, uint32_t *users)
+{
+    UpalaRegistry *registry = ctx->users;
+    const uint64_t known = registry->users_count;
+    const SolPubkey *previous = NULL;
+    uint32_t user = UPALA_NO_USER;
+    uint64_t missing = 0;
+    for (uint64_t j = 0; j < count; j++)
+    {
+        const uint64_t r = items ? items[j] : j;
+        if (!previous || !upala_pubkey_same(previous, &records[r].key))
+        {
+            user = upala_registry_find(registry, &records[r].key);
+            missing += user == UPALA_NO_USER;
+        }
+        if (users)
+        {
+            users[r] = user;
+        }
+        previous = &records[r].key;
+    }
+    if (missing == 0)
+    {
+        return SUCCESS;
+    }
+
+    const uint64_t total = known + missing;
+    const uint64_t err = upala_registry_reserve(ctx, total);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    // The keys are searched among the known ones until the order is merged
+    uint64_t k = known;
+    previous = NULL;
+    for (uint64_t j = 0; j < count; j++)
+    {
+        const uint64_t r = items ? items[j] : j;
+        if (!previous || !upala_pubkey_same(previous, &records[r].key))
+        {
+            user = users ? users[r] : upala_registry_find(registry, &records[r].key);
+            if (user == UPALA_NO_USER)
+            {
+                user = (uint32_t) k;
+                registry->users[k++] = records[r].key;
+            }
+        }
+        if (users)
+        {
+            users[r] = user;
+        }
+        previous = &records[r].key;
+    }
+
+    upala_layout_use(&registry->layout, upala_registry_used(registry, total));
+    uint32_t *order = (uint32_t *)(ctx->registry->data + upala_registry_order_offset(registry));
+    uint64_t i = known;
+    for (uint64_t j = missing; j > 0;)
+    {
+        const uint32_t added = (uint32_t)(known + j - 1);
+        if (i > 0 && upala_pubkey_cmp(&registry->users[order[i - 1]], &registry->users[added]) > 0)
+        {
+            order[i + j - 1] = order[i - 1];
+            i--;
+        }
+        else
+        {
+            order[i + j - 1] = added;
+            j--;
+        }
+    }
+    registry->users_count = (uint32_t) total;
+    return SUCCESS;
+}
+
+/// Registers the uids of the `count` uid | score entries of a payload,
+/// `users` is set to their indexes
+static uint64_t upala_registry_enter(UpalaContext *ctx, const uint8_t *entries, uint8_t count, uint32_t *users)
+{
+    uint32_t order[UINT8_MAX];
+    for (uint32_t j = 0; j < count; j++)
+    {
+        order[j] = j;
+    }
+    upala_sort_items(entries, order, count, UO_Key);
+    return upala_registry_add(ctx, (const UpalaAccount *) entries, order, count, users);
+}
+
+/// Payload of an operation checked by upala_payload_decode(): views into
+/// the instruction data, nothing is copied
+typedef struct
+{
+    const uint8_t  *fields;     // The fixed fields, NULL when the optional ones are left out
+    uint8_t         count;      // Entries following the fixed fields
+    const uint8_t  *entries;
+    uint64_t        entry_len;
+    uint64_t        len;        // Of the whole payload
+} UpalaPayload;
+
+/// One operation of an instruction, the accounts not passed are NULL
+typedef struct
+{
+    UpalaInstruction  instruction;
+    SolAccountInfo   *pool;
+    SolAccountInfo   *group;
+    SolAccountInfo   *user;
+    SolAccountInfo   *user_at;
+    UpalaPayload      payload;
+} UpalaOperation;
+
+/// Account index of a batched operation that does not use the account
+const static uint8_t UPALA_NO_ACCOUNT = UINT8_MAX;
+
+/// Bytes of a batched operation before its payload:
+/// instruction | pool | group | user | user_at | payload length: u16
+#define UPALA_BATCH_OPERATION_LEN (5 * sizeof (uint8_t) + sizeof (uint16_t))
+
+/// Shape of the payload of an instruction: `len` bytes of fixed fields,
+/// then as many entries of `entry_len` bytes as the u8 count at
+/// `count_at` of the fixed fields gives, and not a byte more
+typedef struct
+{
+    uint8_t  len;
+    uint8_t  count_at;      // UPALA_NO_COUNT without entries
+    uint8_t  entry_len;     // Of the header of an operation for UI_Batch
+    uint8_t  max_count;
+    bool     optional;      // The fixed fields may all be left out
+    bool     operations;    // The entries are batched operations, each followed by its payload
+} UpalaPayloadSchema;
+
+/// Offset of the count of a payload without entries
+#define UPALA_NO_COUNT UINT8_MAX
+
+/// gid | count: u8, then count entries of the operations on the members
+#define UPALA_MEMBERS_PAYLOAD(entry) {SIZE_PUBKEY + sizeof (uint8_t), SIZE_PUBKEY, (entry), UINT8_MAX, false, false}
+
+/// Payload of `len` bytes of fixed fields only
+#define UPALA_FIXED_PAYLOAD(len) {(len), UPALA_NO_COUNT, 0, 0, false, false}
+
+const static UpalaPayloadSchema UPALA_PAYLOADS[] = {
+    [UI_CreatePool]   = {sizeof (uint8_t), UPALA_NO_COUNT, 0, 0, true, false},
+    [UI_EmptyPool]    = UPALA_FIXED_PAYLOAD(0),
+    [UI_RemovePool]   = UPALA_FIXED_PAYLOAD(0),
+    [UI_AddUser]      = UPALA_MEMBERS_PAYLOAD(SIZE_PUBKEY + sizeof (uint64_t)),
+    [UI_RemoveUser]   = UPALA_MEMBERS_PAYLOAD(SIZE_PUBKEY),
+    [UI_SetScore]     = UPALA_MEMBERS_PAYLOAD(SIZE_PUBKEY + sizeof (uint64_t)),
+    [UI_CleanStorage] = UPALA_FIXED_PAYLOAD(0),
+    [UI_Migrate]      = UPALA_FIXED_PAYLOAD(0),
+    [UI_Batch]        = {sizeof (uint8_t), 0, UPALA_BATCH_OPERATION_LEN, UINT8_MAX, false, true},
+    [UI_Distribute]   = {2 * sizeof (uint8_t), sizeof (uint8_t), sizeof (uint8_t) + sizeof (uint64_t), UINT8_MAX,
+                         false, false},
+    [UI_CreateShard]  = UPALA_FIXED_PAYLOAD(2 * sizeof (uint16_t)),
+    [UI_GetGroup]     = UPALA_FIXED_PAYLOAD(0),
+    [UI_GetMember]    = UPALA_FIXED_PAYLOAD(SIZE_PUBKEY),
+    [UI_ListMembers]  = UPALA_FIXED_PAYLOAD(sizeof (uint32_t) + sizeof (uint8_t)),
+    [UI_SetRoot]      = UPALA_FIXED_PAYLOAD(2 * SIZE_PUBKEY + sizeof (uint32_t)),
+    [UI_VerifyMember] = {SIZE_PUBKEY + sizeof (uint64_t) + sizeof (uint8_t), SIZE_PUBKEY + sizeof (uint64_t),
+                         SIZE_PUBKEY, UINT8_MAX, false, false},
+    [UI_Deposit]      = UPALA_FIXED_PAYLOAD(SIZE_PUBKEY + sizeof (uint64_t)),
+    [UI_Claim]        = UPALA_FIXED_PAYLOAD(SIZE_PUBKEY),
+};
+
+/// Whether the instruction may be an operation of UI_Batch: the
+/// instructions that set the context up and the queries may not
+static bool upala_batchable(uint8_t instruction)
+{
+    return instruction < SOL_ARRAY_SIZE(UPALA_SCHEMAS) && !UPALA_SCHEMAS[instruction].query &&
+           instruction != UI_Batch && instruction != UI_Migrate && instruction != UI_CreateShard;
+}
+
+/// Checks `len` bytes of payload against the shape and sets the views
+static bool upala_payload_view(const UpalaPayloadSchema *schema, const uint8_t *data, uint64_t len,
+                               UpalaPayload *payload)
+{
+    *payload = (UpalaPayload){NULL, 0, data + len, schema->entry_len, len};
+    if (len == 0 && schema->optional)
+    {
+        return true;
+    }
+    if (len < schema->len)
+    {
+        return false;
+    }
+
+    payload->fields = data;
+    payload->entries = data + schema->len;
+    if (schema->count_at == UPALA_NO_COUNT)
+    {
+        return len == schema->len;
+    }
+    payload->count = data[schema->count_at];
+    return payload->count <= schema->max_count &&
+           (schema->operations || len - schema->len == (uint64_t) payload->count * schema->entry_len);
+}
+
+/// Checks the payload of the instruction in one pass before anything is
+/// read or derived from it, the operations of a batch with their own
+/// payloads, and sets the views. Fails for an unknown instruction
+static bool upala_payload_decode(uint8_t instruction, const uint8_t *data, uint64_t len, UpalaPayload *payload)
+{
+    if (instruction >= SOL_ARRAY_SIZE(UPALA_PAYLOADS) ||
+        !upala_payload_view(&UPALA_PAYLOADS[instruction], data, len, payload))
+    {
+        return false;
+    }
+    if (!UPALA_PAYLOADS[instruction].operations)
+    {
+        return true;
+    }
+
+    const uint8_t *operation = payload->entries;
+    uint64_t left = len - (uint64_t)(operation - data);
+    for (uint8_t i = 0; i < payload->count; i++)
+    {
+        if (left < UPALA_BATCH_OPERATION_LEN)
+        {
+            return false;
+        }
+        if (!upala_batchable(operation[0]))
+        {
+            sol_log("Error: The instruction can not be batched");
+            return false;
+        }
+        const uint64_t operation_len = (uint64_t) operation[5] | (uint64_t) operation[6] << 8;
+        left -= UPALA_BATCH_OPERATION_LEN;
+        UpalaPayload sub;
+        if (left < operation_len ||
+            !upala_payload_view(&UPALA_PAYLOADS[operation[0]], operation + UPALA_BATCH_OPERATION_LEN,
+                                operation_len, &sub))
+        {
+            return false;
+        }
+        operation += UPALA_BATCH_OPERATION_LEN + operation_len;
+        left -= operation_len;
+    }
+    return left == 0;
+}
+
+/// Data of the group `gid` passed to the operation, only the group
+/// manager can change it: its members, or its root with `root` for a
+/// UG_Merkle group
+static uint64_t upala_managed_group(const UpalaContext *ctx,
+                                    const UpalaOperation *op,
+                                    const SolPubkey *gid,
+                                    bool root,
+                                    UpalaGroupData **group)
+{
+    *group = upala_group_data(ctx->params, op->group, gid);
+    if (!*group)
+    {
+        sol_log("Error: The group account does not match the group id");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+    if (root != (((*group)->flags & UG_Merkle) != 0))
+    {
+        sol_log(root ? "Error: The group keeps its members, not a root"
+                     : "Error: The members of a Merkle group are set by UI_SetRoot");
+        return ERROR_INVALID_ARGUMENT;
+    }
+    if (!root && !ctx->users)
+    {
+        sol_log("Error: Registry account not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+    if (ctx->shards_count > 0 && upala_shard_of(gid, ctx->shards_count) != ctx->shard)
+    {
+        sol_log("Error: The group belongs to another shard");
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    if (!ctx->manager->is_signer || !SolPubkey_same(&(*group)->manager, ctx->manager->key))
+    {
+        sol_log("Error: Only the group manager can change the members");
+        return ERROR_MISSING_REQUIRED_SIGNATURES;
+    }
+    return SUCCESS;
+}
+
+/// Provisions an account at a program address, paid by the manager
+///
+/// Does nothing when the account is already owned by `owner`. Otherwise
+/// one create-account CPI funds it with the rent-exempt minimum of `space`
+/// bytes, allocates and assigns it. An address already holding lamports
+/// cannot be created, anybody may send some to it: the rent is topped up
+/// and the space allocated and assigned instead. With `token_owner` the
+/// account is a token account of the minter, initialized for the owner.
+static uint64_t upala_provision(const UpalaContext   *ctx,
+                                      SolAccountInfo *account,
+                                const SolSignerSeed  *seeds,
+                                      uint64_t        seeds_len,
+                                      uint64_t        space,
+                                const SolPubkey      *owner,
+                                const SolAccountInfo *token_owner
+                                UPALA_PROFILE_ARG(profile))
+{
+    if (SolPubkey_same(account->owner, owner))
+    {
+        return SUCCESS;
+    }
+
+    const uint64_t minimum = rent_exempt_minimum(&ctx->rent, space);
+    uint64_t err;
+    if (*account->lamports == 0)
+    {
+        UPALA_PROFILE_PHASE(profile, PF_Create,
+            err = create_account(ctx->manager, account, seeds, seeds_len, ctx->system_program,
+                                 minimum, space, owner));
+    }
+    else
+    {
+        UPALA_PROFILE_PHASE(profile, PF_Create,
+            err = *account->lamports < minimum
+                ? transfer_lamports(ctx->manager, account, ctx->system_program, minimum - *account->lamports)
+                : SUCCESS;
+            if (err == SUCCESS)
+            {
+                err = allocate_space_for_ata(account, seeds, seeds_len, ctx->system_program, space);
+            }
+            if (err == SUCCESS)
+            {
+                err = assign_ata(account, seeds, seeds_len, ctx->system_program, owner);
+            });
+    }
+    if (err != SUCCESS || !token_owner)
+    {
+        return err;
+    }
+
+    UPALA_PROFILE_PHASE(profile, PF_Initialize,
+        err = initialize_ata(account, ctx->minter, token_owner, ctx->sysvar_rent, ctx->spl_token));
+    return err;
+}
+
+/// Opens the registry of the user keys, creating it when the instruction
+/// passes the system program and the rent sysvar
+///
+/// Only the program writes a registry, at the address of the minter: an
+/// existing one is checked by its minter and its shard, the address is
+/// derived when it is created. The registry of a sharded storage gives
+/// the shard of the instruction.
+static uint64_t upala_registry_open(UpalaContext *ctx, SolAccountInfo *account UPALA_PROFILE_ARG(profile))
+{
+    const SolPubkey *program_id = ctx->params->program_id;
+    if (SolPubkey_same(account->owner, program_id))
+    {
+        ctx->users = upala_registry_layout(account->data, account->data_len);
+        if (!ctx->users)
+        {
+            sol_log("Error: Unknown registry layout");
+            return ERROR_INVALID_ACCOUNT_DATA;
+        }
+        if (!upala_pubkey_same(&ctx->users->minter, ctx->minter->key))
+        {
+            ctx->users = NULL;
+            sol_log("Error: The registry belongs to another minter");
+            return ERROR_INVALID_ACCOUNT_DATA;
+        }
+        if (ctx->users->shards_count != ctx->shards_count ||
+            (ctx->shard != UPALA_NO_SHARD && ctx->users->shard != ctx->shard))
+        {
+            ctx->users = NULL;
+            sol_log("Error: The registry belongs to another shard");
+            return ERROR_INVALID_ACCOUNT_DATA;
+        }
+        ctx->shard = ctx->users->shard;
+        return SUCCESS;
+    }
+    if (ctx->shard == UPALA_NO_SHARD)
+    {
+        sol_log("Error: The registry is not created, UI_CreateShard creates it");
+        return ERROR_UNINITIALIZED_ACCOUNT;
+    }
+
+    // The registry of a storage that is not sharded has no shard seed
+    uint8_t bump_seed;
+    const uint8_t shard[] = {(uint8_t) ctx->shard, (uint8_t) (ctx->shard >> 8)};
+    SolSignerSeed seeds[] = {
+        {UPALA_REGISTRY_SEED, sizeof (UPALA_REGISTRY_SEED)},
+        {ctx->minter->key->x, SIZE_PUBKEY},
+        {program_id->x, SIZE_PUBKEY},
+        {shard, sizeof (shard)},
+        {&bump_seed, 1}
+    };
+    uint64_t seeds_len = SOL_ARRAY_SIZE(seeds);
+    if (ctx->shards_count == 0)
+    {
+        seeds[3] = seeds[4];
+        seeds_len--;
+    }
+
+    SolPubkey key;
+    UPALA_PROFILE_PHASE(profile, PF_Derive,
+        sol_try_find_program_address(seeds, seeds_len - 1, program_id, &key, &bump_seed));
+    if (!SolPubkey_same(account->key, &key))
+    {
+        sol_log("Error: Registry address does not match seed derivation");
+        return INVALID_SEEDS;
+    }
+    if (!ctx->system_program || !ctx->sysvar_rent)
+    {
+        sol_log("Error: The registry is not created, UI_AddUser creates it");
+        return ERROR_UNINITIALIZED_ACCOUNT;
+    }
+
+    const uint64_t err = upala_provision(ctx, account, seeds, seeds_len,
+                                         upala_registry_data_len(UPALA_REGISTRY_INITIAL_CAPACITY), program_id, NULL
+                                         UPALA_PROFILE_PASS(profile));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        upala_registry_init(account, ctx->minter->key, bump_seed));
+    ctx->users = (UpalaRegistry *) account->data;
+    ctx->users->shards_count = ctx->shards_count;
+    ctx->users->shard = ctx->shard;
+    return SUCCESS;
+}
+
+/// Opens the shard account of a sharded storage, checked by its address:
+/// the groups of the instruction are read and written there
+static uint64_t upala_shard_open(UpalaContext *ctx, SolAccountInfo *account UPALA_PROFILE_ARG(profile))
+{
+    UpalaStorage *storage = SolPubkey_same(account->owner, ctx->params->program_id) ? upala_storage(account) : NULL;
+    if (!storage || storage->shards_count != ctx->shards_count || storage->shard >= ctx->shards_count)
+    {
+        sol_log("Error: Unknown shard layout, UI_CreateShard creates the shards");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+
+    const uint8_t shard[] = {(uint8_t) storage->shard, (uint8_t) (storage->shard >> 8)};
+    const SolSignerSeed seeds[] = {
+        {UPALA_SHARD_SEED, sizeof (UPALA_SHARD_SEED)},
+        {ctx->minter->key->x, SIZE_PUBKEY},
+        {ctx->params->program_id->x, SIZE_PUBKEY},
+        {shard, sizeof (shard)},
+        {&storage->layout.bump_seed, 1}
+    };
+    bool valid;
+    UPALA_PROFILE_PHASE(profile, PF_Derive,
+        valid = upala_check_program_address(seeds, SOL_ARRAY_SIZE(seeds), ctx->params->program_id, account->key));
+    if (!valid)
+    {
+        sol_log("Error: Shard address does not match seed derivation");
+        return INVALID_SEEDS;
+    }
+
+    ctx->storage_account = account;
+    ctx->storage = storage;
+    ctx->storage_len = account->data_len;
+    ctx->shard = storage->shard;
+    return SUCCESS;
+}
+
+/// Checks that the storage of the instruction keeps the group `gid` and,
+/// with `write`, that the instruction may write it
+static uint64_t upala_storage_check(const UpalaContext *ctx, const SolPubkey *gid, bool write)
+{
+    if (!ctx->storage)
+    {
+        sol_log("Error: Shard account not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+    if (gid && ctx->shards_count > 0 && upala_shard_of(gid, ctx->shards_count) != ctx->shard)
+    {
+        sol_log("Error: The group belongs to another shard");
+        return ERROR_INVALID_ARGUMENT;
+    }
+    if (write && !ctx->storage_account->is_writable)
+    {
+        sol_log("Error: Instruction account must be writable");
+        return ERROR_INVALID_ARGUMENT;
+    }
+    return SUCCESS;
+}
+
+/// Token transfers out of a pool signed by the pools_manager: the
+/// instruction and the signer seeds are set up once for many recipients
+typedef struct
+{
+    uint8_t         data[sizeof (uint8_t) + sizeof (uint64_t)];
+    SolAccountMeta  arguments[3];
+    SolAccountInfo  account_infos[4];
+    SolSignerSeeds  signers_seeds[1];
+    SolInstruction  instruction;
+} UpalaPoolTransfer;
+
+static void upala_pool_transfer_init(UpalaPoolTransfer *transfer,
+                                     const UpalaContext *ctx,
+                                     const SolAccountInfo *pool)
+{
+    transfer->data[0] = TI_TRANSFER;
+
+    /// 0. `[writable]` The source account.
+    /// 1. `[writable]` The destination account.
+    /// 2. `[signer]` The source account's owner/delegate.
+    transfer->arguments[0] = (SolAccountMeta){.pubkey = pool->key,                .is_writable = true,  .is_signer = false};
+    transfer->arguments[1] = (SolAccountMeta){.pubkey = NULL,                     .is_writable = true,  .is_signer = false};
+    transfer->arguments[2] = (SolAccountMeta){.pubkey = ctx->pools_manager->key,  .is_writable = false, .is_signer = true};
+
+    transfer->account_infos[0] = *pool;
+    transfer->account_infos[2] = *ctx->pools_manager;
+    transfer->account_infos[3] = *ctx->spl_token;
+
+    transfer->signers_seeds[0] = (SolSignerSeeds){ctx->pta.seed, ctx->pta.seed_len};
+
+    transfer->instruction = (SolInstruction){
+        ctx->spl_token->key,
+        transfer->arguments, SOL_ARRAY_SIZE(transfer->arguments),
+        transfer->data, SOL_ARRAY_SIZE(transfer->data)
+    };
+}
+
+static uint64_t upala_pool_transfer(UpalaPoolTransfer *transfer,
+                                    const SolAccountInfo *recipient,
+                                    uint64_t amount)
+{
+    sol_memcpy(transfer->data + sizeof (uint8_t), &amount, sizeof (amount));
+#ifdef DEBUG_INSTRUCTION_DATA
+    sol_log_array(transfer->data, SOL_ARRAY_SIZE(transfer->data));
+#endif
+    transfer->arguments[1].pubkey = recipient->key;
+    transfer->account_infos[1] = *recipient;
+
+    return sol_invoke_signed(&transfer->instruction,
+                             transfer->account_infos, SOL_ARRAY_SIZE(transfer->account_infos),
+                             transfer->signers_seeds, SOL_ARRAY_SIZE(transfer->signers_seeds));
+}
+
+/// UI_CreatePool: creates the pool account and the group of the manager
+static uint64_t upala_create_pool(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    upala_debug("Called the instruction UI_CreatePool");
+    if (!op->pool || !op->group)
+    {
+        sol_log("Group account not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+
+    // Optional payload: flags: u8, see UpalaGroupFlags
+    const uint8_t flags = op->payload.fields ? op->payload.fields[0] : 0;
+    if ((flags & ~UPALA_GROUP_FLAGS) != 0 ||
+        ((flags & UG_Merkle) && flags != UG_Merkle))
+    {
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+
+    uint64_t return_value = upala_storage_check(ctx, op->pool->key, true);
+    if (return_value != SUCCESS)
+    {
+        return return_value;
+    }
+
+    const UpalaGroup *existing_ug;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        existing_ug = upala_find_group(ctx->storage, op->pool->key));
+    if (!existing_ug)
+    {
+        // The group account left by a cleaned storage keeps the bump seeds
+        UpalaGroupData *gd = upala_group_data(ctx->params, op->group, op->pool->key);
+
+        SolInnerAccount ata;
+        SolSignerSeed ata_seeds[] = {
+            {ctx->manager->key->x, SIZE_PUBKEY},
+            {ctx->minter->key->x, SIZE_PUBKEY},
+            {ctx->params->program_id->x, SIZE_PUBKEY},
+            {&ata.bump_seed, 1}
+        };
+
+        bool valid;
+        if (gd)
+        {
+            ata.bump_seed = gd->pool_bump;
+            UPALA_PROFILE_PHASE(profile, PF_Derive,
+                valid = upala_check_program_address(ata_seeds, SOL_ARRAY_SIZE(ata_seeds),
+                                                    ctx->params->program_id, op->pool->key));
+        }
+        else
+        {
+            UPALA_PROFILE_PHASE(profile, PF_Derive,
+                sol_try_find_program_address(ata_seeds, SOL_ARRAY_SIZE(ata_seeds) - 1,
+                                             ctx->params->program_id,
+                                             &ata.key, &ata.bump_seed));
+            valid = SolPubkey_same(op->pool->key, &ata.key);
+        }
+        if (!valid)
+        {
+            sol_log("Error: Associated address does not match seed derivation");
+            return INVALID_SEEDS;
+        }
+
+        // The members of a cleaned group keep their claim on the tokens it
+        // held, the group is not created again over them
+        const UpalaRewards *leftover = gd ? upala_group_rewards(gd) : NULL;
+        if (leftover && leftover->held != 0)
+        {
+            sol_log("Error: The group account still holds rewards");
+            return ERROR_INVALID_ARGUMENT;
+        }
+
+        //init associated_token_account
+        return_value = upala_provision(ctx, op->pool, ata_seeds, SOL_ARRAY_SIZE(ata_seeds),
+                                       SPL_TOKEN_ACCOUNT_DATA_LEN, ctx->spl_token->key, ctx->pools_manager
+                                       UPALA_PROFILE_PASS(profile));
+        if (return_value != SUCCESS)
+        {
+            return return_value;
+        }
+
+        if (!gd)
+        {
+            SolInnerAccount gda;
+            SolSignerSeed gda_seeds[] = {
+                {UPALA_GROUP_SEED, sizeof (UPALA_GROUP_SEED)},
+                {op->pool->key->x, SIZE_PUBKEY},
+                {ctx->minter->key->x, SIZE_PUBKEY},
+                {ctx->params->program_id->x, SIZE_PUBKEY},
+                {0, 0}
+            };
+
+            UPALA_PROFILE_PHASE(profile, PF_Derive,
+                sol_try_find_program_address(gda_seeds, SOL_ARRAY_SIZE(gda_seeds) - 1,
+                                             ctx->params->program_id,
+                                             &gda.key, &gda.bump_seed));
+            if (!SolPubkey_same(op->group->key, &gda.key))
+            {
+                sol_log("Error: Group address does not match seed derivation");
+                return INVALID_SEEDS;
+            }
+            gda_seeds[SOL_ARRAY_SIZE(gda_seeds) - 1] = (SolSignerSeed){&gda.bump_seed, 1};
+
+            //init group account
+            return_value = upala_provision(ctx, op->group, gda_seeds, SOL_ARRAY_SIZE(gda_seeds),
+                                           upala_group_data_len(UPALA_GROUP_INITIAL_CAPACITY, flags), ctx->params->program_id, NULL
+                                           UPALA_PROFILE_PASS(profile));
+            if (return_value != SUCCESS)
+            {
+                return return_value;
+            }
+
+            gd = (UpalaGroupData *) op->group->data;
+            upala_layout_init(&gd->layout, UL_Group, UPALA_GROUP_VERSION, gda.bump_seed,
+                              op->group->data_len, sizeof (UpalaGroupData));
+            gd->key = *op->pool->key;
+        }
+        gd->manager = *ctx->manager->key;
+        gd->accounts_count = 0;
+        gd->pool_bump = ata.bump_seed;
+        gd->flags = flags;
+        sol_memset(&gd->stats, 0, sizeof (UpalaScoreStats));
+        if (!upala_layout_use(&gd->layout, upala_group_used(gd, 0)))
+        {
+            sol_log("Error: The group account is too small");
+            return ERROR_ACCOUNT_DATA_TOO_SMALL;
+        }
+        if (flags & UG_Merkle)
+        {
+            sol_memset(upala_group_merkle(gd), 0, sizeof (UpalaMerkle));
+        }
+        if (flags & UG_Rewards)
+        {
+            sol_memset(upala_group_rewards(gd), 0, sizeof (UpalaRewards));
+        }
+        upala_group_filter_build(gd);
+
+        UpalaGroup ug;
+        ug.key = *op->pool->key;
+        ug.manager = *ctx->manager->key;
+
+        UPALA_PROFILE_PHASE(profile, PF_Storage,
+            return_value = upala_storage_reserve(ctx, (uint64_t) ctx->storage->groups_count + 1));
+        if (return_value != SUCCESS)
+        {
+            return return_value;
+        }
+        UPALA_PROFILE_PHASE(profile, PF_Storage,
+            return_value = upala_insert_group(ctx->storage, &ug));
+        if (return_value != SUCCESS)
+        {
+            sol_log("Error: The group storage is full");
+            return return_value;
+        }
+        UpalaEvent event;
+        UPALA_PROFILE_PHASE(profile, PF_Event,
+            upala_event_begin(&event, UE_GroupCreated);
+            upala_event_put_pubkey(&event, &ug.key);
+            upala_event_put_pubkey(&event, &ug.manager);
+            upala_event_emit(&event, NULL, 0));
+        upala_debug("Group created");
+    }
+    else upala_debug("The group exists");
+
+#ifdef DEBUG_LOG
+    UpalaGroupData *gd = upala_group_data(ctx->params, op->group, op->pool->key);
+    if (gd)
+    {
+        UPALA_PROFILE_PHASE(profile, PF_Log,
+            upala_log_group(ctx->storage, gd));
+    }
+#endif
+
+    return return_value;
+}
+
+/// Tokens of the pool the manager may pay out: its balance less the
+/// tokens a UG_Rewards group owes to its members
+static uint64_t upala_pool_available(const UpalaContext *ctx, const UpalaOperation *op, uint64_t *available)
+{
+    UpalaGroupData *group = upala_group_data(ctx->params, op->group, op->pool->key);
+    if (!group)
+    {
+        sol_log("Error: The group account does not match the pool");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+
+    SplAccount pool_spl_info;
+    spl_deserialize(op->pool->data, &pool_spl_info);
+    const UpalaRewards *rewards = upala_group_rewards(group);
+    const uint64_t held = rewards ? rewards->held : 0;
+    *available = pool_spl_info.amount > held ? pool_spl_info.amount - held : 0;
+    return SUCCESS;
+}
+
+/// UI_EmptyPool: transfers the pool to the user token account, but for the
+/// tokens a UG_Rewards group owes to its members
+static uint64_t upala_empty_pool(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    upala_debug("Called the instruction UI_EmptyPool");
+    if (!op->pool || !op->group || !op->user_at)
+    {
+        sol_log("User accounts not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+
+    uint64_t err = upala_storage_check(ctx, op->pool->key, false);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    // A registered pool was checked against its derivation when created
+    const UpalaGroup *ug;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        ug = upala_find_group(ctx->storage, op->pool->key));
+    if (!ug || !SolPubkey_same(&ug->manager, ctx->manager->key))
+    {
+        sol_log("Error: The pool is not a group of the manager");
+        return ERROR_INVALID_ARGUMENT;
+    }
+    if (!ctx->manager->is_signer)
+    {
+        sol_log("Error: Only the group manager can empty the pool");
+        return ERROR_MISSING_REQUIRED_SIGNATURES;
+    }
+
+#ifdef DEBUG_LOG
+    sol_log("User SPL account");
+    SplAccount user_spl_info;
+    spl_deserialize(op->user_at->data, &user_spl_info);
+    UPALA_PROFILE_PHASE(profile, PF_Log, spl_log_account(&user_spl_info));
+#endif
+
+#ifdef DEBUG_LOG
+    sol_log("Pool SPL account");
+    SplAccount pool_spl_info;
+    spl_deserialize(op->pool->data, &pool_spl_info);
+    UPALA_PROFILE_PHASE(profile, PF_Log, spl_log_account(&pool_spl_info));
+#endif
+
+    // The tokens owed to the members stay for their claims
+    uint64_t amount;
+    err = upala_pool_available(ctx, op, &amount);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UpalaPoolTransfer transfer;
+    upala_pool_transfer_init(&transfer, ctx, op->pool);
+
+    uint64_t return_value;
+    UPALA_PROFILE_PHASE(profile, PF_Invoke,
+        return_value = upala_pool_transfer(&transfer, op->user_at, amount));
+    if (return_value == SUCCESS)
+    {
+        UpalaEvent event;
+        UPALA_PROFILE_PHASE(profile, PF_Event,
+            upala_event_begin(&event, UE_PoolEmptied);
+            upala_event_put_pubkey(&event, op->pool->key);
+            upala_event_put_pubkey(&event, op->user_at->key);
+            upala_event_put(&event, &amount, sizeof (amount));
+            upala_event_emit(&event, NULL, 0));
+    }
+    return return_value;
+}
+
+/// UI_Distribute: pays the pool of the manager out to many token accounts
+///
+/// Payload: mode: u8 | count: u8, then count * (recipient: u8 | value: u64),
+/// the recipients are indexes of the instruction accounts. The values are
+/// read according to UpalaDistribution, the shares are rounded down and
+/// the remainder stays in the pool. The tokens a UG_Rewards group owes to
+/// its members are not paid out.
+static uint64_t upala_distribute(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    if (!op->pool || !op->group)
+    {
+        sol_log("Pool account not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+
+    const UpalaDistribution mode = (UpalaDistribution) op->payload.fields[0];
+    const uint8_t count = op->payload.count;
+    const uint8_t *entries = op->payload.entries;
+    const uint64_t entry_len = op->payload.entry_len;
+    if (mode != UD_Amounts && mode != UD_Weights)
+    {
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+
+    uint64_t err = upala_storage_check(ctx, op->pool->key, false);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    const UpalaGroup *ug;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        ug = upala_find_group(ctx->storage, op->pool->key));
+    if (!ug || !SolPubkey_same(&ug->manager, ctx->manager->key))
+    {
+        sol_log("Error: The pool is not a group of the manager");
+        return ERROR_INVALID_ARGUMENT;
+    }
+    if (!ctx->manager->is_signer)
+    {
+        sol_log("Error: Only the group manager can distribute the pool");
+        return ERROR_MISSING_REQUIRED_SIGNATURES;
+    }
+
+    // The recipients and the balance are checked once before any transfer
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t *entry = entries + i * entry_len;
+        if (entry[0] >= ctx->params->ka_num)
+        {
+            return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+        }
+        const uint64_t value = *(const uint64_t *) (entry + sizeof (uint8_t));
+        if (total + value < total)
+        {
+            return ERROR_INVALID_INSTRUCTION_DATA;
+        }
+        total += value;
+    }
+    if (mode == UD_Weights && total == 0)
+    {
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+
+    uint64_t balance;
+    err = upala_pool_available(ctx, op, &balance);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+    if (mode == UD_Amounts && total > balance)
+    {
+        sol_log("Error: The pool balance is too small");
+        return ERROR_INSUFFICIENT_FUNDS;
+    }
+
+    UpalaPoolTransfer transfer;
+    upala_pool_transfer_init(&transfer, ctx, op->pool);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t *entry = entries + i * entry_len;
+        const SolAccountInfo *recipient = &ctx->params->ka[entry[0]];
+        const uint64_t value = *(const uint64_t *) (entry + sizeof (uint8_t));
+        const uint64_t amount = mode == UD_Amounts ? value
+                              : (uint64_t)((__uint128_t) balance * value / total);
+        if (amount == 0)
+        {
+            continue;
+        }
+
+        UPALA_PROFILE_PHASE(profile, PF_Invoke,
+            err = upala_pool_transfer(&transfer, recipient, amount));
+        if (err != SUCCESS)
+        {
+            return err;
+        }
+
+        UpalaEvent event;
+        UPALA_PROFILE_PHASE(profile, PF_Event,
+            upala_event_begin(&event, UE_PoolEmptied);
+            upala_event_put_pubkey(&event, op->pool->key);
+            upala_event_put_pubkey(&event, recipient->key);
+            upala_event_put(&event, &amount, sizeof (amount));
+            upala_event_emit(&event, NULL, 0));
+    }
+
+    return SUCCESS;
+}
+
+/// UI_AddUser: merges the new members into the group
+///
+/// Payload: gid | count: u8, then count * (uid | score: u64), the uids
+/// are not members of the group and are given once. The token account of
+/// the user account is created when it does not exist, the payload then
+/// adds that user alone: the other uids would be left without one
+static uint64_t upala_add_user(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    if (!op->group || !op->user || !op->user_at)
+    {
+        sol_log("User accounts not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+
+    const SolPubkey *gid = (const SolPubkey *) op->payload.fields;
+    const uint8_t uids_count = op->payload.count;
+    const uint8_t *entries = op->payload.entries;
+    const uint64_t entry_len = op->payload.entry_len;
+
+    UpalaGroupData *ug;
+    uint64_t err;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        err = upala_managed_group(ctx, op, gid, false, &ug));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    if (!SolPubkey_same(op->user_at->owner, ctx->spl_token->key))
+    {
+        if (uids_count != 1 || !SolPubkey_same((const SolPubkey *) entries, op->user->key))
+        {
+            sol_log("Error: A token account is created for the one user added");
+            return ERROR_INVALID_ARGUMENT;
+        }
+
+        SolInnerAccount user_ata;
+        const SolSignerSeed uset_ata_seeds[] = {
+            {op->user->key->x, SIZE_PUBKEY},
+            {ctx->minter->key->x, SIZE_PUBKEY},
+            {ctx->params->program_id->x, SIZE_PUBKEY},
+            {&user_ata.bump_seed, 1}
+        };
+        {
+            UPALA_PROFILE_PHASE(profile, PF_Derive,
+                sol_try_find_program_address(uset_ata_seeds, SOL_ARRAY_SIZE(uset_ata_seeds) - 1,
+                                             ctx->params->program_id,
+                                             &user_ata.key, &user_ata.bump_seed));
+            upala_debug("Finded associated token account id:");
+            upala_debug_pubkey(&user_ata.key);
+
+            if (!SolPubkey_same(op->user_at->key, &user_ata.key))
+            {
+                sol_log("Error: Associated address does not match seed derivation");
+                return INVALID_SEEDS;
+            }
+
+            user_ata.seed     = uset_ata_seeds;
+            user_ata.seed_len = SOL_ARRAY_SIZE(uset_ata_seeds);
+        }
+
+        //init associated_token_account for new user
+        err = upala_provision(ctx, op->user_at, user_ata.seed, user_ata.seed_len,
+                              SPL_TOKEN_ACCOUNT_DATA_LEN, ctx->spl_token->key, op->user
+                              UPALA_PROFILE_PASS(profile));
+        if (err != SUCCESS)
+        {
+            return err;
+        }
+
+        upala_debug("Create associated_token_account for new user");
+    }
+
+//        SplAccount spl_info;
+//        spl_deserialize(op->pool->data, &spl_info);
+//        spl_log_account(&spl_info);
+
+    // Only a group growing takes an entry of the lengths of the context
+    const uint64_t required = (uint64_t) ug->accounts_count + uids_count;
+    if (required > upala_group_capacity(ug))
+    {
+        const uint64_t *base_len = upala_group_len(ctx, op->group);
+        if (!base_len)
+        {
+            sol_log("Error: Too many groups grown at once");
+            return ERROR_INVALID_ARGUMENT;
+        }
+
+        uint64_t reserve_err;
+        UPALA_PROFILE_PHASE(profile, PF_Storage,
+            reserve_err = upala_group_reserve(op->group, ug, ctx->manager, ctx->system_program,
+                                              &ctx->rent, *base_len, required));
+        if (reserve_err != SUCCESS)
+        {
+            return reserve_err;
+        }
+    }
+
+    upala_debug("Group id: ->");
+    upala_debug_pubkey(&ug->key);
+    upala_debug("Group manager id: ->");
+    upala_debug_pubkey(&ug->manager);
+    upala_debug("Num of accounts: ->");
+    upala_debug_64(0,0,0,0, ug->accounts_count);
+    // -----------------------------------
+
+    upala_debug("Adding account");
+
+    uint32_t users[UINT8_MAX];
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        err = upala_registry_enter(ctx, entries, uids_count, users));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        err = upala_group_merge(ug, entries, users, uids_count));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UpalaEvent event;
+    UPALA_PROFILE_PHASE(profile, PF_Event,
+        upala_event_begin(&event, UE_UserAdded);
+        upala_event_put_pubkey(&event, gid);
+        upala_event_put(&event, &uids_count, sizeof (uids_count));
+        upala_event_emit(&event, entries, uids_count * entry_len));
+
+    // -----------------------------------
+
+#ifdef DEBUG_LOG
+    UPALA_PROFILE_MARK(profile, PF_Handler);
+    sol_log("=== All users ===");
+    for (size_t j = 0; j < ug->accounts_count; j++)
+    {
+        const UpalaMember *uas = upala_group_member(ug, j);
+        sol_log("...User index: ->");
+        sol_log_64(0,0,0,0, uas->user);
+        sol_log("...The score of user: ->");
+        sol_log_64(0,0,0,0, uas->score);
+    }
+    UPALA_PROFILE_MARK(profile, PF_Log);
+#endif
+
+    return SUCCESS;
+}
+
+/// UI_SetScore: changes the scores of the members in place
+///
+/// Payload: gid | count: u8, then count * (uid | score: u64)
+static uint64_t upala_set_score(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    if (!op->group)
+    {
+        sol_log("Group account not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+
+    const UpalaPayload *members = &op->payload;
+    const SolPubkey *gid = (const SolPubkey *) members->fields;
+    UpalaGroupData *ug;
+    uint64_t err;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        err = upala_managed_group(ctx, op, gid, false, &ug));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UPALA_PROFILE_MARK(profile, PF_Handler);
+    for (size_t i = 0; i < members->count; i++)
+    {
+        const uint8_t *entry = members->entries + i * members->entry_len;
+        const uint32_t user = upala_registry_find(ctx->users, (const SolPubkey *) entry);
+        const uint64_t pos = user == UPALA_NO_USER ? UINT64_MAX : upala_group_find(ug, user);
+        if (pos == UINT64_MAX)
+        {
+            sol_log("Error: The user is not a member of the group");
+            return ERROR_INVALID_ARGUMENT;
+        }
+        if (!upala_group_set_score(ug, pos, *(const uint64_t *) (entry + SIZE_PUBKEY)))
+        {
+            sol_log("Error: The scores of the group overflow");
+            return ERROR_INVALID_ARGUMENT;
+        }
+    }
+    UPALA_PROFILE_MARK(profile, PF_Storage);
+
+    UpalaEvent event;
+    UPALA_PROFILE_PHASE(profile, PF_Event,
+        upala_event_begin(&event, UE_ScoreSet);
+        upala_event_put_pubkey(&event, gid);
+        upala_event_put(&event, &members->count, sizeof (members->count));
+        upala_event_emit(&event, members->entries, members->count * members->entry_len));
+
+    return SUCCESS;
+}
+
+/// UI_RemoveUser: removes the members, the members past a removed one
+/// move down a place. A member of a UG_Rewards group still owed tokens
+/// the pool holds is not removed: UI_Claim pays it first, into a token
+/// account of the member, so its manager never takes them back
+///
+/// Payload: gid | count: u8, then count * uid
+static uint64_t upala_remove_user(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    if (!op->group)
+    {
+        sol_log("Group account not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+
+    const UpalaPayload *members = &op->payload;
+    const SolPubkey *gid = (const SolPubkey *) members->fields;
+    UpalaGroupData *ug;
+    uint64_t err;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        err = upala_managed_group(ctx, op, gid, false, &ug));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UPALA_PROFILE_MARK(profile, PF_Handler);
+    const UpalaRewards *rewards = upala_group_rewards(ug);
+    for (size_t i = 0; i < members->count; i++)
+    {
+        const uint8_t *entry = members->entries + i * members->entry_len;
+        const uint32_t user = upala_registry_find(ctx->users, (const SolPubkey *) entry);
+        const uint64_t pos = user == UPALA_NO_USER ? UINT64_MAX : upala_group_find(ug, user);
+        if (pos == UINT64_MAX)
+        {
+            sol_log("Error: The user is not a member of the group");
+            return ERROR_INVALID_ARGUMENT;
+        }
+        if (rewards && rewards->held != 0 && upala_group_pending(ug, pos) != 0)
+        {
+            sol_log("Error: The member has rewards to claim");
+            return ERROR_INVALID_ARGUMENT;
+        }
+        upala_group_remove(ug, pos);
+    }
+    upala_group_filter_build(ug);
+    UPALA_PROFILE_MARK(profile, PF_Storage);
+
+    UpalaEvent event;
+    UPALA_PROFILE_PHASE(profile, PF_Event,
+        upala_event_begin(&event, UE_UserRemoved);
+        upala_event_put_pubkey(&event, gid);
+        upala_event_put(&event, &members->count, sizeof (members->count));
+        upala_event_emit(&event, members->entries, members->count * members->entry_len));
+
+    return SUCCESS;
+}
+
+/// UI_SetRoot: replaces the members of a UG_Merkle group by the ones of
+/// the new root, computed off-chain, whatever their number
+///
+/// Payload: gid | root | members: u32
+static uint64_t upala_set_root(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    if (!op->group)
+    {
+        sol_log("Group account not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+    const uint8_t *fields = op->payload.fields;
+    const SolPubkey *gid = (const SolPubkey *) fields;
+    UpalaGroupData *ug;
+    uint64_t err;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        err = upala_managed_group(ctx, op, gid, true, &ug));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UpalaMerkle *merkle = upala_group_merkle(ug);
+    merkle->root = *(const SolPubkey *) (fields + SIZE_PUBKEY);
+    merkle->members = *(const uint32_t *) (fields + 2 * SIZE_PUBKEY);
+
+    UpalaEvent event;
+    UPALA_PROFILE_PHASE(profile, PF_Event,
+        upala_event_begin(&event, UE_RootSet);
+        upala_event_put_pubkey(&event, gid);
+        upala_event_emit(&event, fields + SIZE_PUBKEY, op->payload.len - SIZE_PUBKEY));
+
+    return SUCCESS;
+}
+
+/// Data and rewards of the UG_Rewards group `gid` paying out of the pool
+/// of the instruction
+static uint64_t upala_rewards_group(const UpalaContext *ctx,
+                                    const UpalaOperation *op,
+                                    const SolPubkey *gid,
+                                    UpalaGroupData **group,
+                                    UpalaRewards **rewards)
+{
+    *group = upala_group_data(ctx->params, op->group, gid);
+    if (!*group || !SolPubkey_same(op->pool->key, gid))
+    {
+        sol_log("Error: The group account does not match the pool");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+    *rewards = upala_group_rewards(*group);
+    if (!*rewards)
+    {
+        sol_log("Error: The group pays no rewards, UG_Rewards is not set");
+        return ERROR_INVALID_ARGUMENT;
+    }
+    return SUCCESS;
+}
+
+/// UI_Deposit: moves tokens of the manager account into the pool of a
+/// UG_Rewards group, spread over the scores of the members in one step
+///
+/// Payload: gid | amount: u64, the tokens come from the user_at token
+/// account, owned by the manager account. Anybody may deposit
+static uint64_t upala_deposit(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    if (!op->pool || !op->group || !op->user_at)
+    {
+        sol_log("Pool accounts not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+    const SolPubkey *gid = (const SolPubkey *) op->payload.fields;
+    const uint64_t amount = *(const uint64_t *) (op->payload.fields + SIZE_PUBKEY);
+    UpalaGroupData *ug;
+    UpalaRewards *rewards;
+    uint64_t err;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        err = upala_rewards_group(ctx, op, gid, &ug, &rewards));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+    if (rewards->deposited + amount < rewards->deposited)
+    {
+        sol_log("Error: The deposits of the group overflow");
+        return ERROR_INVALID_ARGUMENT;
+    }
+    if (!upala_rewards_spread(rewards, amount, ug->stats.sum))
+    {
+        sol_log("Error: The group has no score to spread the deposit over");
+        return ERROR_INVALID_ARGUMENT;
+    }
+    rewards->held += amount;
+    rewards->deposited += amount;
+
+    UPALA_PROFILE_PHASE(profile, PF_Invoke,
+        err = transfer_tokens(op->user_at, op->pool, ctx->manager, ctx->spl_token, amount));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UpalaEvent event;
+    UPALA_PROFILE_PHASE(profile, PF_Event,
+        upala_event_begin(&event, UE_Deposited);
+        upala_event_put_pubkey(&event, gid);
+        upala_event_put_pubkey(&event, op->user_at->key);
+        upala_event_put(&event, &amount, sizeof (amount));
+        upala_event_emit(&event, NULL, 0));
+    return SUCCESS;
+}
+
+/// UI_Claim: pays a member of a UG_Rewards group the tokens it is owed,
+/// out of the pool, whatever the number of members. Anybody may claim for
+/// the member, the tokens only go to a token account of the member
+///
+/// Payload: gid, the user account is the member and user_at its token
+/// account for the minter
+static uint64_t upala_claim(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    if (!op->pool || !op->group || !op->user || !op->user_at)
+    {
+        sol_log("User accounts not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+    const SolPubkey *gid = (const SolPubkey *) op->payload.fields;
+    UpalaGroupData *ug;
+    UpalaRewards *rewards;
+    uint64_t err;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        err = upala_rewards_group(ctx, op, gid, &ug, &rewards));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+    if (ctx->shards_count > 0 && upala_shard_of(gid, ctx->shards_count) != ctx->shard)
+    {
+        sol_log("Error: The group belongs to another shard");
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    SplAccount user_spl_info;
+    if (!SolPubkey_same(op->user_at->owner, ctx->spl_token->key) ||
+        op->user_at->data_len < SPL_TOKEN_ACCOUNT_DATA_LEN ||
+        !spl_deserialize(op->user_at->data, &user_spl_info) ||
+        !SolPubkey_same(user_spl_info.owner, op->user->key) ||
+        !SolPubkey_same(user_spl_info.mint, ctx->minter->key))
+    {
+        sol_log("Error: The token account is not one of the member");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+
+    uint32_t user;
+    uint64_t pos;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        user = upala_registry_find(ctx->users, op->user->key);
+        pos = user == UPALA_NO_USER ? UINT64_MAX : upala_group_find(ug, user));
+    if (pos == UINT64_MAX)
+    {
+        sol_log("Error: The user is not a member of the group");
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    // A member is never paid what the pool does not hold, the checkpoint
+    // only moves by what is paid and the rest stays to claim
+    const uint64_t pending = upala_group_pending(ug, pos);
+    const uint64_t amount = pending < rewards->held ? pending : rewards->held;
+    upala_group_checkpoints(ug)[pos] += amount;
+    rewards->held -= amount;
+    if (amount == 0)
+    {
+        return SUCCESS;
+    }
+
+    UpalaPoolTransfer transfer;
+    upala_pool_transfer_init(&transfer, ctx, op->pool);
+    UPALA_PROFILE_PHASE(profile, PF_Invoke,
+        err = upala_pool_transfer(&transfer, op->user_at, amount));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UpalaEvent event;
+    UPALA_PROFILE_PHASE(profile, PF_Event,
+        upala_event_begin(&event, UE_Claimed);
+        upala_event_put_pubkey(&event, gid);
+        upala_event_put_pubkey(&event, op->user->key);
+        upala_event_put(&event, &amount, sizeof (amount));
+        upala_event_emit(&event, NULL, 0));
+    return SUCCESS;
+}
+
+/// UI_RemovePool: closes the group account and removes the group
+static uint64_t upala_remove_pool(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    upala_debug("Called the instruction UI_RemovePool");
+    if (!op->pool || !op->group)
+    {
+        sol_log("Group account not included in the instruction");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+
+    const uint64_t err = upala_storage_check(ctx, op->pool->key, true);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    const UpalaGroup *ug;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        ug = upala_find_group(ctx->storage, op->pool->key));
+    if (!ug)
+    {
+        sol_log("Error: The group does not exist");
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    if (!ctx->manager->is_signer || !SolPubkey_same(&ug->manager, ctx->manager->key))
+    {
+        sol_log("Error: Only the group manager can remove the group");
+        return ERROR_MISSING_REQUIRED_SIGNATURES;
+    }
+
+    // The tokens the group owes stay with the members until they claim
+    // them, closing the group would leave them in the pool for good
+    UpalaGroupData *group = upala_group_data(ctx->params, op->group, op->pool->key);
+    const UpalaRewards *rewards = group ? upala_group_rewards(group) : NULL;
+    if (rewards && rewards->held != 0)
+    {
+        sol_log("Error: The group still owes rewards to its members");
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    // Close the group account, its rent goes back to the manager
+    if (group)
+    {
+        *ctx->manager->lamports += *op->group->lamports;
+        *op->group->lamports = 0;
+        sol_memset(op->group->data, 0, op->group->data_len);
+    }
+
+    uint64_t return_value;
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        return_value = upala_remove_group(ctx->storage, op->pool->key);
+        if (return_value == SUCCESS) upala_storage_shrink(ctx));
+    if (return_value == SUCCESS)
+    {
+        UpalaEvent event;
+        UPALA_PROFILE_PHASE(profile, PF_Event,
+            upala_event_begin(&event, UE_GroupRemoved);
+            upala_event_put_pubkey(&event, op->pool->key);
+            upala_event_emit(&event, NULL, 0));
+    }
+    upala_debug("Group removed");
+    return return_value;
+}
+
+/// UI_CleanStorage: drops all the groups of the storage, of the shard
+/// with a sharded storage. Only the authority of the storage cleans it
+static uint64_t upala_clean_storage(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    const uint64_t err = upala_storage_check(ctx, NULL, true);
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    if (!ctx->manager->is_signer || !SolPubkey_same(&ctx->storage->authority, ctx->manager->key))
+    {
+        sol_log("Error: Only the storage authority can clean the storage");
+        return ERROR_MISSING_REQUIRED_SIGNATURES;
+    }
+
+    // The group accounts are left as they are, UI_CreatePool resets
+    // them when the groups are created again
+    UPALA_PROFILE_PHASE(profile, PF_Storage,
+        const uint16_t shards_count = ctx->storage->shards_count;
+        const uint16_t shard = ctx->storage->shard;
+        upala_storage_init(ctx->storage_account, ctx->storage->layout.bump_seed, ctx->manager->key);
+        ctx->storage->shards_count = shards_count;
+        ctx->storage->shard = shard;
+        upala_storage_shrink(ctx));
+
+    UpalaEvent event;
+    UPALA_PROFILE_PHASE(profile, PF_Event,
+        upala_event_begin(&event, UE_StorageCleaned);
+        upala_event_put_pubkey(&event, ctx->storage_account->key);
+        upala_event_emit(&event, NULL, 0));
+
+    return SUCCESS;
+}
+
+/// UI_CreateShard: creates a shard of the storage and its registry
+///
+/// Payload: shards count: u16 | shard: u16. The first shard created
+/// spreads the storage, which must hold no group, over the shards count,
+/// which does not change afterwards. A shard that exists is left as it is.
+static uint64_t upala_create_shard(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    const uint8_t *fields = op->payload.fields;
+    const uint16_t shards_count = (uint16_t) fields[0] | (uint16_t) fields[1] << 8;
+    const uint16_t shard = (uint16_t) fields[2] | (uint16_t) fields[3] << 8;
+    if (shards_count == 0 || shards_count > UPALA_MAX_SHARDS || shard >= shards_count)
+    {
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+
+    UpalaStorage *root = ctx->storage;
+    if (root->shards_count != shards_count)
+    {
+        if (root->shards_count != 0 || root->groups_count != 0)
+        {
+            sol_log("Error: The storage holds groups or has another shards count");
+            return ERROR_INVALID_ARGUMENT;
+        }
+        root->shards_count = shards_count;
+    }
+    ctx->shards_count = shards_count;
+    ctx->shard = shard;
+
+    uint64_t err;
+    SolAccountInfo *account = ctx->shard_account;
+    const SolPubkey *program_id = ctx->params->program_id;
+    if (SolPubkey_same(account->owner, program_id))
+    {
+        err = upala_shard_open(ctx, account UPALA_PROFILE_PASS(profile));
+        if (err == SUCCESS && ctx->shard != shard)
+        {
+            sol_log("Error: Shard address does not match seed derivation");
+            err = INVALID_SEEDS;
+        }
+    }
+    else
+    {
+        uint8_t bump_seed;
+        const uint8_t index[] = {(uint8_t) shard, (uint8_t) (shard >> 8)};
+        const SolSignerSeed seeds[] = {
+            {UPALA_SHARD_SEED, sizeof (UPALA_SHARD_SEED)},
+            {ctx->minter->key->x, SIZE_PUBKEY},
+            {program_id->x, SIZE_PUBKEY},
+            {index, sizeof (index)},
+            {&bump_seed, 1}
+        };
+        SolPubkey key;
+        UPALA_PROFILE_PHASE(profile, PF_Derive,
+            sol_try_find_program_address(seeds, SOL_ARRAY_SIZE(seeds) - 1, program_id, &key, &bump_seed));
+        if (!SolPubkey_same(account->key, &key))
+        {
+            sol_log("Error: Shard address does not match seed derivation");
+            return INVALID_SEEDS;
+        }
+
+        err = upala_provision(ctx, account, seeds, SOL_ARRAY_SIZE(seeds),
+                              upala_storage_data_len(UPALA_STORAGE_INITIAL_CAPACITY), program_id, NULL
+                              UPALA_PROFILE_PASS(profile));
+        if (err == SUCCESS)
+        {
+            UpalaStorage *storage = (UpalaStorage *) account->data;
+            UPALA_PROFILE_PHASE(profile, PF_Storage,
+                upala_storage_init(account, bump_seed, &root->authority);
+                storage->shards_count = shards_count;
+                storage->shard = shard);
+
+            UpalaEvent event;
+            UPALA_PROFILE_PHASE(profile, PF_Event,
+                upala_event_begin(&event, UE_ShardCreated);
+                upala_event_put_pubkey(&event, account->key);
+                upala_event_put(&event, &shard, sizeof (shard));
+                upala_event_put(&event, &shards_count, sizeof (shards_count));
+                upala_event_emit(&event, NULL, 0));
+        }
+    }
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    // The members of the groups of the shard go to its own registry
+    return upala_registry_open(ctx, ctx->registry UPALA_PROFILE_PASS(profile));
+}
+
+/// UI_Migrate: upgrades the accounts of an older layout in place. Every
+/// account still has its first layout, the storage has been checked by
+/// the prologue and the group account, when passed, is checked here; the
+/// upgrades go here with the next layouts
+static uint64_t upala_migrate(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    if (op->group && !upala_group_layout(op->group->data, op->group->data_len))
+    {
+        sol_log("Error: Unknown group layout version");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+    return SUCCESS;
+}
+
+static uint64_t upala_dispatch(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile));
+
+/// Account of a batched operation, `account` is NULL when the operation
+/// does not use it
+static uint64_t upala_batch_account(const UpalaContext *ctx, uint8_t index, SolAccountInfo **account)
+{
+    if (index == UPALA_NO_ACCOUNT)
+    {
+        *account = NULL;
+        return SUCCESS;
+    }
+    if (index >= ctx->params->ka_num)
+    {
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+    *account = &ctx->params->ka[index];
+    return SUCCESS;
+}
+
+/// UI_Batch: runs the operations in order with the context set up once
+///
+/// Payload: count: u8, then count * (instruction: u8 | pool: u8 | group: u8 |
+/// user: u8 | user_at: u8 | len: u16 | payload), the accounts are indexes of
+/// the instruction accounts or UPALA_NO_ACCOUNT. The first failed operation
+/// fails the instruction, so the runtime rolls back the whole batch.
+static uint64_t upala_batch(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    // upala_payload_decode() has checked the operations and their payloads
+    const uint8_t *data = op->payload.entries;
+    for (uint8_t i = 0; i < op->payload.count; i++)
+    {
+        UpalaOperation sub;
+        sub.instruction = (UpalaInstruction) data[0];
+        const uint64_t len = (uint64_t) data[5] | (uint64_t) data[6] << 8;
+        upala_payload_view(&UPALA_PAYLOADS[sub.instruction], data + UPALA_BATCH_OPERATION_LEN, len, &sub.payload);
+
+        uint64_t err = upala_batch_account(ctx, data[1], &sub.pool);
+        if (err == SUCCESS) err = upala_batch_account(ctx, data[2], &sub.group);
+        if (err == SUCCESS) err = upala_batch_account(ctx, data[3], &sub.user);
+        if (err == SUCCESS) err = upala_batch_account(ctx, data[4], &sub.user_at);
+        if (err != SUCCESS)
+        {
+            return err;
+        }
+
+        data += UPALA_BATCH_OPERATION_LEN + len;
+        err = upala_dispatch(ctx, &sub UPALA_PROFILE_PASS(profile));
+        if (err != SUCCESS)
+        {
+            sol_log("Error: Batched operation failed");
+            sol_log_64(0, 0, 0, i, sub.instruction);
+            return err;
+        }
+    }
+
+    return SUCCESS;
+}
+
+/// Handler of an instruction that writes, called with the context set up
+typedef uint64_t (*UpalaHandler)(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile));
+
+const static UpalaHandler UPALA_HANDLERS[] = {
+    [UI_CreatePool]   = upala_create_pool,
+    [UI_EmptyPool]    = upala_empty_pool,
+    [UI_RemovePool]   = upala_remove_pool,
+    [UI_AddUser]      = upala_add_user,
+    [UI_RemoveUser]   = upala_remove_user,
+    [UI_SetScore]     = upala_set_score,
+    [UI_CleanStorage] = upala_clean_storage,
+    [UI_Migrate]      = upala_migrate,
+    [UI_Batch]        = upala_batch,
+    [UI_Distribute]   = upala_distribute,
+    [UI_CreateShard]  = upala_create_shard,
+    [UI_SetRoot]      = upala_set_root,
+    [UI_Deposit]      = upala_deposit,
+    [UI_Claim]        = upala_claim,
+};
+
+static uint64_t upala_dispatch(UpalaContext *ctx, const UpalaOperation *op UPALA_PROFILE_ARG(profile))
+{
+    upala_debug_64(0,0,0,0,op->instruction);
+    const UpalaHandler handler = op->instruction < SOL_ARRAY_SIZE(UPALA_HANDLERS) ? UPALA_HANDLERS[op->instruction] : NULL;
+    if (!handler)
+    {
+        sol_log("Error: Unknown instruction");
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+    return handler(ctx, op UPALA_PROFILE_PASS(profile));
+}
+
+/// Group of a query: the account the program created for the group at
+/// the address of the minter, checked with the bump seed it keeps
+static uint64_t upala_query_group(const SolParameters *params,
+                                  SolAccountInfo *roles[UA_RolesCount],
+                                  UpalaGroupData **group
+                                  UPALA_PROFILE_ARG(profile))
+{
+    const SolAccountInfo *account = roles[UA_Group];
+    *group = SolPubkey_same(account->owner, params->program_id)
+           ? upala_group_layout(account->data, account->data_len)
+           : NULL;
+    if (!*group)
+    {
+        sol_log("Error: Unknown group layout");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+
+    bool valid;
+    const SolSignerSeed seeds[] = {
+        {UPALA_GROUP_SEED, sizeof (UPALA_GROUP_SEED)},
+        {(*group)->key.x, SIZE_PUBKEY},
+        {roles[UA_Minter]->key->x, SIZE_PUBKEY},
+        {params->program_id->x, SIZE_PUBKEY},
+        {&(*group)->layout.bump_seed, 1}
+    };
+    UPALA_PROFILE_PHASE(profile, PF_Derive,
+        valid = upala_check_program_address(seeds, SOL_ARRAY_SIZE(seeds), params->program_id, account->key));
+    if (!valid)
+    {
+        sol_log("Error: Group address does not match seed derivation");
+        return INVALID_SEEDS;
+    }
+    return SUCCESS;
+}
+
+/// Registry of the members of the query group: the one of the minter, and
+/// of the shard of the group in a sharded storage
+static uint64_t upala_query_registry(const SolParameters *params,
+                                     SolAccountInfo *roles[UA_RolesCount],
+                                     const UpalaGroupData *group,
+                                     UpalaRegistry **users)
+{
+    const SolAccountInfo *account = roles[UA_Registry];
+    *users = SolPubkey_same(account->owner, params->program_id)
+           ? upala_registry_layout(account->data, account->data_len)
+           : NULL;
+    if (!*users)
+    {
+        sol_log("Error: Unknown registry layout");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+    if (!upala_pubkey_same(&(*users)->minter, roles[UA_Minter]->key))
+    {
+        sol_log("Error: The registry belongs to another minter");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+    if ((*users)->shards_count > 0 && upala_shard_of(&group->key, (*users)->shards_count) != (*users)->shard)
+    {
+        sol_log("Error: The registry belongs to another shard");
+        return ERROR_INVALID_ACCOUNT_DATA;
+    }
+    return SUCCESS;
+}
+
+/// UI_GetGroup: returns the UQ_Group record of the group
+///
+/// Payload: none
+static uint64_t upala_get_group(UpalaGroupData *group, UpalaRegistry *users, const UpalaPayload *payload,
+                                UpalaResult *result UPALA_PROFILE_ARG(profile))
+{
+    const UpalaMerkle *merkle = upala_group_merkle(group);
+    const uint32_t members = merkle ? merkle->members : group->accounts_count;
+    const uint8_t flags = group->flags;
+    upala_result_begin(result, UQ_Group);
+    upala_result_put_pubkey(result, &group->key);
+    upala_result_put_pubkey(result, &group->manager);
+    upala_result_put(result, &members, sizeof (members));
+    upala_result_put(result, &flags, sizeof (flags));
+    upala_result_put(result, &group->stats.sum, sizeof (uint64_t));
+    upala_result_put(result, &group->stats.min, sizeof (uint64_t));
+    upala_result_put(result, &group->stats.max, sizeof (uint64_t));
+    upala_result_put(result, &group->stats.min_count, sizeof (uint32_t));
+    upala_result_put(result, &group->stats.max_count, sizeof (uint32_t));
+    return SUCCESS;
+}
+
+/// UI_GetMember: returns the UQ_Member record of the user
+///
+/// Payload: uid
+static uint64_t upala_get_member(UpalaGroupData *group, UpalaRegistry *users, const UpalaPayload *payload,
+                                 UpalaResult *result UPALA_PROFILE_ARG(profile))
+{
+    const SolPubkey *uid = (const SolPubkey *) payload->fields;
+    const uint32_t user = upala_registry_find(users, uid);
+    const uint64_t pos = user == UPALA_NO_USER ? UINT64_MAX : upala_group_find(group, user);
+    const uint8_t member = pos != UINT64_MAX;
+    uint32_t position = 0;
+    uint64_t score = 0;
+    uint32_t rank = 0;
+    uint64_t pending = 0;
+    if (member)
+    {
+        const uint32_t *ranks = upala_group_ranks(group);
+        position = (uint32_t) pos;
+        score = upala_group_member(group, pos)->score;
+        rank = ranks ? (uint32_t) upala_group_rank_of(group, ranks, group->accounts_count, pos) : UINT32_MAX;
+        pending = upala_group_pending(group, pos);
+    }
+
+    upala_result_begin(result, UQ_Member);
+    upala_result_put_pubkey(result, uid);
+    upala_result_put(result, &member, sizeof (member));
+    upala_result_put(result, &position, sizeof (position));
+    upala_result_put(result, &score, sizeof (score));
+    upala_result_put(result, &rank, sizeof (rank));
+    upala_result_put(result, &pending, sizeof (pending));
+    return SUCCESS;
+}
+
+/// UI_ListMembers: returns the UQ_Members record of up to `limit` members
+/// from the position `offset`, in the order of the group records
+///
+/// Payload: offset: u32 | limit: u8, one record holds
+/// UPALA_QUERY_MAX_MEMBERS members at most
+static uint64_t upala_list_members(UpalaGroupData *group, UpalaRegistry *users, const UpalaPayload *payload,
+                                   UpalaResult *result UPALA_PROFILE_ARG(profile))
+{
+    const uint8_t *data = payload->fields;
+    const uint32_t offset = *(const uint32_t *) data;
+    uint64_t limit = data[sizeof (uint32_t)];
+    if (limit > UPALA_QUERY_MAX_MEMBERS)
+    {
+        limit = UPALA_QUERY_MAX_MEMBERS;
+    }
+    const uint64_t left = offset < group->accounts_count ? group->accounts_count - offset : 0;
+    const uint8_t count = (uint8_t) (left < limit ? left : limit);
+
+    upala_result_begin(result, UQ_Members);
+    upala_result_put(result, &group->accounts_count, sizeof (uint32_t));
+    upala_result_put(result, &offset, sizeof (offset));
+    upala_result_put(result, &count, sizeof (count));
+    for (uint64_t i = offset; i < offset + count; i++)
+    {
+        const UpalaMember *member = upala_group_member(group, i);
+        const SolPubkey *uid = upala_registry_user(users, member->user);
+        if (!uid)
+        {
+            sol_log("Error: The member is not in the registry");
+            return ERROR_INVALID_ACCOUNT_DATA;
+        }
+        upala_result_put_pubkey(result, uid);
+        upala_result_put(result, &member->score, sizeof (member->score));
+    }
+    return SUCCESS;
+}
+
+/// UI_VerifyMember: checks the proof that the user is a member of the
+/// UG_Merkle group with the score, and returns the UQ_Verified record. A
+/// proof that does not lead to the root fails the instruction, so a
+/// program invoking it gets the answer without reading the record
+///
+/// Payload: uid | score: u64 | depth: u8, then depth * node, the nodes
+/// from the sibling of the leaf up
+static uint64_t upala_verify_member(UpalaGroupData *group, UpalaRegistry *users, const UpalaPayload *payload,
+                                    UpalaResult *result UPALA_PROFILE_ARG(profile))
+{
+    const uint8_t *data = payload->fields;
+    const uint8_t depth = payload->count;
+    if (depth > UPALA_MERKLE_MAX_DEPTH)
+    {
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+
+    const UpalaMerkle *merkle = upala_group_merkle(group);
+    if (!merkle)
+    {
+        sol_log("Error: The group keeps its members, not a root");
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    const SolPubkey *uid = (const SolPubkey *) data;
+    const uint64_t score = *(const uint64_t *) (data + SIZE_PUBKEY);
+    bool valid;
+    UPALA_PROFILE_PHASE(profile, PF_Handler,
+        valid = upala_merkle_verify(&merkle->root, uid, score, (const SolPubkey *) payload->entries, depth));
+    if (!valid)
+    {
+        sol_log("Error: The proof does not lead to the root of the group");
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    upala_result_begin(result, UQ_Verified);
+    upala_result_put_pubkey(result, &group->key);
+    upala_result_put_pubkey(result, uid);
+    upala_result_put(result, &score, sizeof (score));
+    return SUCCESS;
+}
+
+/// Handler of a query instruction, the registry is NULL when the
+/// instruction leaves it out
+typedef uint64_t (*UpalaQueryHandler)(UpalaGroupData *group, UpalaRegistry *users, const UpalaPayload *payload,
+                                      UpalaResult *result UPALA_PROFILE_ARG(profile));
+
+const static UpalaQueryHandler UPALA_QUERIES[] = {
+    [UI_GetGroup]     = upala_get_group,
+    [UI_GetMember]    = upala_get_member,
+    [UI_ListMembers]  = upala_list_members,
+    [UI_VerifyMember] = upala_verify_member,
+};
+
+/// Runs a query instruction: it reads the group and the registry without
+/// the context of the other instructions, takes no signer and writes no
+/// account, its result is the return data
+static uint64_t upala_query(const SolParameters *params,
+                            SolAccountInfo *roles[UA_RolesCount],
+                            const UpalaPayload *payload
+                            UPALA_PROFILE_ARG(profile))
+{
+    const UpalaQueryHandler handler = params->data[0] < SOL_ARRAY_SIZE(UPALA_QUERIES)
+                                    ? UPALA_QUERIES[params->data[0]] : NULL;
+    if (!handler)
+    {
+        sol_log("Error: Unknown instruction");
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+
+    UpalaGroupData *group;
+    uint64_t err = upala_query_group(params, roles, &group UPALA_PROFILE_PASS(profile));
+    UpalaRegistry *users = NULL;
+    if (err == SUCCESS && roles[UA_Registry])
+    {
+        err = upala_query_registry(params, roles, group, &users);
+    }
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UpalaResult result;
+    err = handler(group, users, payload, &result UPALA_PROFILE_PASS(profile));
+    if (err != SUCCESS)
+    {
+        return err;
+    }
+
+    UPALA_PROFILE_PHASE(profile, PF_Event,
+        upala_result_return(&result));
+    return SUCCESS;
+}
+
+/// Assigns the instruction accounts to the roles of the schema, the roles
+/// missing from the schema or left out by the instruction are NULL
+static uint64_t upala_schema_accounts(const UpalaAccountSchema *schema,
+                                      const SolParameters *params,
+                                      SolAccountInfo *roles[UA_RolesCount])
+{
+    if (params->ka_num < upala_schema_count(schema->accounts & ~schema->optional))
+    {
+        sol_log("Error: Instruction accounts missing");
+        return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    }
+
+    uint64_t index = 0;
+    for (size_t role = 0; role < UA_RolesCount; role++)
+    {
+        roles[role] = NULL;
+        if ((schema->accounts & UA(role)) == 0)
+        {
+            continue;
+        }
+        if (index < params->ka_num)
+        {
+            roles[role] = &params->ka[index];
+            if ((schema->writable & UA(role)) && !roles[role]->is_writable)
+            {
+                sol_log("Error: Instruction account must be writable");
+                sol_log_64(0, 0, 0, index, role);
+                return ERROR_INVALID_ARGUMENT;
+            }
+        }
+        index++;
+    }
+    return SUCCESS;
+}
+
+static uint64_t upala_processing(SolParameters *params UPALA_PROFILE_ARG(profile))
+{
+    if (params->data_len == 0)
+    {
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+
+    const UpalaAccountSchema *schema = upala_schema(params->data[0]);
+    if (!schema)
+    {
+        sol_log("Error: Unknown instruction");
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+
+    // The whole payload is checked before any account is looked at
+    UpalaPayload payload;
+    if (!upala_payload_decode(params->data[0], params->data + sizeof (uint8_t), params->data_len - sizeof (uint8_t),
+                              &payload))
+    {
+        sol_log("Error: Invalid instruction data");
+        return ERROR_INVALID_INSTRUCTION_DATA;
+    }
+
+    SolAccountInfo *roles[UA_RolesCount];
+    uint64_t schema_err = upala_schema_accounts(schema, params, roles);
+    if (schema_err != SUCCESS)
+    {
+        return schema_err;
+    }
+    if (schema->query)
+    {
+        return upala_query(params, roles, &payload UPALA_PROFILE_PASS(profile));
+    }
+
+    // Get accounts
+    UpalaContext context;
+    UpalaContext *ctx = &context;
+    ctx->params                 = params;
+    ctx->manager                = roles[UA_Manager];
+    ctx->pools_manager          = roles[UA_PoolsManager];
+    ctx->minter                 = roles[UA_Minter];
+    ctx->system_program         = roles[UA_SystemProgram];
+    ctx->sysvar_rent            = roles[UA_SysvarRent];
+    ctx->spl_token              = roles[UA_SplToken];
+
+    // The CPIs sign with the pools_manager seeds or move lamports of the
+    // manager, they only go to the token and the system programs
+    if (ctx->spl_token && !SolPubkey_same(ctx->spl_token->key, &spl_program_id))
+    {
+        sol_log("Error: The token program is not the SPL Token program");
+        return ERROR_INCORRECT_PROGRAM_ID;
+    }
+    if (ctx->system_program && !SolPubkey_same(ctx->system_program->key, &system_program_id))
+    {
+        sol_log("Error: The system program is not the System program");
+        return ERROR_INCORRECT_PROGRAM_ID;
+    }
+
+    if (ctx->sysvar_rent && !upala_rent_load(ctx->sysvar_rent, &ctx->rent))
+    {
+        sol_log("Error: Rent sysvar not included in the instruction");
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    // The account must be owned by the program in order to modify its data
+    if (!SolPubkey_same(ctx->manager->owner, &system_program_id))
+    {
+        return ERROR_INCORRECT_PROGRAM_ID;
+    }
+
+    // A single operation takes the accounts of its roles
+    UpalaOperation op;
+    op.instruction = (UpalaInstruction) params->data[0];
+    op.pool     = roles[UA_Pool];
+    op.group    = roles[UA_Group];
+    op.user     = roles[UA_User];
+    op.user_at  = roles[UA_UserAt];
+    op.payload  = payload;
+
+    ctx->registry = roles[UA_Registry];
+    ctx->users    = NULL;
+    ctx->shard_account   = roles[UA_Shard];
+    ctx->storage_account = ctx->pools_manager;
+    ctx->shards_count    = 0;
+    ctx->shard           = 0;
+    ctx->storage_len  = ctx->pools_manager->data_len;
+    ctx->registry_len = ctx->registry ? ctx->registry->data_len : 0;
+    ctx->group_lens_count = 0;
+    ctx->pta_seeds[0] = (SolSignerSeed){ctx->minter->key->x, SIZE_PUBKEY};
+    ctx->pta_seeds[1] = (SolSignerSeed){params->program_id->x, SIZE_PUBKEY};
+    ctx->pta_seeds[2] = (SolSignerSeed){&ctx->pta.bump_seed, 1};
+    ctx->pta.seed     = ctx->pta_seeds;
+    ctx->pta.seed_len = SOL_ARRAY_SIZE(ctx->pta_seeds);
+    {
+        if (SolPubkey_same(ctx->pools_manager->owner, params->program_id))
+        {
+            ctx->storage = upala_storage(ctx->pools_manager);
+            if (!ctx->storage)
+            {
+                sol_log("Error: Unknown storage layout");
+                return ERROR_INVALID_ACCOUNT_DATA;
+            }
+
+            // The initialized storage keeps the bump seed
+            bool valid;
+            ctx->pta.key = *ctx->pools_manager->key;
+            ctx->pta.bump_seed = ctx->storage->layout.bump_seed;
+            UPALA_PROFILE_PHASE(profile, PF_Derive,
+                valid = upala_check_program_address(ctx->pta.seed, ctx->pta.seed_len,
+                                                    ctx->params->program_id, &ctx->pta.key));
+            if (!valid)
+            {
+                sol_log("Error: Associated address does not match seed derivation");
+                return INVALID_SEEDS;
+            }
+        }
+        else
+        {
+            UPALA_PROFILE_PHASE(profile, PF_Derive,
+                sol_try_find_program_address(ctx->pta_seeds, SOL_ARRAY_SIZE(ctx->pta_seeds) - 1,
+                                             ctx->params->program_id,
+                                             &ctx->pta.key, &ctx->pta.bump_seed));
+            upala_debug("Finded associated token account id:");
+            upala_debug_pubkey(&ctx->pta.key);
+
+            if (!SolPubkey_same(ctx->pools_manager->key, &ctx->pta.key))
+            {
+                sol_log("Error: Associated address does not match seed derivation");
+                return INVALID_SEEDS;
+            }
+
+            //init pools_manager_account
+            if (!ctx->system_program || !ctx->sysvar_rent)
+            {
+                sol_log("Error: The storage is not created, UI_CreatePool creates it");
+                return ERROR_UNINITIALIZED_ACCOUNT;
+            }
+            const uint64_t err = upala_provision(ctx, ctx->pools_manager, ctx->pta.seed, ctx->pta.seed_len,
+                                                 upala_storage_data_len(UPALA_STORAGE_INITIAL_CAPACITY),
+                                                 params->program_id, NULL
+                                                 UPALA_PROFILE_PASS(profile));
+            if (err != SUCCESS)
+            {
+                return err;
+            }
+
+            UPALA_PROFILE_PHASE(profile, PF_Storage,
+                upala_storage_init(ctx->pools_manager, ctx->pta.bump_seed, ctx->manager->key));
+            ctx->storage = (UpalaStorage *) ctx->pools_manager->data;
+        }
+    }
+
+    // The groups of a sharded storage are in the shard of the instruction,
+    // given by the shard account or by the registry
+    ctx->shards_count = ctx->storage->shards_count;
+    if (ctx->shards_count > 0 && op.instruction != UI_CreateShard)
+    {
+        ctx->storage = NULL;
+        ctx->shard = UPALA_NO_SHARD;
+        if (ctx->shard_account)
+        {
+            const uint64_t err = upala_shard_open(ctx, ctx->shard_account UPALA_PROFILE_PASS(profile));
+            if (err != SUCCESS)
+            {
+                return err;
+            }
+        }
+    }
+
+    if (ctx->registry && op.instruction != UI_CreateShard)
+    {
+        const uint64_t err = upala_registry_open(ctx, ctx->registry UPALA_PROFILE_PASS(profile));
+        if (err != SUCCESS)
+        {
+            return err;
+        }
+    }
+
+    return upala_dispatch(ctx, &op UPALA_PROFILE_PASS(profile));
+}
+
+uint64_t processing(SolParameters *params)
+{
+    UPALA_PROFILE_START(profile, params);
+
+    const uint64_t result = upala_processing(params UPALA_PROFILE_PASS(profile));
+    UPALA_PROFILE_MARK(profile, PF_Handler);
+
+    UPALA_PROFILE_REPORT(profile, result);
+    return result;
+}
+
+static uint64_t transfer_lamports(SolAccountInfo *payer,
+                                  SolAccountInfo *recipient,
+                                  SolAccountInfo *system_program,
+                                  uint64_t        lamports)
+{
     SolAccountMeta accounts[] = {
-        {.pubkey = payer->key,  .is_writable = true, .is_signer = true},
-        {.pubkey = ata->key,    .is_writable = true, .is_signer = false}
+        {.pubkey = payer->key,      .is_writable = true, .is_signer = true},
+        {.pubkey = recipient->key,  .is_writable = true, .is_signer = false}
     };
 
     uint32_t cmd = SI_TRANSFER; // SystemInstruction::Transfer
-    uint8_t data[sizeof (uint32_t) + sizeof(required_lamports)];
+    uint8_t data[sizeof (uint32_t) + sizeof(lamports)];
     sol_memcpy(data, &cmd, sizeof (uint32_t));
-    sol_memcpy(data + sizeof (uint32_t), &required_lamports, sizeof(required_lamports));
+    sol_memcpy(data + sizeof (uint32_t), &lamports, sizeof(lamports));
 #ifdef DEBUG_INSTRUCTION_DATA
     sol_log_array(data, SOL_ARRAY_SIZE(data));
 #endif
@@ -731,20 +3465,113 @@ static uint64_t transfer_to_ata(SolAccountInfo *payer,
 
     const SolAccountInfo account_infos[] = {
         *payer,
-        *ata,
+        *recipient,
         *system_program
     };
 
     return sol_invoke(&instruction, account_infos, SOL_ARRAY_SIZE(account_infos));
 }
 
+static uint64_t transfer_tokens(SolAccountInfo *source,
+                                SolAccountInfo *destination,
+                                SolAccountInfo *owner,
+                                SolAccountInfo *spl_token,
+                                uint64_t        amount)
+{
+    SolAccountMeta arguments[] = {
+        ///   0. `[writable]` The source account.
+        {.pubkey = source->key,       .is_writable = true,  .is_signer = false},
+        ///   1. `[writable]` The destination account.
+        {.pubkey = destination->key,  .is_writable = true,  .is_signer = false},
+        ///   2. `[signer]` The source account's owner/delegate.
+        {.pubkey = owner->key,        .is_writable = false, .is_signer = true}
+    };
+
+    uint8_t data[sizeof (uint8_t) + sizeof (amount)];
+    data[0] = TI_TRANSFER;
+    sol_memcpy(data + sizeof (uint8_t), &amount, sizeof (amount));
+#ifdef DEBUG_INSTRUCTION_DATA
+    sol_log_array(data, SOL_ARRAY_SIZE(data));
+#endif
+
+    const SolInstruction instruction = {
+        spl_token->key,
+        arguments, SOL_ARRAY_SIZE(arguments),
+        data, SOL_ARRAY_SIZE(data)
+    };
+
+    const SolAccountInfo account_infos[] = {
+        *source,
+        *destination,
+        *owner,
+        *spl_token
+    };
+
+    return sol_invoke(&instruction, account_infos, SOL_ARRAY_SIZE(account_infos));
+}
+
+static uint64_t create_account(      SolAccountInfo *payer,
+                                     SolAccountInfo *account,
+                               const SolSignerSeed  *account_signer_seeds,
+                                     uint64_t        account_signer_seeds_len,
+                                     SolAccountInfo *system_program,
+                                     uint64_t        lamports,
+                                     uint64_t        space,
+                               const SolPubkey      *owner)
+{
+    upala_debug("Create the account at the program address");
+
+    SolAccountMeta arguments[] = {
+        // [WRITE, SIGNER] Funding account
+        {.pubkey = payer->key,   .is_writable = true, .is_signer = true},
+        // [WRITE, SIGNER] New account
+        {.pubkey = account->key, .is_writable = true, .is_signer = true}
+    };
+
+    uint32_t cmd = SI_CREATE_ACCOUNT;
+    uint8_t data[sizeof (cmd) + sizeof (lamports) + sizeof (space) + SIZE_PUBKEY];
+    sol_memcpy(data, &cmd, sizeof (cmd));
+    sol_memcpy(data + sizeof (cmd), &lamports, sizeof (lamports));
+    sol_memcpy(data + sizeof (cmd) + sizeof (lamports), &space, sizeof (space));
+    sol_memcpy(data + sizeof (cmd) + sizeof (lamports) + sizeof (space), owner->x, SIZE_PUBKEY);
+#ifdef DEBUG_INSTRUCTION_DATA
+    sol_log_array(data, SOL_ARRAY_SIZE(data));
+#endif
+
+    const SolInstruction instruction = {
+        system_program->key,
+        arguments, SOL_ARRAY_SIZE(arguments),
+        data, SOL_ARRAY_SIZE(data)
+    };
+
+    const SolSignerSeeds signers_seeds[] = {
+        {account_signer_seeds, account_signer_seeds_len}
+    };
+
+    const SolAccountInfo account_infos[] = {
+        *payer,
+        *account,
+        *system_program
+    };
+
+    uint64_t err = sol_invoke_signed(&instruction,
+                      account_infos, SOL_ARRAY_SIZE(account_infos),
+                      signers_seeds, SOL_ARRAY_SIZE(signers_seeds));
+
+    // So that an error does not appear: "failed: non-system instruction changed account size"
+    account->data_len = space;
+    sol_memset(account->data, 0, space);
+
+    return err;
+}
+
 static uint64_t allocate_space_for_ata(      SolAccountInfo *ata,
                                        const SolSignerSeed  *ata_signer_seeds,
                                              uint64_t        ata_signer_seeds_len,
                                              SolAccountInfo *system_program,
                                              uint64_t        allocated_space)
 {
-    sol_log("Allocate space for the associated token account");
+    upala_debug("Allocate space for the associated token account");
 
     SolAccountMeta arguments[] = {
         // [WRITE, SIGNER] New account
@@ -790,9 +3617,9 @@ static uint64_t assign_ata(      SolAccountInfo *ata,
                            const SolSignerSeed  *ata_signer_seeds,
                                  uint64_t        ata_signer_seeds_len,
                                  SolAccountInfo *system_program,
-                                 SolAccountInfo *spl_token)
+                           const SolPubkey      *owner)
 {
-    sol_log("Assign the associated token account to the SPL Token program");
+    upala_debug("Assign the account to the owner program");
 
     SolAccountMeta arguments[] = {
         // [WRITE, SIGNER] Assigned account public key
@@ -802,7 +3629,7 @@ static uint64_t assign_ata(      SolAccountInfo *ata,
     uint32_t cmd = SI_ASSIGN;
     uint8_t data[sizeof(cmd) + SIZE_PUBKEY];
     sol_memcpy(data, &cmd, sizeof(cmd));
-    sol_memcpy(data + sizeof(cmd), spl_token->key->x, SIZE_PUBKEY);
+    sol_memcpy(data + sizeof(cmd), owner->x, SIZE_PUBKEY);
 #ifdef DEBUG_INSTRUCTION_DATA
     sol_log_array(data, SOL_ARRAY_SIZE(data));
 #endif
@@ -832,7 +3659,7 @@ static uint64_t initialize_ata(      SolAccountInfo *ata,
                                      SolAccountInfo *sysvar_rent,
                                      SolAccountInfo *spl_token)
 {
-    sol_log("Initialize the associated token account");
+    upala_debug("Initialize the associated token account");
 
     SolAccountMeta arguments[] = {
         ///   0. `[writable]`  The account to initialize.
@@ -871,13 +3698,33 @@ static uint64_t initialize_ata(      SolAccountInfo *ata,
 
 extern uint64_t entrypoint(const uint8_t *input)
 {
-    SolAccountInfo accounts[10];
-    SolParameters params = (SolParameters){.ka = accounts};
-
-    if (!sol_deserialize(input, &params, SOL_ARRAY_SIZE(accounts)))
+    UpalaInput in;
+    if (!upala_input_parse(input, &in))
     {
         return ERROR_INVALID_ARGUMENT;
     }
 
+    // Only the accounts of the instruction schema are decoded, unless its
+    // payload addresses the accounts by index
+    uint64_t ka_num = in.ka_num;
+    const UpalaAccountSchema *schema = in.data_len > 0 ? upala_schema(in.data[0]) : NULL;
+    if (schema && !schema->indexed && ka_num > upala_schema_count(schema->accounts))
+    {
+        ka_num = upala_schema_count(schema->accounts);
+    }
+
+    SolAccountInfo accounts[UPALA_MAX_ACCOUNTS];
+    for (uint64_t i = 0; i < ka_num; i++)
+    {
+        upala_input_account(&in, i, &accounts[i]);
+    }
+
+    SolParameters params = {
+        .ka         = accounts,
+        .ka_num     = ka_num,
+        .data       = in.data,
+        .data_len   = in.data_len,
+        .program_id = in.program_id
+    };
     return processing(&params);
 }
@@ -0,0 +1,109 @@
+#pragma once
+/**
+ * @brief Lazy reader of the serialized program input
+ *
+ * sol_deserialize() decodes every account of the instruction. The reader
+ * walks the input once, reading no more than the data length of each
+ * account to find the next one, and decodes an account only when it is
+ * asked for. The decoded accounts point into the input, as the ones of
+ * sol_deserialize() do, so the program writes the accounts in place.
+ *
+ * Layout of an account in the input:
+ *   duplicate: u8 (UPALA_INPUT_NOT_DUPLICATE or the index of an earlier
+ *   account, then 7 bytes of padding) | is_signer: u8 | is_writable: u8 |
+ *   executable: u8 | padding: 4 | key | owner | lamports: u64 |
+ *   data_len: u64 | data | MAX_PERMITTED_DATA_INCREASE spare bytes, up to
+ *   8-byte alignment | rent_epoch: u64
+ * The accounts are followed by data_len: u64 | data | program_id.
+ */
+#include <solana_sdk.h>
+
+/// Accounts of an instruction the program reads, enough for the batches
+/// and the distributions to address their recipients
+#define UPALA_MAX_ACCOUNTS 32
+
+/// First byte of an account that is not a duplicate of an earlier one
+#define UPALA_INPUT_NOT_DUPLICATE UINT8_MAX
+
+typedef struct
+{
+    const uint8_t    *accounts[UPALA_MAX_ACCOUNTS];  // Start of each account in the input
+    uint64_t          ka_num;                        // Accounts read, at most UPALA_MAX_ACCOUNTS
+    const uint8_t    *data;
+    uint64_t          data_len;
+    const SolPubkey  *program_id;
+} UpalaInput;
+
+/// Offset of the data length in an account that is not a duplicate
+#define UPALA_INPUT_DATA_LEN (4 * sizeof (uint8_t) + sizeof (uint32_t) + 2 * SIZE_PUBKEY + sizeof (uint64_t))
+
+static const uint8_t *upala_input_align(const uint8_t *input)
+{
+    return (const uint8_t *)(((uint64_t) input + sizeof (uint64_t) - 1) & ~(uint64_t)(sizeof (uint64_t) - 1));
+}
+
+/// Finds the accounts and the instruction data, the accounts past
+/// UPALA_MAX_ACCOUNTS are skipped
+static bool upala_input_parse(const uint8_t *input, UpalaInput *in)
+{
+    if (NULL == input || NULL == in)
+    {
+        return false;
+    }
+
+    const uint64_t ka_num = *(uint64_t *) input;
+    input += sizeof (uint64_t);
+    in->ka_num = ka_num < UPALA_MAX_ACCOUNTS ? ka_num : UPALA_MAX_ACCOUNTS;
+
+    for (uint64_t i = 0; i < ka_num; i++)
+    {
+        if (i < UPALA_MAX_ACCOUNTS)
+        {
+            in->accounts[i] = input;
+        }
+        if (input[0] != UPALA_INPUT_NOT_DUPLICATE)
+        {
+            input += sizeof (uint64_t);
+            continue;
+        }
+
+        const uint64_t data_len = *(uint64_t *)(input + UPALA_INPUT_DATA_LEN);
+        input += UPALA_INPUT_DATA_LEN + sizeof (uint64_t) + data_len + MAX_PERMITTED_DATA_INCREASE;
+        input = upala_input_align(input) + sizeof (uint64_t);
+    }
+
+    in->data_len = *(uint64_t *) input;
+    input += sizeof (uint64_t);
+    in->data = input;
+    input += in->data_len;
+    in->program_id = (const SolPubkey *) input;
+    return true;
+}
+
+/// Decodes the account `index` of the input, below `in->ka_num`
+static void upala_input_account(const UpalaInput *in, uint64_t index, SolAccountInfo *account)
+{
+    const uint8_t *input = in->accounts[index];
+    if (input[0] != UPALA_INPUT_NOT_DUPLICATE)
+    {
+        // A duplicate refers to an earlier account, which is not one
+        input = in->accounts[input[0]];
+    }
+
+    account->is_signer   = input[1];
+    account->is_writable = input[2];
+    account->executable  = input[3];
+    input += 4 * sizeof (uint8_t) + sizeof (uint32_t);
+
+    account->key = (SolPubkey *) input;
+    input += SIZE_PUBKEY;
+    account->owner = (SolPubkey *) input;
+    input += SIZE_PUBKEY;
+    account->lamports = (uint64_t *) input;
+    input += sizeof (uint64_t);
+    account->data_len = *(uint64_t *) input;
+    input += sizeof (uint64_t);
+    account->data = (uint8_t *) input;
+    input += account->data_len + MAX_PERMITTED_DATA_INCREASE;
+    account->rent_epoch = *(uint64_t *) upala_input_align(input);
+}
@@ -1,5 +1,5 @@
 #pragma once
-#include "/home/boris/.local/share/solana/install/releases/1.6.10/solana-release/bin/sdk/bpf/c/inc/solana_sdk.h"
+#include <solana_sdk.h>
 
 //ATokenGPvbdGVxr1b2hvZbsiqW5xWH25efTNsLJA8knL
 const SolPubkey associated_token_program_id = (SolPubkey){.x={
@@ -0,0 +1,134 @@
+#pragma once
+/**
+ * @brief Layout of the accounts owned by the Upala program
+ *
+ * The data of every account starts with an UpalaLayout header: the magic,
+ * the kind and the version of the layout, the canonical bump seed of the
+ * account address, the bytes the layout may use and the bytes in use.
+ * Records are reached through upala_layout_at(), which checks them
+ * against the bytes in use and their alignment.
+ *
+ * A layout of an older version is upgraded in place by UI_Migrate, one
+ * version step after another. Every kind still has its first version.
+ */
+#include <solana_sdk.h>
+
+/// "UPLA" read as a little-endian word
+#define UPALA_LAYOUT_MAGIC 0x414c5055
+
+/// Alignment of the records in the account data
+#define UPALA_RECORD_ALIGN 8
+
+/// Rounds `offset` up to the record alignment
+#define UPALA_ALIGN(offset) (((offset) + UPALA_RECORD_ALIGN - 1) & ~(uint64_t)(UPALA_RECORD_ALIGN - 1))
+
+typedef enum
+{
+    UL_Storage = 1,   // pools_manager
+    UL_Group,         // Group account
+    UL_Registry,      // Registry of the user keys
+} UpalaLayoutKind;
+
+typedef struct
+{
+    uint32_t  magic;
+    uint8_t   kind;
+    uint8_t   version;
+    uint8_t   bump_seed;    // Canonical bump seed of the account address
+    uint8_t   reserved;
+    uint32_t  capacity;     // Bytes of the account data the layout may use
+    uint32_t  used;         // Bytes in use, the header included
+} UpalaLayout;
+
+_Static_assert(sizeof (UpalaLayout) % UPALA_RECORD_ALIGN == 0,
+               "The records following the layout header must stay aligned");
+
+static void upala_layout_init(UpalaLayout *layout, UpalaLayoutKind kind, uint8_t version,
+                              uint8_t bump_seed, uint64_t capacity, uint64_t used)
+{
+    layout->magic = UPALA_LAYOUT_MAGIC;
+    layout->kind = (uint8_t) kind;
+    layout->version = version;
+    layout->bump_seed = bump_seed;
+    layout->reserved = 0;
+    layout->capacity = (uint32_t) capacity;
+    layout->used = (uint32_t) used;
+}
+
+/// Header of `len` bytes of account data, NULL unless they hold a layout
+/// of `kind` with sizes consistent with the data
+static UpalaLayout *upala_layout_data(uint8_t *data, uint64_t len, UpalaLayoutKind kind)
+{
+    if (len < sizeof (UpalaLayout))
+    {
+        return NULL;
+    }
+
+    UpalaLayout *layout = (UpalaLayout *) data;
+    if (layout->magic != UPALA_LAYOUT_MAGIC || layout->kind != kind ||
+        layout->capacity > len ||
+        layout->used < sizeof (UpalaLayout) || layout->used > layout->capacity)
+    {
+        return NULL;
+    }
+    return layout;
+}
+
+/// Header of the account data, NULL unless the data holds a layout of
+/// `kind` with sizes consistent with the account
+static UpalaLayout *upala_layout(const SolAccountInfo *account, UpalaLayoutKind kind)
+{
+    return upala_layout_data(account->data, account->data_len, kind);
+}
+
+/// Version of the layout of `kind` held by the account, 0 for the data
+/// written before the layouts had a header
+static uint8_t upala_layout_version(const SolAccountInfo *account, UpalaLayoutKind kind)
+{
+    const UpalaLayout *layout = upala_layout(account, kind);
+    return layout ? layout->version : 0;
+}
+
+/// Pointer to `len` bytes at `offset` of the data in use, NULL when they
+/// are out of the bytes in use or `offset` is not aligned to `align`
+static void *upala_layout_at(UpalaLayout *layout, uint64_t offset, uint64_t len, uint64_t align)
+{
+    if (offset % align != 0 || offset > layout->used || len > layout->used - offset)
+    {
+        return NULL;
+    }
+    return (uint8_t *) layout + offset;
+}
+
+#define UPALA_LAYOUT_AT(layout, type, offset) \
+    ((type *) upala_layout_at(layout, offset, sizeof (type), _Alignof (type)))
+
+/// Changes the bytes in use, fails when they do not fit the capacity
+static bool upala_layout_use(UpalaLayout *layout, uint64_t used)
+{
+    if (used < sizeof (UpalaLayout) || used > layout->capacity)
+    {
+        return false;
+    }
+    layout->used = (uint32_t) used;
+    return true;
+}
+
+/// Moves `len` bytes within the account data, the ranges may overlap
+static void upala_layout_move(uint8_t *data, uint64_t from, uint64_t to, uint64_t len)
+{
+    if (to > from)
+    {
+        for (uint64_t i = len; i > 0; i--)
+        {
+            data[to + i - 1] = data[from + i - 1];
+        }
+    }
+    else
+    {
+        for (uint64_t i = 0; i < len; i++)
+        {
+            data[to + i] = data[from + i];
+        }
+    }
+}
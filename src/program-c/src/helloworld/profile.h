@@ -0,0 +1,107 @@
+#pragma once
+/**
+ * @brief Compute units profiling of the Upala instructions
+ *
+ * Define UPALA_PROFILE to build the program with the checkpoints, the
+ * production build carries none of them. Needs an SDK providing
+ * sol_remaining_compute_units().
+ */
+#include <solana_sdk.h>
+
+//#define UPALA_PROFILE
+
+typedef enum
+{
+    PF_Derive,       // Program address search and checks
+    PF_Storage,      // pools_manager init and group lookup in the storage
+    PF_Create,       // create_account, or top-up, allocate and assign
+    PF_Initialize,   // initialize_ata
+    PF_Invoke,       // Token program transfer
+    PF_Event,        // Event records
+    PF_Log,          // Debug dumps
+    PF_Handler,      // Instruction handler body
+    PF_PhasesCount
+} UpalaProfilePhase;
+
+#ifdef UPALA_PROFILE
+
+typedef struct
+{
+    uint64_t  instruction;
+    uint64_t  entry;                    // Remaining units at the entry
+    uint64_t  checkpoint;               // Remaining units at the last checkpoint
+    uint64_t  overhead;                 // Units spent by one checkpoint
+    uint64_t  units[PF_PhasesCount];
+    uint16_t  calls[PF_PhasesCount];
+} UpalaProfile;
+
+static void upala_profile_start(UpalaProfile *profile, const SolParameters *params)
+{
+    sol_memset(profile, 0, sizeof (UpalaProfile));
+    profile->instruction = params->data_len ? params->data[0] : UINT8_MAX;
+    profile->entry = sol_remaining_compute_units();
+    profile->checkpoint = sol_remaining_compute_units();
+    profile->overhead = profile->entry - profile->checkpoint;
+}
+
+/// Charges the units spent since the last checkpoint to `phase`
+static void upala_profile_mark(UpalaProfile *profile, UpalaProfilePhase phase)
+{
+    const uint64_t now = sol_remaining_compute_units();
+    const uint64_t spent = profile->checkpoint - now;
+    profile->units[phase] += spent > profile->overhead ? spent - profile->overhead : 0;
+    profile->calls[phase] += 1;
+    profile->checkpoint = sol_remaining_compute_units();
+}
+
+/// Bytes taken from the heap: the SDK bump allocator keeps its position in
+/// the first word of the heap and hands out memory downwards from the end,
+/// nothing is freed, so this is also the high-water mark
+static uint64_t upala_heap_used(void)
+{
+    const uint64_t position = *(const uint64_t *) HEAP_START_ADDRESS;
+    return position ? HEAP_START_ADDRESS + HEAP_LENGTH - position : 0;
+}
+
+/// One line per instruction: instruction, entry units, spent units, result;
+/// one line for the heap: instruction, bytes used, heap length;
+/// then one line per phase that was hit: instruction, phase, calls, units
+static void upala_profile_report(const UpalaProfile *profile, uint64_t result)
+{
+    const uint64_t instruction = profile->instruction;
+    sol_log("Upala profile:");
+    sol_log_64(instruction, PF_PhasesCount, profile->entry,
+               profile->entry - sol_remaining_compute_units(), result);
+    sol_log_64(instruction, PF_PhasesCount, upala_heap_used(), HEAP_LENGTH, 0);
+    for (size_t i = 0; i < PF_PhasesCount; i++)
+    {
+        if (profile->calls[i])
+        {
+            sol_log_64(instruction, i, profile->calls[i], profile->units[i], 0);
+        }
+    }
+}
+
+#define UPALA_PROFILE_ARG(profile)      , UpalaProfile *profile
+#define UPALA_PROFILE_PASS(profile)     , profile
+#define UPALA_PROFILE_START(profile, params) \
+                                        UpalaProfile profile##_data; \
+                                        UpalaProfile *profile = &profile##_data; \
+                                        upala_profile_start(profile, params)
+#define UPALA_PROFILE_MARK(profile, phase) upala_profile_mark(profile, phase)
+#define UPALA_PROFILE_REPORT(profile, result) upala_profile_report(profile, result)
+
+#else
+
+#define UPALA_PROFILE_ARG(profile)
+#define UPALA_PROFILE_PASS(profile)
+#define UPALA_PROFILE_START(profile, params)
+#define UPALA_PROFILE_MARK(profile, phase)
+#define UPALA_PROFILE_REPORT(profile, result)
+
+#endif
+
+/// Runs the statement as a profiled phase, the units spent before it are
+/// charged to the handler body
+#define UPALA_PROFILE_PHASE(profile, phase, ...) \
+    do { UPALA_PROFILE_MARK(profile, PF_Handler); __VA_ARGS__; UPALA_PROFILE_MARK(profile, phase); } while (0)
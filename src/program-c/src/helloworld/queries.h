@@ -0,0 +1,56 @@
+#pragma once
+/**
+ * @brief Upala query results
+ *
+ * The query instructions write no account: they answer with one binary
+ * record set by sol_set_return_data, read by the client from a simulated
+ * transaction. The first field of a record is the UpalaQueryKind byte,
+ * the fields are little-endian and not padded, as the events are. Needs
+ * an SDK providing sol_set_return_data().
+ */
+#include <solana_sdk.h>
+
+typedef enum
+{
+    UQ_Group = 1,   // kind | gid | manager | members: u32 | flags: u8 | sum: u64 | min: u64 | max: u64 |
+                    // min count: u32 | max count: u32
+    UQ_Member,      // kind | uid | member: u8 | position: u32 | score: u64 | rank: u32 | pending: u64,
+                    // the rank is UINT32_MAX without UG_ScoreIndex, the tokens pending a claim 0 without
+                    // UG_Rewards; member 0 and the other fields 0 for a non-member
+    UQ_Members,     // kind | members: u32 | offset: u32 | count: u8, then count * (uid | score: u64)
+    UQ_Verified,    // kind | gid | uid | score: u64, the proof of the member is valid
+} UpalaQueryKind;
+
+/// Bytes of UQ_Members before its members
+#define UPALA_QUERY_MEMBERS_HEADER (sizeof (uint8_t) + 2 * sizeof (uint32_t) + sizeof (uint8_t))
+
+/// Members one UQ_Members record holds at most
+#define UPALA_QUERY_MAX_MEMBERS ((MAX_RETURN_DATA - UPALA_QUERY_MEMBERS_HEADER) / (SIZE_PUBKEY + sizeof (uint64_t)))
+
+typedef struct
+{
+    uint8_t  data[MAX_RETURN_DATA];
+    uint64_t len;
+} UpalaResult;
+
+static void upala_result_begin(UpalaResult *result, UpalaQueryKind kind)
+{
+    result->data[0] = (uint8_t) kind;
+    result->len = sizeof (uint8_t);
+}
+
+static void upala_result_put(UpalaResult *result, const void *value, uint64_t len)
+{
+    sol_memcpy(result->data + result->len, value, len);
+    result->len += len;
+}
+
+static void upala_result_put_pubkey(UpalaResult *result, const SolPubkey *key)
+{
+    upala_result_put(result, key->x, SIZE_PUBKEY);
+}
+
+static void upala_result_return(const UpalaResult *result)
+{
+    sol_set_return_data(result->data, result->len);
+}
@@ -1,33 +1,1224 @@
 #include "helloworld.c"
+#include "../../host/fixture.h"
 #include <criterion/criterion.h>
 
-Test(hello, sanity) {
-  uint8_t instruction_data[] = {};
-  SolPubkey program_id = {.x = {
-                              1,
-                          }};
-  SolPubkey key = {.x = {
-                       2,
-                   }};
-  uint64_t lamports = 1;
-  uint8_t data[] = {0, 0, 0, 0};
-  SolAccountInfo accounts[] = {{
-      &key,
-      &lamports,
-      sizeof(data),
-      data,
-      &program_id,
-      0,
-      true,
-      true,
-      false,
-  }};
-  SolParameters params = {accounts, sizeof(accounts), instruction_data,
-                          sizeof(instruction_data), &program_id};
-
-  cr_assert(0 == *(uint32_t *)data);
-  cr_assert(SUCCESS == helloworld(&params));
-  cr_assert(1 == *(uint32_t *)data);
-  cr_assert(SUCCESS == helloworld(&params));
-  cr_assert(2 == *(uint32_t *)data);
+/// Decoded arguments of a recorded create-account invocation
+static uint64_t created_lamports(const SolHostCall *call)
+{
+    uint64_t lamports;
+    sol_memcpy(&lamports, call->data + sizeof (uint32_t), sizeof (lamports));
+    return lamports;
+}
+
+static uint64_t transferred_amount(const SolHostCall *call)
+{
+    uint64_t amount;
+    sol_memcpy(&amount, call->data + sizeof (uint8_t), sizeof (amount));
+    return amount;
+}
+
+Test(rent, minimum_balance) {
+    cr_assert(rent_exempt_minimum(&HOST_RENT, SPL_TOKEN_ACCOUNT_DATA_LEN) == 2039280);
+    cr_assert(rent_exempt_minimum(&HOST_RENT, MAX_PERMITTED_DATA_INCREASE) ==
+              (ACCOUNT_STORAGE_OVERHEAD + MAX_PERMITTED_DATA_INCREASE) * 3480 * 2);
+
+    const UpalaRent half = {3480, 0x3fe0000000000000ull};
+    cr_assert(rent_exempt_minimum(&half, 0) == ACCOUNT_STORAGE_OVERHEAD * 3480 / 2);
+}
+
+Test(storage, insert_find_remove) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    UpalaContext ctx;
+    host_world_context(w, &ctx);
+    UpalaStorage *storage = ctx.storage;
+    cr_assert(storage && storage->groups_count == 1);
+    cr_assert(upala_storage_capacity(storage) == UPALA_STORAGE_INITIAL_CAPACITY);
+
+    UpalaGroup ug = {{{0}}, w->keys[UA_Manager]};
+    for (uint32_t i = 1; i < UPALA_STORAGE_INITIAL_CAPACITY; i++)
+    {
+        ug.key = host_user(i);
+        cr_assert(upala_insert_group(storage, &ug) == SUCCESS);
+    }
+    ug.key = host_user(UPALA_STORAGE_INITIAL_CAPACITY);
+    cr_assert(upala_insert_group(storage, &ug) == ERROR_ACCOUNT_DATA_TOO_SMALL);
+
+    // The storage grows past MAX_PERMITTED_DATA_INCREASE over several instructions
+    const uint32_t groups = 400;
+    for (uint32_t i = UPALA_STORAGE_INITIAL_CAPACITY; i < groups; i++)
+    {
+        ug.key = host_user(i);
+        if (upala_storage_reserve(&ctx, storage->groups_count + 1) != SUCCESS)
+        {
+            ctx.storage_len = ctx.pools_manager->data_len;
+            cr_assert(upala_storage_reserve(&ctx, storage->groups_count + 1) == SUCCESS);
+        }
+        cr_assert(upala_insert_group(storage, &ug) == SUCCESS);
+    }
+    cr_assert(ctx.pools_manager->data_len > MAX_PERMITTED_DATA_INCREASE);
+    cr_assert(host_len(ctx.pools_manager) == ctx.pools_manager->data_len);
+    cr_assert(sol_host_calls_len > 0);
+    cr_assert(upala_storage_reserve(&ctx, groups + MAX_PERMITTED_DATA_INCREASE) == ERROR_ACCOUNT_DATA_TOO_SMALL);
+
+    for (uint32_t i = 1; i < groups; i++)
+    {
+        const SolPubkey gid = host_user(i);
+        const UpalaGroup *found = upala_find_group(storage, &gid);
+        cr_assert(found && SolPubkey_same(&found->key, &gid));
+        if (i % 2 == 0)
+        {
+            cr_assert(upala_remove_group(storage, &gid) == SUCCESS);
+        }
+    }
+    cr_assert(upala_storage(ctx.pools_manager));
+    for (uint32_t i = 1; i < groups; i++)
+    {
+        const SolPubkey gid = host_user(i);
+        cr_assert((upala_find_group(storage, &gid) != NULL) == (i % 2 == 1));
+    }
+    const uint32_t *index = upala_storage_index(storage);
+    for (uint32_t i = 1; i < storage->groups_count; i++)
+    {
+        cr_assert(upala_pubkey_cmp(&upala_storage_group(storage, index[i - 1])->key,
+                                   &upala_storage_group(storage, index[i])->key) < 0);
+    }
+    host_world_free(w);
+}
+
+Test(storage, shrink) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    UpalaContext ctx;
+    host_world_context(w, &ctx);
+    UpalaStorage *storage = ctx.storage;
+
+    UpalaGroup ug = {{{0}}, w->keys[UA_Manager]};
+    for (uint32_t i = 1; i < 64; i++)
+    {
+        ug.key = host_user(i);
+        cr_assert(upala_storage_reserve(&ctx, storage->groups_count + 1) == SUCCESS);
+        cr_assert(upala_insert_group(storage, &ug) == SUCCESS);
+    }
+    cr_assert(upala_storage_capacity(storage) == 64);
+    w->lamports[UA_PoolsManager] = rent_exempt_minimum(&HOST_RENT, ctx.pools_manager->data_len);
+
+    // A quarter full storage halves, the rent above its minimum is refunded
+    for (uint32_t i = 17; i < 64; i++)
+    {
+        const SolPubkey gid = host_user(i);
+        cr_assert(upala_remove_group(storage, &gid) == SUCCESS);
+    }
+    upala_storage_shrink(&ctx);
+    cr_assert(upala_storage_capacity(storage) == 64);
+
+    const uint64_t balance = w->lamports[UA_Manager] + w->lamports[UA_PoolsManager];
+    const SolPubkey last = host_user(16);
+    cr_assert(upala_remove_group(storage, &last) == SUCCESS);
+    upala_storage_shrink(&ctx);
+    cr_assert(upala_storage_capacity(storage) == 32 && storage->groups_count == 16);
+    cr_assert(ctx.pools_manager->data_len == upala_storage_data_len(32));
+    cr_assert(host_len(ctx.pools_manager) == upala_storage_data_len(32));
+    cr_assert(w->lamports[UA_PoolsManager] == rent_exempt_minimum(&HOST_RENT, upala_storage_data_len(32)));
+    cr_assert(w->lamports[UA_Manager] + w->lamports[UA_PoolsManager] == balance);
+    cr_assert(upala_storage(ctx.pools_manager));
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        const SolPubkey gid = i == 0 ? w->keys[UA_Pool] : host_user(i);
+        cr_assert(upala_find_group(storage, &gid));
+    }
+
+    // Emptied, it goes back to its initial capacity
+    upala_storage_init(ctx.pools_manager, UINT8_MAX, &w->keys[UA_Manager]);
+    upala_storage_shrink(&ctx);
+    cr_assert(upala_storage_capacity(storage) == UPALA_STORAGE_INITIAL_CAPACITY);
+    cr_assert(upala_storage(ctx.pools_manager) && storage->groups_count == 0);
+    host_world_free(w);
+}
+
+Test(storage, clean_authority) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    const uint8_t data[] = {UI_CleanStorage};
+    cr_assert(SolPubkey_same(&host_world_storage(w)->authority, &w->keys[UA_Manager]));
+
+    w->accounts[UA_Manager].is_signer = false;
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == ERROR_MISSING_REQUIRED_SIGNATURES);
+    w->accounts[UA_Manager].is_signer = true;
+    host_world_storage(w)->authority = host_user(99);
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == ERROR_MISSING_REQUIRED_SIGNATURES);
+    cr_assert(host_world_storage(w)->groups_count == 1);
+
+    // The authority cleans it and gets the rent above the minimum
+    host_world_storage(w)->authority = w->keys[UA_Manager];
+    w->lamports[UA_PoolsManager] += 100;
+    const uint64_t balance = w->lamports[UA_Manager];
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == SUCCESS);
+    cr_assert(host_world_storage(w)->groups_count == 0);
+    cr_assert(SolPubkey_same(&host_world_storage(w)->authority, &w->keys[UA_Manager]));
+    cr_assert(w->lamports[UA_Manager] == balance + 100);
+    host_world_free(w);
+}
+
+Test(instruction, create_pool) {
+    HostWorld *w = host_world_new();
+
+    uint8_t set_score[1 + SIZE_PUBKEY + 1] = {UI_SetScore};
+    cr_assert(host_world_run(w, set_score, sizeof (set_score), 0) == ERROR_UNINITIALIZED_ACCOUNT);
+
+    // The payload is checked before the storage is created
+    const uint8_t long_create[] = {UI_CreatePool, 0, 0};
+    cr_assert(host_world_run(w, long_create, sizeof (long_create), 0) == ERROR_INVALID_INSTRUCTION_DATA);
+    cr_assert(sol_host_calls_len == 0);
+
+    const uint8_t create[] = {UI_CreatePool};
+    cr_assert(host_world_run(w, create, sizeof (create), 0) == SUCCESS);
+
+    // pools_manager, pool and its initialization, group
+    cr_assert(sol_host_calls_len == 4);
+    const SolHostCall *calls = sol_host_calls;
+    cr_assert(calls[0].signed_by_program && SolPubkey_same(&calls[0].accounts[1], &w->keys[UA_PoolsManager]));
+    cr_assert(created_lamports(&calls[0]) == rent_exempt_minimum(&HOST_RENT, upala_storage_data_len(UPALA_STORAGE_INITIAL_CAPACITY)));
+    cr_assert(SolPubkey_same(&calls[1].accounts[1], &w->keys[UA_Pool]));
+    cr_assert(created_lamports(&calls[1]) == rent_exempt_minimum(&HOST_RENT, SPL_TOKEN_ACCOUNT_DATA_LEN));
+    cr_assert(!calls[2].signed_by_program && SolPubkey_same(&calls[2].program_id, &w->keys[UA_SplToken]));
+    cr_assert(SolPubkey_same(&calls[3].accounts[1], &w->keys[UA_Group]));
+    cr_assert(created_lamports(&calls[3]) ==
+              rent_exempt_minimum(&HOST_RENT, upala_group_data_len(UPALA_GROUP_INITIAL_CAPACITY, 0)));
+
+    const uint8_t unknown_flags[] = {UI_CreatePool, UG_Rewards << 1};
+    cr_assert(host_world_run(w, unknown_flags, sizeof (unknown_flags), 0) == ERROR_INVALID_INSTRUCTION_DATA);
+    const uint8_t both_flags[] = {UI_CreatePool, UG_ScoreIndex | UG_Merkle};
+    cr_assert(host_world_run(w, both_flags, sizeof (both_flags), 0) == ERROR_INVALID_INSTRUCTION_DATA);
+    const uint8_t merkle_rewards[] = {UI_CreatePool, UG_Merkle | UG_Rewards};
+    cr_assert(host_world_run(w, merkle_rewards, sizeof (merkle_rewards), 0) == ERROR_INVALID_INSTRUCTION_DATA);
+
+    w->keys[UA_Group] = host_user(0);
+    cr_assert(host_world_run(w, create, sizeof (create), 0) == INVALID_SEEDS);
+    host_world_free(w);
+}
+
+Test(instruction, add_set_remove) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    const SolPubkey *gid = &w->keys[UA_Pool];
+    uint8_t data[1 + SIZE_PUBKEY + 1 + UINT8_MAX * sizeof (UpalaAccount)];
+
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+    uint64_t len = host_members(data, UI_AddUser, gid, 50, 20);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    UpalaGroupData *gd = host_world_group(w);
+    cr_assert(gd->accounts_count == 20 && host_world_member(w, 69)->score == 69);
+    cr_assert(host_world_registry(w)->users_count == 20);
+    cr_assert(gd->layout.capacity == host_len(&w->accounts[UA_Group]));
+    cr_assert(gd->layout.used == upala_group_used(gd, 20));
+    cr_assert(sol_host_calls_len == 1);   // The rent of the grown group account
+
+    // A member is added once, in a payload and across them
+    len = host_members(data, UI_AddUser, gid, 69, 2);
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ARGUMENT && gd->accounts_count == 20);
+    len = host_members(data, UI_AddUser, gid, 70, 2);
+    sol_memcpy(data + 1 + SIZE_PUBKEY + 1 + sizeof (UpalaAccount), data + 1 + SIZE_PUBKEY + 1, SIZE_PUBKEY);
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ARGUMENT && gd->accounts_count == 20);
+
+    len = host_members(data, UI_SetScore, gid, 60, 2);
+    const uint64_t score = 500;
+    sol_memcpy(data + 1 + SIZE_PUBKEY + 1 + SIZE_PUBKEY, &score, sizeof (score));
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    cr_assert(host_world_member(w, 60)->score == 500 && host_world_member(w, 61)->score == 61);
+
+    len = host_members(data, UI_RemoveUser, gid, 67, 3);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    cr_assert(gd->accounts_count == 17 && gd->layout.used == upala_group_used(gd, 17));
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ARGUMENT);
+
+    // The removed users stay registered, an unknown key is no member
+    const SolPubkey removed = host_user(67);
+    cr_assert(upala_registry_find(host_world_registry(w), &removed) != UPALA_NO_USER && !host_world_member(w, 67));
+    len = host_members(data, UI_SetScore, gid, 90, 1);
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ARGUMENT);
+
+    len = host_members(data, UI_SetScore, gid, 50, 1);
+    w->accounts[UA_Manager].is_signer = false;
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_MISSING_REQUIRED_SIGNATURES);
+    w->accounts[UA_Manager].is_signer = true;
+    w->accounts[UA_Group].is_writable = false;
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ARGUMENT);
+    w->accounts[UA_Group].is_writable = true;
+    ((UpalaRegistry *) w->accounts[UA_Registry].data)->minter = host_user(1);
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ACCOUNT_DATA);
+    host_world_free(w);
+}
+
+Test(query, group_member_list) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, UG_ScoreIndex);
+    const SolPubkey *gid = &w->keys[UA_Pool];
+    uint8_t data[1 + SIZE_PUBKEY + 1 + UINT8_MAX * sizeof (UpalaAccount)];
+
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+    uint64_t len = host_members(data, UI_AddUser, gid, 50, 30);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+
+    // The queries take no signer and write no account
+    for (int i = 0; i < HOST_ACCOUNTS; i++)
+    {
+        w->accounts[i].is_signer = w->accounts[i].is_writable = false;
+    }
+
+    const uint8_t get_group[] = {UI_GetGroup};
+    cr_assert(host_world_run(w, get_group, sizeof (get_group), 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 0 && sol_host_return_data_len == 102);
+    const uint8_t *r = sol_host_return_data;
+    cr_assert(r[0] == UQ_Group && memcmp(r + 1, gid->x, SIZE_PUBKEY) == 0);
+    cr_assert(memcmp(r + 1 + SIZE_PUBKEY, w->keys[UA_Manager].x, SIZE_PUBKEY) == 0);
+    cr_assert(*(const uint32_t *) (r + 65) == 30 && r[69] == UG_ScoreIndex);
+    cr_assert(*(const uint64_t *) (r + 70) == (50 + 79) * 30 / 2);
+    cr_assert(*(const uint64_t *) (r + 78) == 50 && *(const uint64_t *) (r + 86) == 79);
+
+    uint8_t get_member[1 + SIZE_PUBKEY] = {UI_GetMember};
+    SolPubkey uid = host_user(60);
+    sol_memcpy(get_member + 1, uid.x, SIZE_PUBKEY);
+    cr_assert(host_world_run(w, get_member, sizeof (get_member), 0) == SUCCESS);
+    cr_assert(sol_host_return_data_len == 1 + SIZE_PUBKEY + 1 + 4 + 8 + 4 + 8);
+    r = sol_host_return_data + 1 + SIZE_PUBKEY;
+    cr_assert(r[0] == 1 && *(const uint64_t *) (r + 5) == 60 && *(const uint32_t *) (r + 13) == 10);
+    cr_assert(upala_group_member(host_world_group(w), *(const uint32_t *) (r + 1))->score == 60);
+
+    uid = host_user(90);
+    sol_memcpy(get_member + 1, uid.x, SIZE_PUBKEY);
+    cr_assert(host_world_run(w, get_member, sizeof (get_member), 0) == SUCCESS);
+    cr_assert(sol_host_return_data[1 + SIZE_PUBKEY] == 0);
+
+    // A page is cut at the end of the group and at the size of the return data
+    uint8_t list[] = {UI_ListMembers, 20, 0, 0, 0, UINT8_MAX};
+    cr_assert(host_world_run(w, list, sizeof (list), 0) == SUCCESS);
+    cr_assert(sol_host_return_data[0] == UQ_Members && sol_host_return_data[9] == 10);
+    cr_assert(sol_host_return_data_len == UPALA_QUERY_MEMBERS_HEADER + 10 * (SIZE_PUBKEY + sizeof (uint64_t)));
+    UpalaGroupData *gd = host_world_group(w);
+    const SolPubkey *first = upala_registry_user(host_world_registry(w), upala_group_member(gd, 20)->user);
+    cr_assert(memcmp(sol_host_return_data + UPALA_QUERY_MEMBERS_HEADER, first->x, SIZE_PUBKEY) == 0);
+    list[1] = 0;
+    cr_assert(host_world_run(w, list, sizeof (list), 0) == SUCCESS);
+    cr_assert(sol_host_return_data[9] == UPALA_QUERY_MAX_MEMBERS);
+    list[1] = 40;
+    cr_assert(host_world_run(w, list, sizeof (list), 0) == SUCCESS && sol_host_return_data[9] == 0);
+    cr_assert(host_world_run(w, list, sizeof (list) - 1, 0) == ERROR_INVALID_INSTRUCTION_DATA);
+
+    // The registry and the group must be the ones of the minter
+    ((UpalaRegistry *) w->accounts[UA_Registry].data)->minter = host_user(1);
+    cr_assert(host_world_run(w, list, sizeof (list), 0) == ERROR_INVALID_ACCOUNT_DATA);
+    cr_assert(host_world_run(w, get_group, sizeof (get_group), 0) == SUCCESS);
+    w->keys[UA_Minter] = host_user(1);
+    cr_assert(host_world_run(w, get_group, sizeof (get_group), 0) == INVALID_SEEDS);
+    host_world_free(w);
+}
+
+/// Proof of the leaf `i` of the tree of `count` leaves, built the way
+/// the clients build it: a node without sibling goes up unchanged.
+/// Returns the depth of the proof and sets the root
+static uint8_t merkle_proof(SolPubkey *level, uint64_t count, uint64_t i, SolPubkey *proof, SolPubkey *root)
+{
+    uint8_t depth = 0;
+    for (; count > 1; count = (count + 1) / 2, i /= 2)
+    {
+        if ((i ^ 1) < count)
+        {
+            proof[depth++] = level[i ^ 1];
+        }
+        for (uint64_t j = 0; j < count; j += 2)
+        {
+            if (j + 1 < count) upala_merkle_node(&level[j], &level[j + 1], &level[j / 2]);
+            else level[j / 2] = level[j];
+        }
+    }
+    *root = level[0];
+    return depth;
+}
+
+Test(merkle, root_and_proof) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, 0, UG_Merkle);
+    const SolPubkey *gid = &w->keys[UA_Pool];
+    const uint64_t group_len = host_len(&w->accounts[UA_Group]);
+    cr_assert(group_len == sizeof (UpalaGroupData) + sizeof (UpalaMerkle));
+
+    SolPubkey leaves[5];
+    for (uint32_t i = 0; i < SOL_ARRAY_SIZE(leaves); i++)
+    {
+        const SolPubkey uid = host_user(i);
+        upala_merkle_leaf(&uid, i * 10, &leaves[i]);
+    }
+    SolPubkey proof[8];
+    SolPubkey root;
+    const uint8_t depth = merkle_proof(leaves, SOL_ARRAY_SIZE(leaves), 3, proof, &root);
+    cr_assert(depth == 3);
+
+    uint8_t set_root[1 + 2 * SIZE_PUBKEY + sizeof (uint32_t)] = {UI_SetRoot};
+    const uint32_t members = SOL_ARRAY_SIZE(leaves);
+    sol_memcpy(set_root + 1, gid->x, SIZE_PUBKEY);
+    sol_memcpy(set_root + 1 + SIZE_PUBKEY, root.x, SIZE_PUBKEY);
+    sol_memcpy(set_root + 1 + 2 * SIZE_PUBKEY, &members, sizeof (members));
+    w->accounts[UA_Manager].is_signer = false;
+    cr_assert(host_world_run(w, set_root, sizeof (set_root), 0) == ERROR_MISSING_REQUIRED_SIGNATURES);
+    w->accounts[UA_Manager].is_signer = true;
+    cr_assert(host_world_run(w, set_root, sizeof (set_root), 0) == SUCCESS);
+    const UpalaMerkle *merkle = upala_group_merkle(host_world_group(w));
+    cr_assert(upala_pubkey_same(&merkle->root, &root) && merkle->members == members);
+    cr_assert(host_len(&w->accounts[UA_Group]) == group_len && sol_host_calls_len == 0);
+
+    // The members of a Merkle group change by their root only
+    uint8_t data[1 + SIZE_PUBKEY + 1 + UINT8_MAX * sizeof (UpalaAccount)];
+    uint64_t len = host_members(data, UI_AddUser, gid, 10, 1);
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ARGUMENT);
+
+    uint8_t verify[1 + SIZE_PUBKEY + sizeof (uint64_t) + 1 + SOL_ARRAY_SIZE(proof) * SIZE_PUBKEY] = {UI_VerifyMember};
+    const SolPubkey uid = host_user(3);
+    uint64_t score = 30;
+    sol_memcpy(verify + 1, uid.x, SIZE_PUBKEY);
+    sol_memcpy(verify + 1 + SIZE_PUBKEY, &score, sizeof (score));
+    verify[1 + SIZE_PUBKEY + sizeof (uint64_t)] = depth;
+    sol_memcpy(verify + 2 + SIZE_PUBKEY + sizeof (uint64_t), proof, depth * SIZE_PUBKEY);
+    const uint64_t verify_len = 2 + SIZE_PUBKEY + sizeof (uint64_t) + depth * SIZE_PUBKEY;
+    for (int i = 0; i < HOST_ACCOUNTS; i++)
+    {
+        w->accounts[i].is_signer = w->accounts[i].is_writable = false;
+    }
+    cr_assert(host_world_run(w, verify, verify_len, 0) == SUCCESS);
+    cr_assert(sol_host_return_data[0] == UQ_Verified && sol_host_return_data_len == 1 + 2 * SIZE_PUBKEY + 8);
+    cr_assert(memcmp(sol_host_return_data + 1 + SIZE_PUBKEY, uid.x, SIZE_PUBKEY) == 0);
+
+    score = 31;
+    sol_memcpy(verify + 1 + SIZE_PUBKEY, &score, sizeof (score));
+    cr_assert(host_world_run(w, verify, verify_len, 0) == ERROR_INVALID_ARGUMENT);
+    cr_assert(host_world_run(w, verify, verify_len - 1, 0) == ERROR_INVALID_INSTRUCTION_DATA);
+
+    const uint8_t get_group[] = {UI_GetGroup};
+    cr_assert(host_world_run(w, get_group, sizeof (get_group), 0) == SUCCESS);
+    cr_assert(*(const uint32_t *) (sol_host_return_data + 65) == members);
+    host_world_free(w);
+
+    // A group keeping its members has no root
+    w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    cr_assert(host_world_run(w, set_root, sizeof (set_root), 0) == ERROR_INVALID_ARGUMENT);
+    cr_assert(host_world_run(w, verify, verify_len, 0) == ERROR_INVALID_ARGUMENT);
+    host_world_free(w);
+}
+
+/// Checks the order, the filter, the aggregates and the ranks of the
+/// group against its members
+static void check_group(UpalaGroupData *gd)
+{
+    UpalaScoreStats stats = {0};
+    for (uint64_t i = 0; i < gd->accounts_count; i++)
+    {
+        const UpalaMember *member = upala_group_member(gd, i);
+        cr_assert(i == 0 || upala_group_member(gd, i - 1)->user < member->user);
+        cr_assert(upala_group_find(gd, member->user) == i);
+        upala_stats_add(&stats, i, member->score);
+    }
+    cr_assert(sol_memcmp(&stats, &gd->stats, sizeof (stats)) == 0);
+
+    const uint32_t *ranks = upala_group_ranks(gd);
+    if (!ranks)
+    {
+        return;
+    }
+    bool *seen = calloc(gd->accounts_count + 1, sizeof (bool));
+    for (uint64_t r = 0; r < gd->accounts_count; r++)
+    {
+        cr_assert(ranks[r] < gd->accounts_count && !seen[ranks[r]]);
+        seen[ranks[r]] = true;
+        if (r > 0)
+        {
+            const UpalaMember *a = upala_group_ranked(gd, r - 1), *b = upala_group_ranked(gd, r);
+            cr_assert(a->score < b->score || (a->score == b->score && a->user < b->user));
+        }
+    }
+    free(seen);
+}
+
+/// Instruction data of an operation on the member `user`, scored `score`
+static uint64_t rewards_member(uint8_t *data, uint8_t instruction, const SolPubkey *gid,
+                               uint32_t user, uint64_t score)
+{
+    const uint64_t len = host_members(data, instruction, gid, user, 1);
+    if (instruction != UI_RemoveUser)
+    {
+        sol_memcpy(data + len - sizeof (score), &score, sizeof (score));
+    }
+    return len;
+}
+
+/// Tokens pending a claim of the member, read by UI_GetMember
+static uint64_t rewards_pending(HostWorld *w, uint32_t user)
+{
+    uint8_t get_member[1 + SIZE_PUBKEY] = {UI_GetMember};
+    const SolPubkey uid = host_user(user);
+    sol_memcpy(get_member + 1, uid.x, SIZE_PUBKEY);
+    cr_assert(host_world_run(w, get_member, sizeof (get_member), 0) == SUCCESS);
+    uint64_t pending;
+    sol_memcpy(&pending, sol_host_return_data + sol_host_return_data_len - sizeof (pending), sizeof (pending));
+    return pending;
+}
+
+Test(rewards, deposit_and_claim) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, 0, UG_Rewards);
+    const SolPubkey *gid = &w->keys[UA_Pool];
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+
+    uint8_t deposit[1 + SIZE_PUBKEY + sizeof (uint64_t)] = {UI_Deposit};
+    sol_memcpy(deposit + 1, gid->x, SIZE_PUBKEY);
+    uint64_t amount = 600;
+    sol_memcpy(deposit + 1 + SIZE_PUBKEY, &amount, sizeof (amount));
+    cr_assert(host_world_run(w, deposit, sizeof (deposit), 0) == ERROR_INVALID_ARGUMENT);
+
+    uint8_t data[1 + SIZE_PUBKEY + 1 + UINT8_MAX * sizeof (UpalaAccount)];
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        const uint64_t len = rewards_member(data, UI_AddUser, gid, 100 + i, i + 1);
+        cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    }
+
+    // The deposit moves the tokens of the signer, spread over the scores 1, 2 and 3
+    cr_assert(host_world_run(w, deposit, sizeof (deposit), 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 1 && !sol_host_calls[0].signed_by_program);
+    cr_assert(transferred_amount(&sol_host_calls[0]) == 600);
+    const UpalaRewards *rewards = upala_group_rewards(host_world_group(w));
+    cr_assert(rewards->held == 600 && rewards->deposited == 600);
+    cr_assert(rewards_pending(w, 100) == 100 && rewards_pending(w, 102) == 300);
+
+    // Anybody claims for the member, into a token account of the member
+    uint8_t claim[1 + SIZE_PUBKEY] = {UI_Claim};
+    sol_memcpy(claim + 1, gid->x, SIZE_PUBKEY);
+    SolAccountInfo *user_at = &w->accounts[UA_UserAt];
+    w->keys[UA_User] = host_user(102);
+    host_set_len(user_at, SPL_TOKEN_ACCOUNT_DATA_LEN);
+    sol_memcpy(user_at->data, w->keys[UA_Minter].x, SIZE_PUBKEY);
+    sol_memcpy(user_at->data + SIZE_PUBKEY, w->keys[UA_Manager].x, SIZE_PUBKEY);
+    w->accounts[UA_Manager].is_signer = false;
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == ERROR_INVALID_ACCOUNT_DATA);
+    sol_memcpy(user_at->data + SIZE_PUBKEY, w->keys[UA_User].x, SIZE_PUBKEY);
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 1 && sol_host_calls[0].signed_by_program);
+    cr_assert(transferred_amount(&sol_host_calls[0]) == 300);
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == SUCCESS && sol_host_calls_len == 0);
+    w->accounts[UA_Manager].is_signer = true;
+
+    // A new score counts from the next deposit, the new members are owed
+    // nothing of the previous ones and the checkpoints move with the room
+    uint64_t len = rewards_member(data, UI_SetScore, gid, 102, 6);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    cr_assert(rewards_pending(w, 102) == 0);
+    len = host_members(data, UI_AddUser, gid, 110, 8);
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        sol_memset(data + 2 + SIZE_PUBKEY + i * sizeof (UpalaAccount) + SIZE_PUBKEY, 0, sizeof (uint64_t));
+    }
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    cr_assert(upala_group_capacity(host_world_group(w)) > 3);
+    cr_assert(rewards_pending(w, 100) == 100 && rewards_pending(w, 101) == 200 && rewards_pending(w, 110) == 0);
+
+    amount = 900;
+    sol_memcpy(deposit + 1 + SIZE_PUBKEY, &amount, sizeof (amount));
+    cr_assert(host_world_run(w, deposit, sizeof (deposit), 0) == SUCCESS);
+    cr_assert(rewards_pending(w, 100) == 200 && rewards_pending(w, 101) == 400 && rewards_pending(w, 102) == 600);
+
+    // A member leaves once paid, the manager does not take its tokens
+    len = rewards_member(data, UI_RemoveUser, gid, 101, 0);
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ARGUMENT);
+    cr_assert(rewards_pending(w, 101) == 400);
+    w->keys[UA_User] = host_user(101);
+    sol_memcpy(user_at->data + SIZE_PUBKEY, w->keys[UA_User].x, SIZE_PUBKEY);
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 1 && transferred_amount(&sol_host_calls[0]) == 400);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    cr_assert(rewards_pending(w, 100) == 200 && rewards_pending(w, 102) == 600);
+    rewards = upala_group_rewards(host_world_group(w));
+    cr_assert(rewards->held == 800);
+
+    // A group without UG_Rewards pays no rewards
+    host_world_free(w);
+    w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    cr_assert(host_world_run(w, deposit, sizeof (deposit), 0) == ERROR_INVALID_ARGUMENT);
+    host_world_free(w);
+}
+
+/// Sets the token balance of the pool, the host does not move the tokens
+static void pool_balance(HostWorld *w, uint64_t balance)
+{
+    sol_memcpy(w->accounts[UA_Pool].data + 2 * SIZE_PUBKEY, &balance, sizeof (balance));
+}
+
+Test(rewards, payouts_keep_held) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, 0, UG_Rewards);
+    const SolPubkey *gid = &w->keys[UA_Pool];
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+
+    uint8_t data[1 + SIZE_PUBKEY + 1 + sizeof (UpalaAccount)];
+    const uint64_t len = rewards_member(data, UI_AddUser, gid, 100, 1);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+
+    uint8_t deposit[1 + SIZE_PUBKEY + sizeof (uint64_t)] = {UI_Deposit};
+    sol_memcpy(deposit + 1, gid->x, SIZE_PUBKEY);
+    const uint64_t amount = 600;
+    sol_memcpy(deposit + 1 + SIZE_PUBKEY, &amount, sizeof (amount));
+    cr_assert(host_world_run(w, deposit, sizeof (deposit), 0) == SUCCESS);
+    pool_balance(w, 1000 + amount);
+
+    // The manager takes the pool but for the tokens owed to the member
+    const uint8_t empty[] = {UI_EmptyPool};
+    cr_assert(host_world_run(w, empty, sizeof (empty), 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 1 && transferred_amount(&sol_host_calls[0]) == 1000);
+    pool_balance(w, amount);
+
+    uint8_t distribute[3 + sizeof (uint8_t) + sizeof (uint64_t)] = {UI_Distribute, UD_Amounts, 1, 7};
+    uint64_t value = 1;
+    sol_memcpy(distribute + 4, &value, sizeof (value));
+    cr_assert(host_world_run(w, distribute, sizeof (distribute), 1) == ERROR_INSUFFICIENT_FUNDS);
+    distribute[1] = UD_Weights;
+    cr_assert(host_world_run(w, distribute, sizeof (distribute), 1) == SUCCESS && sol_host_calls_len == 0);
+
+    // The member still claims all of its tokens
+    uint8_t claim[1 + SIZE_PUBKEY] = {UI_Claim};
+    sol_memcpy(claim + 1, gid->x, SIZE_PUBKEY);
+    SolAccountInfo *user_at = &w->accounts[UA_UserAt];
+    w->keys[UA_User] = host_user(100);
+    host_set_len(user_at, SPL_TOKEN_ACCOUNT_DATA_LEN);
+    sol_memcpy(user_at->data, w->keys[UA_Minter].x, SIZE_PUBKEY);
+    sol_memcpy(user_at->data + SIZE_PUBKEY, w->keys[UA_User].x, SIZE_PUBKEY);
+
+    // A program posing as the token program never gets the pool signer
+    w->keys[UA_SplToken] = host_key(4);
+    *user_at->owner = w->keys[UA_SplToken];
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == ERROR_INCORRECT_PROGRAM_ID && sol_host_calls_len == 0);
+    cr_assert(host_world_run(w, deposit, sizeof (deposit), 0) == ERROR_INCORRECT_PROGRAM_ID && sol_host_calls_len == 0);
+    w->keys[UA_SplToken] = spl_program_id;
+    *user_at->owner = w->keys[UA_SplToken];
+
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 1 && transferred_amount(&sol_host_calls[0]) == 600);
+    cr_assert(upala_group_rewards(host_world_group(w))->held == 0);
+
+    // A claim the pool falls short of keeps the rest pending
+    cr_assert(host_world_run(w, deposit, sizeof (deposit), 0) == SUCCESS);
+    UpalaRewards *rewards = upala_group_rewards(host_world_group(w));
+    rewards->held = 250;
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 1 && transferred_amount(&sol_host_calls[0]) == 250);
+    cr_assert(rewards->held == 0 && rewards_pending(w, 100) == 350);
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == SUCCESS && sol_host_calls_len == 0);
+    rewards->held = 350;
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 1 && transferred_amount(&sol_host_calls[0]) == 350);
+    cr_assert(rewards->held == 0 && rewards_pending(w, 100) == 0);
+    host_world_free(w);
+}
+
+Test(rewards, held_keeps_group) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, 0, UG_Rewards);
+    const SolPubkey gid = w->keys[UA_Pool];
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+
+    uint8_t data[1 + SIZE_PUBKEY + 1 + sizeof (UpalaAccount)];
+    const uint64_t len = rewards_member(data, UI_AddUser, &gid, 100, 1);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    uint8_t deposit[1 + SIZE_PUBKEY + sizeof (uint64_t)] = {UI_Deposit};
+    sol_memcpy(deposit + 1, gid.x, SIZE_PUBKEY);
+    const uint64_t amount = 600;
+    sol_memcpy(deposit + 1 + SIZE_PUBKEY, &amount, sizeof (amount));
+    cr_assert(host_world_run(w, deposit, sizeof (deposit), 0) == SUCCESS);
+
+    // The group owing tokens to its member is not removed
+    const uint8_t remove[] = {UI_RemovePool};
+    cr_assert(host_world_run(w, remove, sizeof (remove), 0) == ERROR_INVALID_ARGUMENT);
+    cr_assert(host_world_storage(w)->groups_count == 1);
+    cr_assert(upala_group_rewards(host_world_group(w))->held == amount);
+
+    // Nor created again over its account once the storage is cleaned
+    const uint8_t clean[] = {UI_CleanStorage};
+    cr_assert(host_world_run(w, clean, sizeof (clean), 0) == SUCCESS);
+    const uint8_t create[] = {UI_CreatePool, UG_Rewards};
+    cr_assert(host_world_run(w, create, sizeof (create), 0) == ERROR_INVALID_ARGUMENT);
+    cr_assert(sol_host_calls_len == 0 && host_world_storage(w)->groups_count == 0);
+    cr_assert(upala_group_rewards(host_world_group(w))->held == amount);
+    upala_group_rewards(host_world_group(w))->held = 0;
+    cr_assert(host_world_run(w, create, sizeof (create), 0) == SUCCESS);
+    host_world_free(w);
+
+    // Once the member claimed, the group goes
+    w = host_world_new();
+    host_world_create(w, 0, 0, UG_Rewards);
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    cr_assert(host_world_run(w, deposit, sizeof (deposit), 0) == SUCCESS);
+    uint8_t claim[1 + SIZE_PUBKEY] = {UI_Claim};
+    sol_memcpy(claim + 1, gid.x, SIZE_PUBKEY);
+    SolAccountInfo *user_at = &w->accounts[UA_UserAt];
+    w->keys[UA_User] = host_user(100);
+    host_set_len(user_at, SPL_TOKEN_ACCOUNT_DATA_LEN);
+    sol_memcpy(user_at->data, w->keys[UA_Minter].x, SIZE_PUBKEY);
+    sol_memcpy(user_at->data + SIZE_PUBKEY, w->keys[UA_User].x, SIZE_PUBKEY);
+    cr_assert(host_world_run(w, claim, sizeof (claim), 0) == SUCCESS);
+    cr_assert(upala_group_rewards(host_world_group(w))->held == 0);
+    cr_assert(host_world_run(w, remove, sizeof (remove), 0) == SUCCESS);
+    cr_assert(host_world_storage(w)->groups_count == 0);
+    host_world_free(w);
+}
+
+Test(group, score_stats) {
+    for (uint8_t flags = 0; flags <= UG_ScoreIndex; flags++)
+    {
+        HostWorld *w = host_world_new();
+        host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, flags);
+        *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+        const SolPubkey *gid = &w->keys[UA_Pool];
+        uint8_t data[1 + SIZE_PUBKEY + 1 + UINT8_MAX * sizeof (UpalaAccount)];
+
+        // Members 10..49 scored 10..49, the ranks move as the account grows
+        uint64_t len = host_members(data, UI_AddUser, gid, 10, 40);
+        cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+        UpalaGroupData *gd = host_world_group(w);
+        cr_assert(gd->stats.sum == 1180 && gd->stats.min == 10 && gd->stats.max == 49);
+        cr_assert(gd->layout.used == upala_group_used(gd, 40));
+        check_group(gd);
+
+        // Members 10 and 11 tie for the highest score, then both leave
+        len = host_members(data, UI_SetScore, gid, 10, 2);
+        const uint64_t score = 90;
+        sol_memcpy(data + 1 + SIZE_PUBKEY + 1 + SIZE_PUBKEY, &score, sizeof (score));
+        sol_memcpy(data + 1 + SIZE_PUBKEY + 1 + sizeof (UpalaAccount) + SIZE_PUBKEY, &score, sizeof (score));
+        cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+        cr_assert(gd->stats.min == 12 && gd->stats.max == 90 && gd->stats.max_count == 2);
+        check_group(gd);
+
+        len = host_members(data, UI_RemoveUser, gid, 10, 1);
+        cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+        cr_assert(gd->stats.max == 90 && gd->stats.max_count == 1);
+        check_group(gd);
+        len = host_members(data, UI_RemoveUser, gid, 11, 3);
+        cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+        cr_assert(gd->stats.sum == 1180 - 21 - 12 - 13 && gd->stats.min == 14 && gd->stats.max == 49);
+        check_group(gd);
+
+        if (flags & UG_ScoreIndex)
+        {
+            cr_assert(upala_group_at_least(gd, 40) == gd->accounts_count - 10);
+            cr_assert(upala_group_at_least(gd, 50) == gd->accounts_count);
+            cr_assert(upala_group_ranked(gd, gd->accounts_count - 1)->score == 49);
+        }
+        else
+        {
+            cr_assert(upala_group_at_least(gd, 40) == UINT64_MAX && !upala_group_ranked(gd, 0));
+        }
+
+        // The sum of the scores does not overflow
+        len = host_members(data, UI_SetScore, gid, 20, 1);
+        const uint64_t huge = UINT64_MAX - 100;
+        sol_memcpy(data + 1 + SIZE_PUBKEY + 1 + SIZE_PUBKEY, &huge, sizeof (huge));
+        cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ARGUMENT);
+
+        len = host_members(data, UI_RemoveUser, gid, 14, 36);
+        cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+        cr_assert(gd->accounts_count == 0 && gd->stats.sum == 0 && gd->stats.max_count == 0);
+        host_world_free(w);
+    }
+}
+
+Test(group, growth_per_instruction) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    UpalaContext ctx;
+    host_world_context(w, &ctx);
+    SolAccountInfo *account = &w->accounts[UA_Group];
+    UpalaGroupData *gd = host_world_group(w);
+
+    // Two steps within the increase, together beyond it from the length
+    // of the account at the start of the instruction
+    const uint64_t step = MAX_PERMITTED_DATA_INCREASE * 2 / 3 / upala_group_entry_len(0);
+    const uint64_t *base_len = upala_group_len(&ctx, account);
+    cr_assert(base_len && *base_len == account->data_len);
+    cr_assert(upala_group_reserve(account, gd, ctx.manager, ctx.system_program, &ctx.rent, *base_len,
+                                  UPALA_GROUP_INITIAL_CAPACITY + step) == SUCCESS);
+    cr_assert(upala_group_len(&ctx, account) == base_len && ctx.group_lens_count == 1);
+    cr_assert(upala_group_reserve(account, gd, ctx.manager, ctx.system_program, &ctx.rent, *base_len,
+                                  UPALA_GROUP_INITIAL_CAPACITY + 2 * step) == ERROR_INVALID_ARGUMENT);
+    cr_assert(upala_group_capacity(gd) == UPALA_GROUP_INITIAL_CAPACITY + step);
+
+    // The lengths of UPALA_MAX_GROWN_GROUPS accounts are kept
+    for (int i = 1; i < UPALA_MAX_GROWN_GROUPS; i++)
+    {
+        cr_assert(upala_group_len(&ctx, &w->accounts[i]));
+    }
+    cr_assert(!upala_group_len(&ctx, &w->accounts[UA_Registry]));
+    host_world_free(w);
+}
+
+Test(group, merge_members) {
+    for (uint8_t flags = 0; flags <= UG_ScoreIndex; flags++)
+    {
+        HostWorld *w = host_world_new();
+        host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, flags);
+        *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+        const SolPubkey *gid = &w->keys[UA_Pool];
+        uint8_t data[1 + SIZE_PUBKEY + 1 + UINT8_MAX * sizeof (UpalaAccount)];
+
+        // Payloads of 200 members merged between the members, scores tied
+        // in pairs. The account grows by some 200 members an instruction
+        for (uint32_t first = 0; first < 1000; first += 200)
+        {
+            const uint8_t count = 200;
+            uint64_t len = host_members(data, UI_AddUser, gid, first, count);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const uint64_t score = (first + i) / 2;
+                sol_memcpy(data + 1 + SIZE_PUBKEY + 1 + i * sizeof (UpalaAccount) + SIZE_PUBKEY, &score, sizeof (score));
+            }
+            cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+            check_group(host_world_group(w));
+        }
+        UpalaGroupData *gd = host_world_group(w);
+        cr_assert(gd->accounts_count == 1000 && gd->stats.max == 499 && gd->stats.max_count == 2);
+
+        // The filter turns most of the other users away
+        uint64_t passed = 0;
+        for (uint32_t user = 1000; user < 3000; user++)
+        {
+            passed += upala_group_may_hold(gd, user);
+            cr_assert(upala_group_find(gd, user) == UINT64_MAX);
+        }
+        cr_assert(passed < 200);
+
+        uint64_t len = host_members(data, UI_RemoveUser, gid, 100, 200);
+        cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+        check_group(gd);
+        const SolPubkey removed = host_user(150);
+        const uint32_t user = upala_registry_find(host_world_registry(w), &removed);
+        cr_assert(gd->accounts_count == 800 && !upala_group_may_hold(gd, user));
+        len = host_members(data, UI_AddUser, gid, 150, 10);
+        cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+        check_group(gd);
+        host_world_free(w);
+    }
+}
+
+Test(registry, enter_find) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    UpalaContext ctx;
+    host_world_context(w, &ctx);
+    uint8_t data[1 + SIZE_PUBKEY + 1 + UINT8_MAX * sizeof (UpalaAccount)];
+    const uint8_t *entries = data + 1 + SIZE_PUBKEY + 1;
+    uint32_t users[UINT8_MAX];
+
+    // Payloads overlapping the known keys, a key given twice
+    const uint32_t firsts[] = {0, 100, 50};
+    for (size_t p = 0; p < SOL_ARRAY_SIZE(firsts); p++)
+    {
+        host_members(data, UI_AddUser, &w->keys[UA_Pool], firsts[p], 200);
+        sol_memcpy(data + 1 + SIZE_PUBKEY + 1 + sizeof (UpalaAccount), entries, SIZE_PUBKEY);
+        cr_assert(upala_registry_enter(&ctx, entries, 200, users) == SUCCESS);
+        cr_assert(users[0] == users[1]);
+        for (uint32_t j = 2; j < 200; j++)
+        {
+            const SolPubkey uid = host_user(firsts[p] + j);
+            cr_assert(SolPubkey_same(upala_registry_user(ctx.users, users[j]), &uid));
+        }
+    }
+
+    UpalaRegistry *registry = host_world_registry(w);
+    cr_assert(registry && registry->users_count == 299);
+    cr_assert(registry->layout.used == upala_registry_used(registry, 299));
+    const uint32_t *order = upala_registry_order(registry);
+    for (uint32_t i = 1; i < registry->users_count; i++)
+    {
+        cr_assert(upala_pubkey_cmp(&registry->users[order[i - 1]], &registry->users[order[i]]) < 0);
+    }
+    const SolPubkey unknown = host_user(1);
+    cr_assert(upala_registry_find(registry, &unknown) == UPALA_NO_USER);
+
+    // The account grows by MAX_PERMITTED_DATA_INCREASE bytes at most in
+    // the next instruction, the order moves up past the room of the keys
+    ctx.registry_len = ctx.registry->data_len;
+    const uint64_t capacity = upala_registry_capacity(registry);
+    const uint64_t grown = MAX_PERMITTED_DATA_INCREASE / (SIZE_PUBKEY + sizeof (uint32_t));
+    cr_assert(upala_registry_reserve(&ctx, capacity + grown + 1) == ERROR_INVALID_ARGUMENT);
+    cr_assert(upala_registry_reserve(&ctx, capacity + grown) == SUCCESS);
+    cr_assert(upala_registry_capacity(registry) == capacity + grown);
+    const SolPubkey known = host_user(60);
+    cr_assert(upala_registry_find(registry, &known) == users[10]);
+    host_world_free(w);
+}
+
+Test(instruction, add_user_provisions_account) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    uint8_t data[1 + SIZE_PUBKEY + 1 + 2 * sizeof (UpalaAccount)];
+    const uint64_t len = host_members(data, UI_AddUser, &w->keys[UA_Pool], 0, 1);
+
+    // The token account is created for the one user added
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ARGUMENT && sol_host_calls_len == 0);
+    sol_memcpy(data + 2 + SIZE_PUBKEY, w->keys[UA_User].x, SIZE_PUBKEY);
+    const uint64_t two_len = host_members(data, UI_AddUser, &w->keys[UA_Pool], 0, 2);
+    sol_memcpy(data + 2 + SIZE_PUBKEY, w->keys[UA_User].x, SIZE_PUBKEY);
+    cr_assert(host_world_run(w, data, two_len, 0) == ERROR_INVALID_ARGUMENT && sol_host_calls_len == 0);
+    data[1 + SIZE_PUBKEY] = 1;
+
+    // Neither the rent nor the token account goes to a program posing as another
+    w->keys[UA_SystemProgram] = host_key(5);
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INCORRECT_PROGRAM_ID && sol_host_calls_len == 0);
+    w->keys[UA_SystemProgram] = system_program_id;
+    w->keys[UA_SplToken] = host_key(4);
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INCORRECT_PROGRAM_ID && sol_host_calls_len == 0);
+    w->keys[UA_SplToken] = spl_program_id;
+
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 2);
+    cr_assert(SolPubkey_same(&sol_host_calls[0].accounts[1], &w->keys[UA_UserAt]));
+    cr_assert(SolPubkey_same(&sol_host_calls[1].accounts[2], &w->keys[UA_User]));
+
+    w->keys[UA_UserAt] = host_user(1);
+    cr_assert(host_world_run(w, data, len, 0) == INVALID_SEEDS);
+    host_world_free(w);
+}
+
+Test(instruction, batch) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+
+    // Shared accounts of the schema, then the group, the user and its token account
+    cr_assert(host_world_accounts(w, UI_Batch, 0) == 8);
+    w->accounts[UA_RolesCount + 0] = w->accounts[UA_Group];
+    w->accounts[UA_RolesCount + 1] = w->accounts[UA_User];
+    w->accounts[UA_RolesCount + 2] = w->accounts[UA_UserAt];
+
+    uint8_t data[2 + 2 * (UPALA_BATCH_OPERATION_LEN + 1 + SIZE_PUBKEY + 1 + 10 * sizeof (UpalaAccount))];
+    uint8_t *p = data;
+    *p++ = UI_Batch;
+    *p++ = 2;
+    for (uint32_t o = 0; o < 2; o++)
+    {
+        // The payload of the operation is the instruction data less the
+        // instruction byte, written over the end of the operation header
+        uint8_t *operation = p;
+        p += UPALA_BATCH_OPERATION_LEN;
+        const uint16_t operation_len = (uint16_t)(host_members(p - 1, UI_AddUser, &w->keys[UA_Pool], o * 10, 10) - 1);
+        operation[0] = UI_AddUser;
+        operation[1] = UPALA_NO_ACCOUNT;
+        operation[2] = 8;
+        operation[3] = 9;
+        operation[4] = 10;
+        sol_memcpy(operation + 5, &operation_len, sizeof (operation_len));
+        p += operation_len;
+    }
+
+    cr_assert(host_world_run(w, data, p - data, 3) == SUCCESS);
+    UpalaGroupData *gd = host_world_group(w);
+    cr_assert(gd->accounts_count == 20 && host_world_member(w, 19)->score == 19);
+
+    data[4] = 42;
+    cr_assert(host_world_run(w, data, p - data, 3) == ERROR_NOT_ENOUGH_ACCOUNT_KEYS);
+    data[4] = 8;
+    cr_assert(host_world_run(w, data, p - data, 3) == ERROR_INVALID_ARGUMENT);   // Added once
+    data[2] = UI_SetScore;
+    cr_assert(host_world_run(w, data, p - data - 1, 3) == ERROR_INVALID_INSTRUCTION_DATA);
+    cr_assert(host_world_run(w, data, p - data + 1, 3) == ERROR_INVALID_INSTRUCTION_DATA);
+    data[2] = UI_GetMember;
+    cr_assert(host_world_run(w, data, p - data, 3) == ERROR_INVALID_INSTRUCTION_DATA);
+    host_world_free(w);
+}
+
+Test(instruction, empty_pool) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 1000, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    const uint8_t data[] = {UI_EmptyPool};
+
+    w->accounts[UA_Manager].is_signer = false;
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == ERROR_MISSING_REQUIRED_SIGNATURES && sol_host_calls_len == 0);
+    w->accounts[UA_Manager].is_signer = true;
+    w->keys[UA_SplToken] = host_key(4);
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == ERROR_INCORRECT_PROGRAM_ID && sol_host_calls_len == 0);
+    w->keys[UA_SplToken] = spl_program_id;
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == SUCCESS);
+    cr_assert(sol_host_calls_len == 1 && sol_host_calls[0].signed_by_program);
+    cr_assert(transferred_amount(&sol_host_calls[0]) == 1000);
+    host_world_free(w);
+}
+
+Test(instruction, distribute) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 1000, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    cr_assert(host_world_accounts(w, UI_Distribute, 0) == 7);
+
+    uint8_t data[3 + 3 * (sizeof (uint8_t) + sizeof (uint64_t))];
+    uint8_t *p = data;
+    *p++ = UI_Distribute;
+    *p++ = UD_Weights;
+    *p++ = 3;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        *p++ = 7 + i;
+        const uint64_t weight = 1;
+        sol_memcpy(p, &weight, sizeof (weight));
+        p += sizeof (weight);
+    }
+
+    w->keys[UA_SplToken] = host_key(4);
+    cr_assert(host_world_run(w, data, p - data, 3) == ERROR_INCORRECT_PROGRAM_ID && sol_host_calls_len == 0);
+    w->keys[UA_SplToken] = spl_program_id;
+    cr_assert(host_world_run(w, data, p - data, 3) == SUCCESS);
+    cr_assert(sol_host_calls_len == 3 && sol_host_calls[0].signed_by_program);
+    cr_assert(transferred_amount(&sol_host_calls[0]) == 333 && transferred_amount(&sol_host_calls[2]) == 333);
+    cr_assert(SolPubkey_same(&sol_host_calls[1].accounts[1], &w->keys[UA_RolesCount + 1]));
+
+    data[1] = UD_Amounts;
+    uint64_t amount = 999;
+    sol_memcpy(data + 4, &amount, sizeof (amount));
+    cr_assert(host_world_run(w, data, p - data, 3) == ERROR_INSUFFICIENT_FUNDS && sol_host_calls_len == 0);
+    amount = 998;
+    sol_memcpy(data + 4, &amount, sizeof (amount));
+    cr_assert(host_world_run(w, data, p - data, 3) == SUCCESS && sol_host_calls_len == 3);
+
+    data[3] = 10;
+    cr_assert(host_world_run(w, data, p - data, 3) == ERROR_NOT_ENOUGH_ACCOUNT_KEYS && sol_host_calls_len == 0);
+    data[3] = 7;
+
+    // Weights summing to nothing share nothing
+    data[1] = UD_Weights;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        sol_memset(data + 4 + i * (sizeof (uint8_t) + sizeof (uint64_t)), 0, sizeof (uint64_t));
+    }
+    cr_assert(host_world_run(w, data, p - data, 3) == ERROR_INVALID_INSTRUCTION_DATA && sol_host_calls_len == 0);
+    data[2] = 0;
+    cr_assert(host_world_run(w, data, 3, 3) == ERROR_INVALID_INSTRUCTION_DATA && sol_host_calls_len == 0);
+
+    // An unsharded storage takes the recipients right after the group
+    data[1] = UD_Amounts;
+    data[2] = 3;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        uint8_t *entry = data + 3 + i * (sizeof (uint8_t) + sizeof (uint64_t));
+        entry[0] = 6 + i;
+        const uint64_t amount = 100;
+        sol_memcpy(entry + 1, &amount, sizeof (amount));
+    }
+    SolParameters params = {
+        .ka         = w->ka,
+        .ka_num     = host_world_accounts(w, UI_Distribute, 3) - 1,
+        .data       = data,
+        .data_len   = p - data,
+        .program_id = &w->program_id
+    };
+    for (int i = 6; i < 9; i++)
+    {
+        w->ka[i] = w->ka[i + 1];
+    }
+    sol_host_calls_len = 0;
+    cr_assert(processing(&params) == SUCCESS && sol_host_calls_len == 3);
+    cr_assert(SolPubkey_same(&sol_host_calls[0].accounts[1], &w->keys[UA_RolesCount]));
+    params.ka_num = 5;
+    cr_assert(processing(&params) == ERROR_NOT_ENOUGH_ACCOUNT_KEYS);
+    host_world_free(w);
+}
+
+Test(shard, create) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    uint8_t data[] = {UI_CreateShard, 4, 0, 1, 0};
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == ERROR_INVALID_ARGUMENT);   // Holds a group
+
+    upala_storage_init(&w->accounts[UA_PoolsManager], UINT8_MAX, &w->keys[UA_Manager]);
+    host_world_shard_keys(w, 1);
+    *w->accounts[UA_Registry].owner = (SolPubkey){{0}};
+    w->lamports[UA_Registry] = 0;
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == SUCCESS);
+
+    // The shard and its registry
+    cr_assert(sol_host_calls_len == 2);
+    cr_assert(sol_host_calls[0].signed_by_program && SolPubkey_same(&sol_host_calls[0].accounts[1], &w->keys[UA_Shard]));
+    cr_assert(SolPubkey_same(&sol_host_calls[1].accounts[1], &w->keys[UA_Registry]));
+    cr_assert(host_world_storage(w)->shards_count == 4 && host_world_storage(w)->groups_count == 0);
+    cr_assert(host_world_registry(w)->shards_count == 4 && host_world_registry(w)->shard == 1);
+
+    data[1] = 8;
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == ERROR_INVALID_ARGUMENT);   // The count is fixed
+    data[1] = 4;
+    data[3] = 4;
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == ERROR_INVALID_INSTRUCTION_DATA);
+    data[3] = 2;
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == INVALID_SEEDS);
+    host_world_free(w);
+}
+
+Test(shard, route) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+    host_world_shard(w, 4);
+    const uint16_t shard = upala_shard_of(&w->keys[UA_Pool], 4);
+    const SolPubkey *gid = &w->keys[UA_Pool];
+    uint8_t data[1 + SIZE_PUBKEY + 1 + 10 * sizeof (UpalaAccount)];
+
+    // Only the accounts of the shard are written
+    w->accounts[UA_PoolsManager].is_writable = false;
+    uint64_t len = host_members(data, UI_AddUser, gid, 0, 10);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+    cr_assert(host_world_registry(w)->users_count == 10 && host_world_member(w, 9)->score == 9);
+    len = host_members(data, UI_SetScore, gid, 0, 1);
+    cr_assert(host_world_run(w, data, len, 0) == SUCCESS);
+
+    // The registry of another shard does not take the members of the group
+    host_world_registry(w)->shard = (shard + 1) % 4;
+    cr_assert(host_world_run(w, data, len, 0) == ERROR_INVALID_ACCOUNT_DATA);
+    host_world_registry(w)->shard = shard;
+
+    // The shard account is checked by its address, then by its groups
+    UpalaStorage *storage = (UpalaStorage *) w->accounts[UA_Shard].data;
+    storage->shard = (shard + 1) % 4;
+    const uint8_t remove[] = {UI_RemovePool};
+    cr_assert(host_world_run(w, remove, sizeof (remove), 0) == INVALID_SEEDS);
+    host_world_shard_keys(w, storage->shard);
+    cr_assert(host_world_run(w, remove, sizeof (remove), 0) == ERROR_INVALID_ARGUMENT);
+    host_world_shard_keys(w, shard);
+    storage->shard = shard;
+
+    cr_assert(host_world_run(w, remove, sizeof (remove), 0) == SUCCESS);
+    cr_assert(storage->groups_count == 0 && host_world_storage(w)->shards_count == 4);
+    host_world_free(w);
+}
+
+Test(migrate, current_layouts) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+
+    // The accounts of the current layouts are left as they are
+    const uint8_t migrate[] = {UI_Migrate};
+    const uint64_t group_len = host_len(&w->accounts[UA_Group]);
+    cr_assert(host_world_run(w, migrate, sizeof (migrate), 0) == SUCCESS && sol_host_calls_len == 0);
+    cr_assert(host_len(&w->accounts[UA_Group]) == group_len);
+
+    UpalaGroupData *gd = host_world_group(w);
+    gd->layout.version = UPALA_GROUP_VERSION + 1;
+    cr_assert(host_world_run(w, migrate, sizeof (migrate), 0) == ERROR_INVALID_ACCOUNT_DATA);
+    gd->layout.version = UPALA_GROUP_VERSION;
+    host_world_storage(w)->layout.version = UPALA_STORAGE_VERSION + 1;
+    cr_assert(host_world_run(w, migrate, sizeof (migrate), 0) == ERROR_INVALID_ACCOUNT_DATA);
+    host_world_free(w);
+}
+
+Test(entrypoint, decodes_input) {
+    HostWorld *w = host_world_new();
+    host_world_create(w, 0, UPALA_GROUP_INITIAL_CAPACITY, 0);
+    *w->accounts[UA_UserAt].owner = w->keys[UA_SplToken];
+    uint8_t data[1 + SIZE_PUBKEY + 1 + 2 * sizeof (UpalaAccount)];
+    host_members(data, UI_AddUser, &w->keys[UA_Pool], 0, 2);
+    cr_assert(host_world_run(w, data, sizeof (data), 0) == SUCCESS);
+
+    // The accounts of the schema repeated past the UPALA_MAX_ACCOUNTS read
+    const uint64_t count = host_world_accounts(w, UI_SetScore, 0);
+    SolAccountInfo accounts[UPALA_MAX_ACCOUNTS + 2];
+    for (uint64_t i = 0; i < SOL_ARRAY_SIZE(accounts); i++)
+    {
+        accounts[i] = w->ka[i % count];
+    }
+    const uint64_t len = host_members(data, UI_RemoveUser, &w->keys[UA_Pool], 1, 1);
+    uint8_t *input = calloc(1, host_input_len(accounts, SOL_ARRAY_SIZE(accounts), len));
+    host_serialize(input, accounts, SOL_ARRAY_SIZE(accounts), data, len, &w->program_id);
+
+    UpalaInput in;
+    cr_assert(upala_input_parse(input, &in));
+    cr_assert(in.ka_num == UPALA_MAX_ACCOUNTS && in.data_len == len && in.data[0] == UI_RemoveUser);
+    cr_assert(SolPubkey_same(in.program_id, &w->program_id));
+    for (uint64_t i = 0; i < UPALA_MAX_ACCOUNTS; i++)
+    {
+        SolAccountInfo account;
+        upala_input_account(&in, i, &account);
+        const SolAccountInfo *expected = &accounts[i];
+        cr_assert(SolPubkey_same(account.key, expected->key) && account.data_len == expected->data_len);
+        cr_assert(account.is_writable == expected->is_writable && *account.lamports == *expected->lamports);
+        cr_assert(sol_memcmp(account.data, expected->data, account.data_len) == 0);
+    }
+
+    cr_assert(entrypoint(input) == SUCCESS);
+    upala_input_account(&in, 3, &accounts[0]);
+    UpalaGroupData *gd = (UpalaGroupData *) accounts[0].data;
+    cr_assert(gd->accounts_count == 1 && upala_group_member(gd, 0)->score == 0);
+    free(input);
+    host_world_free(w);
+}
+
+/// Writes the operation header of a batch with a payload of `len` bytes
+static uint8_t *batch_operation(uint8_t *p, uint8_t instruction, uint16_t len)
+{
+    p[0] = instruction;
+    sol_memset(p + 1, UPALA_NO_ACCOUNT, 4);
+    sol_memcpy(p + 5, &len, sizeof (len));
+    return p + UPALA_BATCH_OPERATION_LEN;
+}
+
+Test(payload, rejects_malformed) {
+    UpalaPayload payload;
+    uint8_t data[2 * (UPALA_BATCH_OPERATION_LEN + SIZE_PUBKEY + 1 + 2 * sizeof (UpalaAccount)) + 2];
+    sol_memset(data, 0, sizeof (data));
+    const uint64_t members = SIZE_PUBKEY + 1 + 2 * sizeof (UpalaAccount);
+    data[SIZE_PUBKEY] = 2;
+    cr_assert(upala_payload_decode(UI_SetScore, data, members, &payload) && payload.count == 2);
+
+    // Truncated: in the fixed fields, then in the entries
+    cr_assert(!upala_payload_decode(UI_SetScore, data, SIZE_PUBKEY, &payload));
+    cr_assert(!upala_payload_decode(UI_Claim, data, SIZE_PUBKEY - 1, &payload));
+    cr_assert(!upala_payload_decode(UI_SetScore, data, members - 1, &payload));
+
+    // Trailing bytes past the fields or the entries
+    cr_assert(!upala_payload_decode(UI_Claim, data, SIZE_PUBKEY + 1, &payload));
+    cr_assert(!upala_payload_decode(UI_CleanStorage, data, 1, &payload));
+    cr_assert(!upala_payload_decode(UI_SetScore, data, members + 1, &payload));
+
+    // A count larger than the entries that follow
+    data[SIZE_PUBKEY] = 3;
+    cr_assert(!upala_payload_decode(UI_SetScore, data, members, &payload));
+    data[SIZE_PUBKEY] = UINT8_MAX;
+    cr_assert(!upala_payload_decode(UI_RemoveUser, data, members, &payload));
+
+    // Nested batch payloads, each operation checked against its own shape
+    uint8_t *p = data;
+    *p++ = 2;
+    for (int o = 0; o < 2; o++)
+    {
+        p = batch_operation(p, UI_SetScore, SIZE_PUBKEY + 1 + sizeof (UpalaAccount));
+        sol_memset(p, 0, SIZE_PUBKEY);
+        p[SIZE_PUBKEY] = 1;
+        p += SIZE_PUBKEY + 1 + sizeof (UpalaAccount);
+    }
+    const uint64_t batch = (uint64_t)(p - data);
+    cr_assert(upala_payload_decode(UI_Batch, data, batch, &payload) && payload.count == 2);
+    cr_assert(!upala_payload_decode(UI_Batch, data, batch + 1, &payload));      // Trailing byte
+    cr_assert(!upala_payload_decode(UI_Batch, data, batch - 1, &payload));      // Last operation truncated
+    data[0] = 3;
+    cr_assert(!upala_payload_decode(UI_Batch, data, batch, &payload));          // Count past the operations
+    data[0] = 2;
+
+    uint8_t *second = data + 1 + UPALA_BATCH_OPERATION_LEN + SIZE_PUBKEY + 1 + sizeof (UpalaAccount);
+    second[UPALA_BATCH_OPERATION_LEN + SIZE_PUBKEY] = 2;                      // Count past its entries
+    cr_assert(!upala_payload_decode(UI_Batch, data, batch, &payload));
+    second[UPALA_BATCH_OPERATION_LEN + SIZE_PUBKEY] = 1;
+    second[5] -= 1;                                                             // Length short of its entries
+    cr_assert(!upala_payload_decode(UI_Batch, data, batch - 1, &payload));
+    second[5] += 1;
+    second[6] = 1;                                                              // Length past the data
+    cr_assert(!upala_payload_decode(UI_Batch, data, batch, &payload));
+    second[6] = 0;
+    second[0] = UI_Batch;                                                       // A batch in a batch
+    cr_assert(!upala_payload_decode(UI_Batch, data, batch, &payload));
+    second[0] = UI_GetMember;
+    cr_assert(!upala_payload_decode(UI_Batch, data, batch, &payload));
+    second[0] = UI_SetScore;
+    cr_assert(upala_payload_decode(UI_Batch, data, batch, &payload));
 }
@@ -0,0 +1,9 @@
+/**
+ * @brief The Upala program built with the compute units profile
+ *
+ * Loaded by the compute units gate of cu-gate/, which reads the heap use
+ * from the profile report, see profile.h. Not deployed.
+ */
+#define UPALA_PROFILE
+
+#include "../helloworld/helloworld.c"